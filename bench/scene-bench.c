@@ -0,0 +1,532 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <drm_fourcc.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/color.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layer.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+/* Headless scene-graph benchmark.
+ *
+ * Replays synthetic workloads on a headless output with the pixman renderer
+ * and prints one JSON object per frame on stdout, with the time spent in the
+ * workload's step (e.g. updating the scene-graph), the scene timer
+ * durations and blended/copied pixel counts, the number of damage rectangles
+ * and output layers, and the number of minor page faults taken while building
+ * and committing the frame. Page faults only count memory touched for the
+ * first time, not allocations served from already mapped memory.
+ *
+ * The workloads are registered as a meson benchmark, run them with
+ * "meson test --benchmark -C build scene-bench". */
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+
+struct mem_buffer {
+	struct wlr_buffer base;
+	void *data;
+	size_t stride;
+};
+
+static void mem_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct mem_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	wlr_buffer_finish(wlr_buffer);
+	free(buffer->data);
+	free(buffer);
+}
+
+static bool mem_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct mem_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = buffer->data;
+	*format = DRM_FORMAT_ARGB8888;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void mem_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+}
+
+static const struct wlr_buffer_impl mem_buffer_impl = {
+	.destroy = mem_buffer_destroy,
+	.begin_data_ptr_access = mem_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = mem_buffer_end_data_ptr_access,
+};
+
+static struct wlr_buffer *create_mem_buffer(int width, int height,
+		uint32_t argb) {
+	struct mem_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	wlr_buffer_init(&buffer->base, &mem_buffer_impl, width, height);
+
+	buffer->stride = (size_t)width * 4;
+	buffer->data = malloc(buffer->stride * height);
+	if (buffer->data == NULL) {
+		free(buffer);
+		return NULL;
+	}
+	uint32_t *pixels = buffer->data;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		pixels[i] = argb;
+	}
+
+	return &buffer->base;
+}
+
+struct bench {
+	struct wlr_allocator *allocator;
+	struct wlr_scene *scene;
+	struct wlr_scene_output *scene_output;
+	int count;
+
+	struct wlr_scene_node **nodes;
+	size_t nodes_len;
+	struct wlr_buffer *buffer;
+	pixman_region32_t damage;
+	struct wlr_drm_format_set format_sets[2];
+	bool setup_failed;
+};
+
+struct workload {
+	const char *name;
+	float scale;
+	enum wl_output_transform transform;
+	bool output_layers;
+	void (*setup)(struct bench *bench);
+	void (*step)(struct bench *bench, int frame);
+	// If non-zero, render through an inverse EOTF color transform
+	enum wlr_color_transfer_function color_tf;
+	// If non-NULL, render with a dedicated pixman renderer created with
+	// WLR_PIXMAN_THREADS set to this value
+	const char *pixman_threads;
+};
+
+static void add_node(struct bench *bench, struct wlr_scene_node *node) {
+	struct wlr_scene_node **nodes = realloc(bench->nodes,
+		(bench->nodes_len + 1) * sizeof(bench->nodes[0]));
+	if (nodes == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		bench->setup_failed = true;
+		return;
+	}
+	bench->nodes = nodes;
+	bench->nodes[bench->nodes_len++] = node;
+}
+
+static void setup_windows(struct bench *bench) {
+	for (int i = 0; i < bench->count; i++) {
+		struct wlr_buffer *buffer = create_mem_buffer(640, 480,
+			i % 2 == 0 ? 0xFF336699 : 0x80996633);
+		struct wlr_scene_buffer *scene_buffer =
+			wlr_scene_buffer_create(&bench->scene->tree, buffer);
+		wlr_buffer_drop(buffer);
+		wlr_scene_node_set_position(&scene_buffer->node,
+			(i * 37) % (OUTPUT_WIDTH - 320), (i * 23) % (OUTPUT_HEIGHT - 240));
+		add_node(bench, &scene_buffer->node);
+	}
+}
+
+static void step_overlap(struct bench *bench, int frame) {
+	// Re-submit the top-most window, as if its client committed a frame
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_from_node(bench->nodes[bench->nodes_len - 1]);
+	wlr_scene_buffer_set_buffer(scene_buffer, scene_buffer->buffer);
+}
+
+static void step_move(struct bench *bench, int frame) {
+	for (size_t i = 0; i < bench->nodes_len; i++) {
+		struct wlr_scene_node *node = bench->nodes[i];
+		int dx = (int)(i % 5) - 2;
+		int dy = (int)(i % 3) - 1;
+		wlr_scene_node_set_position(node, node->x + dx, node->y + dy);
+	}
+}
+
+static void setup_small_damage(struct bench *bench) {
+	bench->buffer = create_mem_buffer(OUTPUT_WIDTH, OUTPUT_HEIGHT, 0xFF202020);
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&bench->scene->tree, bench->buffer);
+	add_node(bench, &scene_buffer->node);
+}
+
+static void step_small_damage(struct bench *bench, int frame) {
+	pixman_region32_clear(&bench->damage);
+	for (int i = 0; i < bench->count; i++) {
+		int x = ((i + frame) * 97) % (OUTPUT_WIDTH - 8);
+		int y = ((i + frame) * 61) % (OUTPUT_HEIGHT - 8);
+		pixman_region32_union_rect(&bench->damage, &bench->damage, x, y, 4, 4);
+	}
+
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_from_node(bench->nodes[0]);
+	wlr_scene_buffer_set_buffer_with_damage(scene_buffer, bench->buffer,
+		&bench->damage);
+}
+
+static void setup_subsurfaces(struct bench *bench) {
+	// Each window is a tree with a chain of nested subsurfaces
+	for (int i = 0; i < bench->count; i++) {
+		struct wlr_scene_tree *tree = wlr_scene_tree_create(&bench->scene->tree);
+		wlr_scene_node_set_position(&tree->node,
+			(i * 53) % (OUTPUT_WIDTH - 320), (i * 29) % (OUTPUT_HEIGHT - 240));
+		add_node(bench, &tree->node);
+
+		struct wlr_scene_tree *parent = tree;
+		for (int j = 0; j < 8; j++) {
+			struct wlr_buffer *buffer = create_mem_buffer(64, 32, 0xC0408040);
+			wlr_scene_buffer_create(parent, buffer);
+			wlr_buffer_drop(buffer);
+
+			parent = wlr_scene_tree_create(parent);
+			wlr_scene_node_set_position(&parent->node, 16, 24);
+		}
+	}
+}
+
+static struct wlr_buffer *create_alloc_buffer(struct bench *bench,
+		int width, int height, uint32_t xrgb) {
+	// Unlike memory buffers, these have shm attributes and can be put on
+	// output layers
+	struct wlr_buffer *buffer = wlr_allocator_create_buffer(bench->allocator,
+		width, height, &(struct wlr_drm_format){ .format = DRM_FORMAT_XRGB8888 });
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+		wlr_buffer_drop(buffer);
+		return NULL;
+	}
+	for (int y = 0; y < height; y++) {
+		uint32_t *row = (uint32_t *)((char *)data + y * stride);
+		for (int x = 0; x < width; x++) {
+			row[x] = xrgb;
+		}
+	}
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	return buffer;
+}
+
+static void setup_layers(struct bench *bench) {
+	// Opaque windows above a wallpaper, the top-most ones can be displayed
+	// with output layers
+	bench->buffer = create_mem_buffer(OUTPUT_WIDTH, OUTPUT_HEIGHT, 0xFF202020);
+	wlr_scene_buffer_create(&bench->scene->tree, bench->buffer);
+
+	for (int i = 0; i < bench->count; i++) {
+		struct wlr_buffer *buffer = create_alloc_buffer(bench, 256, 256,
+			0x00336699 + i * 0x010101);
+		if (buffer == NULL) {
+			continue;
+		}
+		struct wlr_scene_buffer *scene_buffer =
+			wlr_scene_buffer_create(&bench->scene->tree, buffer);
+		wlr_buffer_drop(buffer);
+		wlr_scene_node_set_position(&scene_buffer->node,
+			(i * 61) % (OUTPUT_WIDTH - 256), (i * 37) % (OUTPUT_HEIGHT - 256));
+		add_node(bench, &scene_buffer->node);
+	}
+}
+
+// Roughly what a Mesa driver exposes for rendering and scan-out
+static const uint32_t bench_formats[] = {
+	DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888, DRM_FORMAT_ABGR8888,
+	DRM_FORMAT_XBGR8888, DRM_FORMAT_RGBA8888, DRM_FORMAT_RGBX8888,
+	DRM_FORMAT_BGRA8888, DRM_FORMAT_BGRX8888, DRM_FORMAT_RGB565,
+	DRM_FORMAT_BGR565, DRM_FORMAT_ARGB2101010, DRM_FORMAT_XRGB2101010,
+	DRM_FORMAT_ABGR2101010, DRM_FORMAT_XBGR2101010, DRM_FORMAT_ABGR16161616F,
+	DRM_FORMAT_XBGR16161616F, DRM_FORMAT_ABGR16161616, DRM_FORMAT_XBGR16161616,
+	DRM_FORMAT_ARGB1555, DRM_FORMAT_XRGB1555, DRM_FORMAT_ARGB4444,
+	DRM_FORMAT_XRGB4444, DRM_FORMAT_R8, DRM_FORMAT_GR88, DRM_FORMAT_R16,
+	DRM_FORMAT_GR1616, DRM_FORMAT_RGB888, DRM_FORMAT_BGR888, DRM_FORMAT_NV12,
+	DRM_FORMAT_NV21, DRM_FORMAT_P010, DRM_FORMAT_P012, DRM_FORMAT_P016,
+	DRM_FORMAT_YUV420, DRM_FORMAT_YVU420, DRM_FORMAT_YUYV, DRM_FORMAT_UYVY,
+	DRM_FORMAT_AYUV, DRM_FORMAT_XYUV8888, DRM_FORMAT_Y410,
+};
+
+#define BENCH_FORMATS_LEN (sizeof(bench_formats) / sizeof(bench_formats[0]))
+#define BENCH_MODIFIERS_LEN 12
+
+static uint64_t bench_modifier(size_t i) {
+	if (i == 0) {
+		return DRM_FORMAT_MOD_LINEAR;
+	}
+	return fourcc_mod_code(INTEL, i);
+}
+
+static void setup_format_sets(struct bench *bench) {
+	// Two overlapping sets filled in a scrambled order, like a renderer's
+	// texture formats and a plane's scan-out formats
+	for (size_t k = 0; k < 2; k++) {
+		struct wlr_drm_format_set *set = &bench->format_sets[k];
+		for (size_t i = 0; i < BENCH_FORMATS_LEN; i++) {
+			size_t format_idx = (i * 7 + k * 3) % BENCH_FORMATS_LEN;
+			for (size_t j = 0; j < BENCH_MODIFIERS_LEN; j++) {
+				size_t modifier_idx = (j * 5 + k) % BENCH_MODIFIERS_LEN;
+				if ((format_idx + modifier_idx + k) % 4 == 0) {
+					continue;
+				}
+				wlr_drm_format_set_add(set, bench_formats[format_idx],
+					bench_modifier(modifier_idx));
+			}
+		}
+	}
+}
+
+static void step_format_sets(struct bench *bench, int frame) {
+	const struct wlr_drm_format_set *a = &bench->format_sets[0];
+	const struct wlr_drm_format_set *b = &bench->format_sets[1];
+	size_t found = 0;
+	for (int i = 0; i < bench->count; i++) {
+		struct wlr_drm_format_set set = {0};
+		wlr_drm_format_set_intersect(&set, a, b);
+		wlr_drm_format_set_union(&set, a, &set);
+		for (size_t j = 0; j < BENCH_FORMATS_LEN; j++) {
+			for (size_t k = 0; k < BENCH_MODIFIERS_LEN; k++) {
+				found += wlr_drm_format_set_has(&set, bench_formats[j],
+					bench_modifier(k));
+			}
+			found += wlr_drm_format_set_get(b, bench_formats[j]) != NULL;
+		}
+		wlr_drm_format_set_finish(&set);
+	}
+	if (found == 0) {
+		fprintf(stderr, "Format set lookups found nothing\n");
+	}
+}
+
+static const struct workload workloads[] = {
+	{ "overlap", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_overlap },
+	{ "move", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_move },
+	{ "small-damage", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_small_damage, step_small_damage },
+	{ "fractional-scale", 1.5, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_move },
+	{ "rotated", 1, WL_OUTPUT_TRANSFORM_90, false, setup_windows, step_move },
+	{ "subsurfaces", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_subsurfaces, step_move },
+	{ "layers", 1, WL_OUTPUT_TRANSFORM_NORMAL, true, setup_layers, step_move },
+	{ "format-sets", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_format_sets, step_format_sets },
+	{ "color-transform", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_move,
+		WLR_COLOR_TRANSFER_FUNCTION_SRGB },
+	{ "threads-single", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_move,
+		0, "1" },
+	{ "threads-multi", 1, WL_OUTPUT_TRANSFORM_NORMAL, false, setup_windows, step_move,
+		0, "0" },
+};
+
+static long get_minor_faults(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
+
+static bool run_workload(const struct workload *workload,
+		struct wlr_backend *backend, struct wlr_renderer *renderer,
+		struct wlr_allocator *allocator, int count, int frames) {
+	struct wlr_output *output =
+		wlr_headless_add_output(backend, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	if (output == NULL || !wlr_output_init_render(output, allocator, renderer)) {
+		return false;
+	}
+
+	struct wlr_output_state state;
+	wlr_output_state_init(&state);
+	wlr_output_state_set_enabled(&state, true);
+	wlr_output_state_set_scale(&state, workload->scale);
+	wlr_output_state_set_transform(&state, workload->transform);
+	bool ok = wlr_output_commit_state(output, &state);
+	wlr_output_state_finish(&state);
+	if (!ok) {
+		wlr_output_destroy(output);
+		return false;
+	}
+
+	// Output layers can only be enabled through the environment
+	if (workload->output_layers) {
+		setenv("WLR_SCENE_OUTPUT_LAYERS", "1", true);
+	}
+	struct bench bench = {
+		.allocator = allocator,
+		.scene = wlr_scene_create(),
+		.count = count,
+	};
+	unsetenv("WLR_SCENE_OUTPUT_LAYERS");
+	pixman_region32_init(&bench.damage);
+	bench.scene_output = wlr_scene_output_create(bench.scene, output);
+	workload->setup(&bench);
+	ok = !bench.setup_failed;
+
+	struct wlr_color_transform *color_transform = NULL;
+	if (workload->color_tf != 0) {
+		color_transform =
+			wlr_color_transform_init_linear_to_inverse_eotf(workload->color_tf);
+		ok = ok && color_transform != NULL;
+	}
+
+	struct wlr_scene_timer timer = {0};
+	for (int frame = 0; frame < frames && ok; frame++) {
+		struct timespec step_start, step_end;
+		clock_gettime(CLOCK_MONOTONIC, &step_start);
+		workload->step(&bench, frame);
+		clock_gettime(CLOCK_MONOTONIC, &step_end);
+		int64_t step_ns = (int64_t)(step_end.tv_sec - step_start.tv_sec) * 1000000000 +
+			(step_end.tv_nsec - step_start.tv_nsec);
+
+		long faults = get_minor_faults();
+
+		wlr_output_state_init(&state);
+		ok = wlr_scene_output_build_state(bench.scene_output, &state,
+			&(struct wlr_scene_output_state_options){
+				.timer = &timer,
+				.color_transform = color_transform,
+			});
+		ok = ok && wlr_output_commit_state(output, &state);
+
+		faults = get_minor_faults() - faults;
+
+		int damage_rects = 0;
+		if (state.committed & WLR_OUTPUT_STATE_DAMAGE) {
+			pixman_region32_rectangles(&state.damage, &damage_rects);
+		}
+		size_t layers = 0;
+		if (state.committed & WLR_OUTPUT_STATE_LAYERS) {
+			for (size_t i = 0; i < state.layers_len; i++) {
+				layers += state.layers[i].buffer != NULL;
+			}
+		}
+		wlr_output_state_finish(&state);
+
+		int render_ns = -1;
+		if (timer.render_timer != NULL) {
+			render_ns = wlr_render_timer_get_duration_ns(timer.render_timer);
+		}
+
+		printf("{\"workload\":\"%s\",\"frame\":%d,\"count\":%d,"
+			"\"step_ns\":%" PRId64 ",\"pre_render_ns\":%" PRId64 ","
+			"\"render_ns\":%d,"
+			"\"blended_pixels\":%" PRIu64 ",\"copied_pixels\":%" PRIu64 ","
+			"\"damage_rects\":%d,\"layers\":%zu,\"minor_faults\":%ld,"
+			"\"ok\":%s}\n",
+			workload->name, frame, count, step_ns, timer.pre_render_duration,
+			render_ns, timer.blended_pixels, timer.copied_pixels,
+			damage_rects, layers, faults, ok ? "true" : "false");
+	}
+	wlr_scene_timer_finish(&timer);
+	wlr_color_transform_unref(color_transform);
+
+	wlr_scene_node_destroy(&bench.scene->tree.node);
+	if (bench.buffer != NULL) {
+		wlr_buffer_drop(bench.buffer);
+	}
+	pixman_region32_fini(&bench.damage);
+	wlr_drm_format_set_finish(&bench.format_sets[0]);
+	wlr_drm_format_set_finish(&bench.format_sets[1]);
+	free(bench.nodes);
+	wlr_output_destroy(output);
+	return ok;
+}
+
+static const char usage[] =
+	"usage: scene-bench [-w workload] [-n count] [-f frames]\n"
+	"\n"
+	"Workloads: overlap, move, small-damage, fractional-scale, rotated,\n"
+	"subsurfaces, layers, format-sets, color-transform, threads-single,\n"
+	"threads-multi. All workloads are run if -w isn't specified.\n";
+
+int main(int argc, char *argv[]) {
+	const char *name = NULL;
+	int count = 32, frames = 120;
+	int c;
+	while ((c = getopt(argc, argv, "w:n:f:h")) != -1) {
+		switch (c) {
+		case 'w':
+			name = optarg;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (count <= 0 || frames <= 0) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct wlr_backend *backend = wlr_headless_backend_create(loop);
+	struct wlr_renderer *renderer = wlr_pixman_renderer_create();
+	if (backend == NULL || renderer == NULL) {
+		return EXIT_FAILURE;
+	}
+	struct wlr_allocator *allocator = wlr_allocator_autocreate(backend, renderer);
+	if (allocator == NULL || !wlr_backend_start(backend)) {
+		return EXIT_FAILURE;
+	}
+
+	bool found = false, ok = true;
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+		if (name != NULL && strcmp(workloads[i].name, name) != 0) {
+			continue;
+		}
+		found = true;
+
+		// The pixman thread count is only read when the renderer is created
+		struct wlr_renderer *workload_renderer = renderer;
+		struct wlr_allocator *workload_allocator = allocator;
+		if (workloads[i].pixman_threads != NULL) {
+			setenv("WLR_PIXMAN_THREADS", workloads[i].pixman_threads, true);
+			workload_renderer = wlr_pixman_renderer_create();
+			unsetenv("WLR_PIXMAN_THREADS");
+			workload_allocator = workload_renderer != NULL ?
+				wlr_allocator_autocreate(backend, workload_renderer) : NULL;
+		}
+
+		if (workload_allocator == NULL || !run_workload(&workloads[i], backend,
+				workload_renderer, workload_allocator, count, frames)) {
+			fprintf(stderr, "Workload %s failed\n", workloads[i].name);
+			ok = false;
+		}
+
+		if (workload_renderer != renderer) {
+			wlr_allocator_destroy(workload_allocator);
+			wlr_renderer_destroy(workload_renderer);
+		}
+	}
+	if (!found) {
+		fprintf(stderr, "Unknown workload: %s\n", name);
+		ok = false;
+	}
+
+	wlr_allocator_destroy(allocator);
+	wlr_renderer_destroy(renderer);
+	wlr_backend_destroy(backend);
+	wl_event_loop_destroy(loop);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,12 +1,19 @@
 #ifndef RENDER_DRM_FORMAT_SET_H
 #define RENDER_DRM_FORMAT_SET_H
 
+#include <sys/types.h>
 #include <wlr/render/drm_format_set.h>
 
 void wlr_drm_format_init(struct wlr_drm_format *fmt, uint32_t format);
 bool wlr_drm_format_has(const struct wlr_drm_format *fmt, uint64_t modifier);
 bool wlr_drm_format_add(struct wlr_drm_format *fmt, uint64_t modifier);
 bool wlr_drm_format_copy(struct wlr_drm_format *dst, const struct wlr_drm_format *src);
+/**
+ * Get the position of a modifier in the format's sorted modifier list, or -1
+ * if the format doesn't support the modifier.
+ */
+ssize_t wlr_drm_format_get_modifier_index(const struct wlr_drm_format *fmt,
+	uint64_t modifier);
 /**
  * Intersect modifiers for two DRM formats. The `dst` must be zeroed or initialized
  * with other state being replaced.
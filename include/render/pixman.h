@@ -1,10 +1,13 @@
 #ifndef RENDER_PIXMAN_H
 #define RENDER_PIXMAN_H
 
+#include <wlr/render/color.h>
 #include <wlr/render/drm_format_set.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/util/addon.h>
+#include "render/color.h"
 #include "render/pixel_format.h"
 
 struct wlr_pixman_pixel_format {
@@ -13,12 +16,25 @@ struct wlr_pixman_pixel_format {
 };
 
 struct wlr_pixman_buffer;
+struct wlr_pixman_worker_pool;
+
+struct wlr_pixman_render_timer {
+	struct wlr_render_timer base;
+
+	bool submitted;
+	struct wlr_pixman_render_timings timings;
+};
 
 struct wlr_pixman_renderer {
 	struct wlr_renderer wlr_renderer;
 
 	struct wl_list buffers; // wlr_pixman_buffer.link
 	struct wl_list textures; // wlr_pixman_texture.link
+	struct wl_list color_transforms; // wlr_pixman_color_transform.link
+	struct wl_list deferred_passes; // wlr_pixman_render_pass.link
+
+	// NULL if render passes are executed on the calling thread
+	struct wlr_pixman_worker_pool *workers;
 
 	struct wlr_drm_format_set drm_formats;
 };
@@ -28,6 +44,9 @@ struct wlr_pixman_buffer {
 	struct wlr_pixman_renderer *renderer;
 
 	pixman_image_t *image;
+	// Intermediate image in blending space, used by passes with a color
+	// transform, may be NULL
+	pixman_image_t *blend_image;
 
 	struct wl_listener buffer_destroy;
 	struct wl_list link; // wlr_pixman_renderer.buffers
@@ -46,19 +65,120 @@ struct wlr_pixman_texture {
 	struct wlr_buffer *buffer; // if created via texture_from_buffer
 };
 
+/**
+ * Per-renderer look-up tables which map 8-bit values in blending space to their
+ * transformed, encoded output counterparts.
+ *
+ * Tables are cached by value: inverse EOTF transforms are matched by transfer
+ * function, since callers typically create a new one for each frame, other
+ * transforms by identity. The destination primaries are part of the key.
+ */
+struct wlr_pixman_color_transform {
+	struct wl_list link; // wlr_pixman_renderer.color_transforms
+
+	enum wlr_color_transform_type type;
+	// Only set for inverse EOTF transforms
+	enum wlr_color_transfer_function tf;
+	// NULL for inverse EOTF transforms
+	struct wlr_color_transform *color_transform;
+	struct wlr_addon addon; // on color_transform, owned by this struct
+	bool has_primaries;
+	struct wlr_color_primaries primaries;
+	// Number of render passes using the tables, which can't be evicted
+	size_t passes;
+
+	// Set if the transform doesn't change anything
+	bool identity;
+	// Set if each channel can be transformed independently through lut_1d,
+	// otherwise lut_3d is used
+	bool separable;
+	uint8_t lut_1d[3][256];
+
+	uint16_t *lut_3d;
+	uint8_t lut_3d_index[256];
+	uint16_t lut_3d_frac[256];
+};
+
 struct wlr_pixman_render_pass {
 	struct wlr_render_pass base;
 	struct wlr_pixman_buffer *buffer;
+	struct wlr_pixman_render_timer *timer; // may be NULL
+
+	// Holds a reference to the transform the tables were built from, so that
+	// they can't be destroyed before the pass is submitted
+	struct wlr_color_transform *color_transform_ref;
+	// Tables applied when copying the blend image to the buffer, NULL if
+	// operations are drawn on the buffer directly
+	struct wlr_pixman_color_transform *color_transform;
+	// Image operations are drawn on: the buffer's image, or its blend image
+	// if there is a color transform
+	pixman_image_t *target;
+	// Area written to by the pass, only filled if there is a color transform
+	// or if the pass is deferred
+	pixman_region32_t damage;
+
+	// Deferred passes record operations and execute them on worker threads
+	// at submit time
+	bool deferred;
+	struct wl_array ops; // struct pixman_render_op
+	struct wl_array texture_buffers; // struct wlr_buffer *, accessed by ops
+	struct wl_list link; // wlr_pixman_renderer.deferred_passes
+	// Set if an operation couldn't be recorded, failing the submission
+	bool failed;
 };
 
 pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
 uint32_t get_drm_format_from_pixman(pixman_format_code_t fmt);
 const uint32_t *get_pixman_drm_formats(size_t *len);
 
+struct wlr_pixman_render_timer *pixman_get_render_timer(
+	struct wlr_render_timer *timer);
+
 bool begin_pixman_data_ptr_access(struct wlr_buffer *buffer, pixman_image_t **image_ptr,
 	uint32_t flags);
 
 struct wlr_pixman_render_pass *begin_pixman_render_pass(
-	struct wlr_pixman_buffer *buffer);
+	struct wlr_pixman_buffer *buffer, const struct wlr_buffer_pass_options *options);
+
+/**
+ * Execute the operations recorded by a deferred render pass so far.
+ */
+void pixman_render_pass_flush(struct wlr_pixman_render_pass *pass);
+
+/**
+ * Create a pool of threads_len worker threads.
+ */
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads_len);
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool);
+/**
+ * Get the number of threads running tasks, including the calling thread.
+ */
+size_t pixman_worker_pool_get_threads(struct wlr_pixman_worker_pool *pool);
+/**
+ * Run tasks_len tasks on the worker threads and the calling thread, and wait
+ * for all of them to complete.
+ */
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool, size_t tasks_len,
+	void (*run)(void *data, size_t index), void *data);
+
+struct wlr_pixman_color_transform *pixman_color_transform_get_or_create(
+	struct wlr_pixman_renderer *renderer, struct wlr_color_transform *tr,
+	const struct wlr_color_primaries *primaries);
+void pixman_color_transform_destroy(struct wlr_pixman_color_transform *transform);
+/**
+ * Get the format of the blend image used with a destination image format.
+ */
+pixman_format_code_t pixman_color_transform_get_blend_format(pixman_format_code_t format);
+/**
+ * Check whether color transforms can be applied to a destination image format.
+ * Only 32-bit formats with 8 bits per color channel are supported.
+ */
+bool pixman_color_transform_supports_format(pixman_format_code_t format);
+/**
+ * Write the pixels of the blend image inside region to the destination image,
+ * applying the color transform.
+ */
+void pixman_color_transform_apply(const struct wlr_pixman_color_transform *transform,
+	pixman_image_t *dst, pixman_image_t *blend, const pixman_region32_t *region);
 
 #endif
@@ -44,6 +44,8 @@ struct wlr_vk_device {
 	bool sync_file_import_export;
 	bool implicit_sync_interop;
 	bool sampler_ycbcr_conversion;
+	// VK_EXT_host_image_copy: shm uploads may be written by the CPU
+	bool host_image_copy;
 
 	// we only ever need one queue for rendering and transfer commands
 	uint32_t queue_family;
@@ -56,6 +58,10 @@ struct wlr_vk_device {
 		PFN_vkGetSemaphoreFdKHR vkGetSemaphoreFdKHR;
 		PFN_vkImportSemaphoreFdKHR vkImportSemaphoreFdKHR;
 		PFN_vkQueueSubmit2KHR vkQueueSubmit2KHR;
+#ifdef VK_EXT_host_image_copy
+		PFN_vkCopyMemoryToImageEXT vkCopyMemoryToImageEXT;
+		PFN_vkTransitionImageLayoutEXT vkTransitionImageLayoutEXT;
+#endif
 	} api;
 
 	uint32_t format_prop_count;
@@ -109,6 +115,7 @@ struct wlr_vk_format_props {
 		VkExtent2D max_extent;
 		VkFormatFeatureFlags features;
 		bool has_mutable_srgb;
+		bool host_image_copy;
 	} shm;
 
 	struct {
@@ -270,8 +277,6 @@ struct wlr_vk_command_buffer {
 	uint64_t timeline_point;
 	// Textures to destroy after the command buffer completes
 	struct wl_list destroy_textures; // wlr_vk_texture.destroy_link
-	// Staging shared buffers to release after the command buffer completes
-	struct wl_list stage_buffers; // wlr_vk_shared_buffer.link
 	// Color transform to unref after the command buffer completes
 	struct wlr_color_transform *color_transform;
 
@@ -282,6 +287,8 @@ struct wlr_vk_command_buffer {
 };
 
 #define VULKAN_COMMAND_BUFFERS_CAP 64
+// Number of idle images kept around for asynchronous reads
+#define VULKAN_READ_PIXELS_POOL_CAP 4
 
 // Vulkan wlr_renderer implementation on top of a wlr_vk_device.
 struct wlr_vk_renderer {
@@ -332,13 +339,22 @@ struct wlr_vk_renderer {
 
 	struct wl_list color_transforms; // wlr_vk_color_transform.link
 
+	// Log the number of draw calls of each render pass
+	bool log_draw_calls;
+
 	// Pool of command buffers
 	struct wlr_vk_command_buffer command_buffers[VULKAN_COMMAND_BUFFERS_CAP];
 
 	struct {
 		struct wlr_vk_command_buffer *cb;
 		uint64_t last_timeline_point;
-		struct wl_list buffers; // wlr_vk_shared_buffer.link
+		struct wl_list buffers; // wlr_vk_shared_buffer.link, by size
+		int64_t last_trim_ms;
+		// Render passes being recorded, whose stage allocations (e.g. vertex
+		// data) are only attached to a submission when the pass is submitted
+		size_t recording_passes;
+		uint64_t buffers_created, buffers_destroyed;
+		uint64_t host_image_copies;
 	} stage;
 
 	struct {
@@ -348,6 +364,12 @@ struct wlr_vk_renderer {
 		VkImage dst_image;
 		VkDeviceMemory dst_img_memory;
 	} read_pixels_cache;
+
+	struct {
+		// wlr_vk_read_pixels_image.link, most recently released first
+		struct wl_list images;
+		size_t len;
+	} read_pixels_pool;
 };
 
 // vertex shader push constant range data
@@ -357,6 +379,12 @@ struct wlr_vk_vert_pcr_data {
 	float uv_size[2];
 };
 
+// Per-instance vertex data of quad draws: each instance draws the part of the
+// quad described by the push constants inside the rectangle
+struct wlr_vk_quad_instance {
+	float rect[4]; // x1, y1, x2, y2 in unit quad coordinates
+};
+
 struct wlr_vk_frag_texture_pcr_data {
 	float matrix[4][4]; // only a 3x3 subset is used
 	float alpha;
@@ -401,6 +429,15 @@ VkCommandBuffer vulkan_record_stage_cb(struct wlr_vk_renderer *renderer);
 // Submits the current stage command buffer and waits until it has
 // finished execution.
 bool vulkan_submit_stage_wait(struct wlr_vk_renderer *renderer);
+// Releases stage allocations of completed submissions and destroys the stage
+// buffers which have remained unused or oversized for too long. Called when
+// recording commands and when textures or render buffers are destroyed, since
+// an idle renderer doesn't record anything.
+void vulkan_trim_stage(struct wlr_vk_renderer *renderer);
+// Submits the current stage command buffer without waiting, and returns a
+// sync_file signalled once it has finished execution, or -1 on error.
+// Requires sync_file export support.
+int vulkan_submit_stage_sync_file(struct wlr_vk_renderer *renderer);
 
 struct wlr_vk_render_pass_texture {
 	struct wlr_vk_texture *texture;
@@ -430,18 +467,29 @@ struct wlr_vk_render_pass {
 	uint64_t signal_point;
 
 	struct wl_array textures; // struct wlr_vk_render_pass_texture
+
+	size_t draw_calls, quad_instances;
 };
 
 struct wlr_vk_render_pass *vulkan_begin_render_pass(struct wlr_vk_renderer *renderer,
 	struct wlr_vk_render_buffer *buffer, const struct wlr_buffer_pass_options *options);
 
 // Suballocates a buffer span with the given size that can be mapped
-// and used as staging buffer. The allocation is implicitly released when the
-// stage cb has finished execution. The start of the span will be a multiple
-// of the given alignment.
+// and used as staging buffer or vertex buffer. The start of the span will be
+// a multiple of the given alignment.
+//
+// Allocations are attached to the next submission as a segment of the ring
+// buffer: the next render pass submission, or the next stage command buffer
+// submission if no render pass is being recorded. The allocation is released
+// once the timeline point signalled by that submission is reached. Until
+// then, it stays pending.
 struct wlr_vk_buffer_span vulkan_get_stage_span(
 	struct wlr_vk_renderer *renderer, VkDeviceSize size,
 	VkDeviceSize alignment);
+// Attaches all stage allocations made since the last call to the submission
+// signalling the given timeline point.
+void vulkan_stage_mark_submit(struct wlr_vk_renderer *renderer,
+	uint64_t timeline_point);
 
 // Tries to allocate a texture descriptor set. Will additionally
 // return the pool it was allocated from when successful (for freeing it later).
@@ -469,6 +517,9 @@ uint64_t vulkan_end_command_buffer(struct wlr_vk_command_buffer *cb,
 void vulkan_reset_command_buffer(struct wlr_vk_command_buffer *cb);
 bool vulkan_wait_command_buffer(struct wlr_vk_command_buffer *cb,
 	struct wlr_vk_renderer *renderer);
+// Creates the binary semaphore used to export a sync_file, if necessary
+bool vulkan_command_buffer_init_binary_semaphore(struct wlr_vk_command_buffer *cb,
+	struct wlr_vk_renderer *renderer);
 
 bool vulkan_sync_render_buffer(struct wlr_vk_renderer *renderer,
 	struct wlr_vk_render_buffer *render_buffer, struct wlr_vk_command_buffer *cb,
@@ -482,6 +533,33 @@ bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
 	uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
 	uint32_t dst_x, uint32_t dst_y, void *data);
 
+// Host-visible image the pixels are copied to, recycled across asynchronous
+// reads of the same format and size
+struct wlr_vk_read_pixels_image {
+	VkImage image;
+	VkDeviceMemory memory;
+	uint32_t drm_format, width, height;
+	struct wl_list link; // wlr_vk_renderer.read_pixels_pool.images
+};
+
+struct wlr_vk_read_pixels_async {
+	struct wlr_texture_read_pixels_async base;
+	struct wlr_vk_renderer *renderer;
+
+	struct wlr_vk_read_pixels_image *image;
+
+	// Command buffer performing the copy
+	struct wlr_vk_command_buffer *cb;
+	uint64_t timeline_point;
+};
+
+// Asynchronous variant of vulkan_read_pixels(). Returns NULL if sync_file
+// export isn't supported.
+struct wlr_vk_read_pixels_async *vulkan_read_pixels_async(
+	struct wlr_vk_renderer *vk_renderer,
+	VkFormat src_format, VkImage src_image, uint32_t drm_format,
+	uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y);
+
 // State (e.g. image texture) associated with a surface.
 struct wlr_vk_texture {
 	struct wlr_texture wlr_texture;
@@ -496,6 +574,7 @@ struct wlr_vk_texture {
 	bool transitioned; // if dma_imported: whether we transitioned it away from preinit
 	bool has_alpha; // whether the image is has alpha channel
 	bool using_mutable_srgb; // can be accessed through _SRGB format view
+	bool host_image_copy; // can be written by the CPU via VK_EXT_host_image_copy
 	struct wl_list foreign_link; // wlr_vk_renderer.foreign_textures
 	struct wl_list destroy_link; // wlr_vk_command_buffer.destroy_textures
 	struct wl_list link; // wlr_vk_renderer.textures
@@ -527,15 +606,31 @@ struct wlr_vk_allocation {
 	VkDeviceSize size;
 };
 
-// List of suballocated staging buffers.
+// Range of a shared buffer used by a submission.
+struct wlr_vk_stage_segment {
+	uint64_t timeline_point;
+	VkDeviceSize end;
+};
+
+// List of staging buffers, each suballocated as a ring buffer.
 // Used to upload to/read from device local images.
 struct wlr_vk_shared_buffer {
-	struct wl_list link; // wlr_vk_renderer.stage.buffers or wlr_vk_command_buffer.stage_buffers
+	struct wl_list link; // wlr_vk_renderer.stage.buffers
 	VkBuffer buffer;
 	VkDeviceMemory memory;
 	VkDeviceSize buf_size;
 	void *cpu_mapping;
-	struct wl_array allocs; // struct wlr_vk_allocation
+
+	// Allocations are made at head and released from tail. The buffer is
+	// full if head == tail and it isn't empty.
+	VkDeviceSize head, tail;
+	// Allocations not attached to a submission yet
+	bool pending;
+	struct wl_array segments; // struct wlr_vk_stage_segment, oldest first
+	// Maximum number of bytes in use since the last trim
+	VkDeviceSize peak;
+	// Peak usage, halved every trim interval unless exceeded
+	VkDeviceSize decayed_peak;
 	int64_t last_used_ms;
 };
 
@@ -57,7 +57,8 @@ bool dmabuf_buffer_drop(struct wlr_dmabuf_buffer *buffer);
 struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 	struct wlr_renderer *renderer);
 /**
- * Try to update the buffer's content.
+ * Try to update the buffer's content. On success, next becomes the source
+ * buffer.
  *
  * Fails if there's more than one reference to the buffer or if the texture
  * isn't mutable.
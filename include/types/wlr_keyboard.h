@@ -6,3 +6,12 @@ void keyboard_key_update(struct wlr_keyboard *keyboard,
 bool keyboard_modifier_update(struct wlr_keyboard *keyboard);
 
 void keyboard_led_update(struct wlr_keyboard *keyboard);
+
+/**
+ * Check whether two keyboards have identical keymaps. Keymaps are
+ * de-duplicated by content, so this doesn't need to compare the keymaps
+ * themselves. Missing keymaps are compared like wlr_keyboard_keymaps_match()
+ * does.
+ */
+bool keyboard_keymaps_match(const struct wlr_keyboard *kb1,
+	const struct wlr_keyboard *kb2);
@@ -17,11 +17,24 @@ bool output_pick_format(struct wlr_output *output,
 bool output_ensure_buffer(struct wlr_output *output,
 	struct wlr_output_state *state, bool *new_back_buffer);
 
+/**
+ * Set the cursor texture. If cache_texture is set, the texture contents must
+ * never change: the rendered hardware cursor buffers are cached and re-used
+ * the next time the same texture is set, until output_cursor_forget_texture()
+ * is called.
+ */
 bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
-	struct wlr_texture *texture, bool own_texture, const struct wlr_fbox *src_box,
-	int dst_width, int dst_height, enum wl_output_transform transform,
-	int32_t hotspot_x, int32_t hotspot_y, struct wlr_drm_syncobj_timeline *wait_timeline,
-	uint64_t wait_point);
+	struct wlr_texture *texture, bool own_texture, bool cache_texture,
+	const struct wlr_fbox *src_box, int dst_width, int dst_height,
+	enum wl_output_transform transform, int32_t hotspot_x, int32_t hotspot_y,
+	struct wlr_drm_syncobj_timeline *wait_timeline, uint64_t wait_point);
+/**
+ * Drop the cached hardware cursor buffers rendered from a texture. Must be
+ * called before destroying a texture passed with cache_texture set.
+ */
+void output_cursor_forget_texture(struct wlr_output_cursor *cursor,
+	struct wlr_texture *texture);
+void output_destroy_cursor_swapchain(struct wlr_output *output);
 
 void output_defer_present(struct wlr_output *output, struct wlr_output_event_present event);
 
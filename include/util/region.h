@@ -0,0 +1,51 @@
+#ifndef UTIL_REGION_H
+#define UTIL_REGION_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <wayland-server-protocol.h>
+#include <wayland-util.h>
+
+/**
+ * Simplify a region so that it's made up of at most max_rects rectangles.
+ *
+ * Rectangles are merged two by two into their bounding box, greedily picking
+ * the pair which adds the least area not covered by the original region. Only
+ * rectangles close to each other in the region's band order are considered
+ * for merging. Merged rectangles absorb the rectangles they overlap. The
+ * resulting region always covers the original one.
+ *
+ * This is not cheap: callers should only simplify damage once, when it's
+ * consumed, rather than after each accumulation. On allocation failure, the
+ * region is left untouched.
+ */
+void region_coalesce(pixman_region32_t *region, int max_rects);
+
+struct region_map_options {
+	// Translation, applied first
+	int dx, dy;
+	// Scale factors, coordinates are rounded outwards like wlr_region_scale_xy()
+	float scale_x, scale_y;
+	// Distance to expand rectangles by after scaling, like wlr_region_expand()
+	int expand;
+	// Transform applied inside a width x height box, like wlr_region_transform()
+	enum wl_output_transform transform;
+	int width, height;
+	// Optional box to clip the result to, in destination coordinates
+	const pixman_box32_t *clip;
+};
+
+/**
+ * Translate, scale, expand, transform and clip a region in a single pass over
+ * its rectangles. dst and src may alias.
+ *
+ * The temporary rectangle array lives in scratch, which is re-used across
+ * calls to avoid allocating for every region.
+ *
+ * On allocation failure, dst is set to the mapped extents of src, which covers
+ * the exact result, and false is returned.
+ */
+bool region_map(pixman_region32_t *dst, const pixman_region32_t *src,
+	const struct region_map_options *options, struct wl_array *scratch);
+
+#endif
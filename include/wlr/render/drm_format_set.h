@@ -47,6 +47,10 @@ void wlr_drm_format_finish(struct wlr_drm_format *format);
  *
  * Users must not assume that implicit modifiers are supported unless INVALID
  * is listed in the modifier list.
+ *
+ * Formats are sorted by format code, and modifiers are sorted within each
+ * format. Sets must only be built with the functions below, which maintain
+ * this order.
  */
 struct wlr_drm_format_set {
 	// The number of formats
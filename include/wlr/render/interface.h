@@ -43,11 +43,37 @@ struct wlr_texture_impl {
 		const struct wlr_texture_read_pixels_options *options);
 	uint32_t (*preferred_read_format)(struct wlr_texture *texture);
 	void (*destroy)(struct wlr_texture *texture);
+	struct wlr_texture_read_pixels_async *(*read_pixels_async)(struct wlr_texture *texture,
+		const struct wlr_texture_read_pixels_async_options *options);
 };
 
 void wlr_texture_init(struct wlr_texture *texture, struct wlr_renderer *rendener,
 	const struct wlr_texture_impl *impl, uint32_t width, uint32_t height);
 
+struct wlr_texture_read_pixels_async {
+	const struct wlr_texture_read_pixels_async_impl *impl;
+	// Signalled once the pixels can be written without blocking
+	int sync_file_fd;
+
+	struct wl_event_source *event_source;
+	bool ready;
+	wlr_texture_read_pixels_async_ready_callback callback;
+	void *data;
+};
+
+struct wlr_texture_read_pixels_async_impl {
+	bool (*finish)(struct wlr_texture_read_pixels_async *read,
+		void *data, uint32_t stride);
+	/* Implementers are responsible for waiting on pending GPU work */
+	void (*destroy)(struct wlr_texture_read_pixels_async *read);
+};
+
+/**
+ * Initialize a read. Ownership of the sync_file FD is transferred.
+ */
+void wlr_texture_read_pixels_async_init(struct wlr_texture_read_pixels_async *read,
+	const struct wlr_texture_read_pixels_async_impl *impl, int sync_file_fd);
+
 struct wlr_render_pass {
 	const struct wlr_render_pass_impl *impl;
 };
@@ -12,11 +12,42 @@
 #include <pixman.h>
 #include <wlr/render/wlr_renderer.h>
 
+/**
+ * CPU time spent in the last render pass a pixman render timer was attached
+ * to, broken down per operation type.
+ *
+ * When render passes are executed on worker threads (see WLR_PIXMAN_THREADS),
+ * operations are only recorded when added and their execution is accounted in
+ * submit_ns.
+ */
+struct wlr_pixman_render_timings {
+	// Untransformed texture copies and blends
+	int64_t blit_ns;
+	size_t blit_count;
+	// Scaled or transformed texture composites
+	int64_t composite_ns;
+	size_t composite_count;
+	// Solid color rectangles
+	int64_t fill_ns;
+	size_t fill_count;
+	// Pass submission, including the output color transform
+	int64_t submit_ns;
+};
+
 struct wlr_renderer *wlr_pixman_renderer_create(void);
 
 bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer);
+bool wlr_render_timer_is_pixman(struct wlr_render_timer *timer);
 bool wlr_texture_is_pixman(struct wlr_texture *texture);
 
+/**
+ * Get the per-operation breakdown of the duration reported by
+ * wlr_render_timer_get_duration_ns(). Returns false if the timer hasn't been
+ * used by a submitted render pass yet.
+ */
+bool wlr_pixman_render_timer_get_timings(struct wlr_render_timer *timer,
+	struct wlr_pixman_render_timings *timings);
+
 pixman_image_t *wlr_pixman_renderer_get_buffer_image(
     struct wlr_renderer *wlr_renderer, struct wlr_buffer *wlr_buffer);
 pixman_image_t *wlr_pixman_texture_get_image(struct wlr_texture *wlr_texture);
@@ -25,6 +25,25 @@ VkPhysicalDevice wlr_vk_renderer_get_physical_device(struct wlr_renderer *render
 VkDevice wlr_vk_renderer_get_device(struct wlr_renderer *renderer);
 uint32_t wlr_vk_renderer_get_queue_family(struct wlr_renderer *renderer);
 
+/**
+ * Statistics about the staging memory used to upload and read back pixels.
+ */
+struct wlr_vk_renderer_stage_stats {
+	size_t buffers; // number of staging buffers
+	uint64_t capacity; // total size of staging buffers, in bytes
+	uint64_t used; // bytes used by pending or in-flight submissions
+	uint64_t peak; // maximum bytes used during the last trim interval
+	// Number of staging buffers created and destroyed since the renderer
+	// was created
+	uint64_t buffers_created, buffers_destroyed;
+	// Number of shm uploads written directly from the CPU with
+	// VK_EXT_host_image_copy, without a staging buffer
+	uint64_t host_image_copies;
+};
+
+void wlr_vk_renderer_get_stage_stats(struct wlr_renderer *renderer,
+	struct wlr_vk_renderer_stage_stats *stats);
+
 bool wlr_renderer_is_vk(struct wlr_renderer *wlr_renderer);
 bool wlr_texture_is_vk(struct wlr_texture *texture);
 
@@ -18,6 +18,7 @@
 struct wlr_buffer;
 struct wlr_renderer;
 struct wlr_texture_impl;
+struct wlr_texture_read_pixels_async;
 
 struct wlr_texture {
 	const struct wlr_texture_impl *impl;
@@ -42,6 +43,43 @@ struct wlr_texture_read_pixels_options {
 bool wlr_texture_read_pixels(struct wlr_texture *texture,
 	const struct wlr_texture_read_pixels_options *options);
 
+struct wlr_texture_read_pixels_async_options {
+	/** Format used for writing the pixel data */
+	uint32_t format;
+	/** Source box of the texture to read from. If empty, the full texture is assumed. */
+	const struct wlr_box src_box;
+};
+
+typedef void (*wlr_texture_read_pixels_async_ready_callback)(
+	struct wlr_texture_read_pixels_async *read, void *data);
+
+/**
+ * Start reading pixels from a texture without blocking until the GPU is done.
+ *
+ * The callback is invoked from the event loop once the pixels can be written
+ * to their destination with wlr_texture_read_pixels_async_finish(). The
+ * texture may be destroyed in the meantime.
+ *
+ * Returns NULL if the renderer doesn't support asynchronous reads or on
+ * error, in which case callers can fall back to wlr_texture_read_pixels().
+ */
+struct wlr_texture_read_pixels_async *wlr_texture_read_pixels_async_begin(
+	struct wlr_texture *texture,
+	const struct wlr_texture_read_pixels_async_options *options,
+	struct wl_event_loop *loop, wlr_texture_read_pixels_async_ready_callback callback,
+	void *data);
+/**
+ * Write the pixels of a read to a memory location with the given stride. Must
+ * only be called after the ready callback has been invoked.
+ */
+bool wlr_texture_read_pixels_async_finish(struct wlr_texture_read_pixels_async *read,
+	void *data, uint32_t stride);
+/**
+ * Destroy a read. This can be done before it's ready, but must be done before
+ * the renderer is destroyed.
+ */
+void wlr_texture_read_pixels_async_destroy(struct wlr_texture_read_pixels_async *read);
+
 uint32_t wlr_texture_preferred_read_format(struct wlr_texture *texture);
 
 /**
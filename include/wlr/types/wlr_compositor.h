@@ -266,6 +266,15 @@ struct wlr_surface {
 
 		struct wl_resource *pending_buffer_resource;
 		struct wl_listener pending_buffer_resource_destroy;
+
+		// The previous client buffer, kept around when the surface uses shm
+		// buffers so that a partial upload can be done to it when the current
+		// one is still locked. The buffer damage of the last few commits is
+		// kept to bring it up to date.
+		struct wlr_client_buffer *prev_buffer;
+		uint64_t buffer_seq, prev_buffer_seq;
+		pixman_region32_t damage_history[4];
+		uint64_t damage_seq;
 	} WLR_PRIVATE;
 };
 
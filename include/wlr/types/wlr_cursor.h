@@ -215,4 +215,31 @@ void wlr_cursor_map_to_region(struct wlr_cursor *cur, const struct wlr_box *box)
 void wlr_cursor_map_input_to_region(struct wlr_cursor *cur,
 	struct wlr_input_device *dev, const struct wlr_box *box);
 
+/**
+ * Coalesce relative pointer motion events, for high polling rate pointers.
+ *
+ * The first motion event of a burst is emitted right away. Motion events
+ * received during the following interval_ms are accumulated per input device
+ * (both accelerated and unaccelerated deltas) and emitted as a single motion
+ * event, followed by a single frame event, when the interval elapses. Any
+ * other event received through this cursor (buttons, axis, gestures, touch
+ * and tablet events of attached devices) flushes pending motion events first,
+ * so that their ordering is preserved.
+ *
+ * Events which don't go through the cursor, such as keyboard events or
+ * events from devices which aren't attached to it, aren't ordered with
+ * pending motion events. Compositors enabling coalescing must call
+ * wlr_cursor_flush_motion() before handling them.
+ *
+ * An interval of 0 disables coalescing, which is the default.
+ */
+void wlr_cursor_set_motion_coalescing(struct wlr_cursor *cur,
+	struct wl_event_loop *loop, int interval_ms);
+
+/**
+ * Emit pending coalesced motion events right away. Compositors can call this
+ * before rendering an output frame to align motion delivery to frames.
+ */
+void wlr_cursor_flush_motion(struct wlr_cursor *cur);
+
 #endif
@@ -17,8 +17,26 @@
 
 struct wlr_box;
 
+// Number of previous frames tracked in WLR_DAMAGE_RING_MODE_AGE
+#define WLR_DAMAGE_RING_HISTORY_LEN 4
+
+enum wlr_damage_ring_mode {
+	/**
+	 * Damage is tracked per buffer: each buffer keeps the damage accumulated
+	 * since it was last rotated. This mode supports arbitrarily old buffers.
+	 */
+	WLR_DAMAGE_RING_MODE_BUFFERS,
+	/**
+	 * Damage is tracked in a fixed-size history of per-frame damage, indexed
+	 * by buffer age. Buffers older than WLR_DAMAGE_RING_HISTORY_LEN + 1 frames
+	 * are fully damaged. Rotating is cheaper than in the per-buffer mode.
+	 */
+	WLR_DAMAGE_RING_MODE_AGE,
+};
+
 struct wlr_damage_ring_buffer {
 	struct wlr_buffer *buffer;
+	// Only used in WLR_DAMAGE_RING_MODE_BUFFERS
 	pixman_region32_t damage;
 
 	struct wlr_damage_ring *ring;
@@ -26,6 +44,7 @@ struct wlr_damage_ring_buffer {
 
 	struct {
 		struct wl_listener destroy;
+		uint64_t frame; // value of wlr_damage_ring.frame when last rotated
 	} WLR_PRIVATE;
 };
 
@@ -35,6 +54,17 @@ struct wlr_damage_ring {
 
 	struct {
 		struct wl_list buffers; // wlr_damage_ring_buffer.link
+		int max_rects;
+
+		enum wlr_damage_ring_mode mode;
+		uint64_t frame; // number of rotations so far
+
+		// Only used in WLR_DAMAGE_RING_MODE_AGE: circular array of the
+		// union of the damage of the N most recent frames, at index
+		// (history_idx + N - 1) % WLR_DAMAGE_RING_HISTORY_LEN
+		pixman_region32_t history[WLR_DAMAGE_RING_HISTORY_LEN];
+		size_t history_idx;
+		size_t history_len;
 	} WLR_PRIVATE;
 };
 
@@ -42,6 +72,27 @@ void wlr_damage_ring_init(struct wlr_damage_ring *ring);
 
 void wlr_damage_ring_finish(struct wlr_damage_ring *ring);
 
+/**
+ * Set the maximum number of rectangles of the buffer damage returned by
+ * wlr_damage_ring_rotate_buffer().
+ *
+ * When the damage exceeds this budget, rectangles are merged together,
+ * preferring merges which add the least area to the damage. Lower values
+ * reduce the cost of handling damage at the expense of redrawing more pixels.
+ * Values lower than 1 are clamped to 1, which always collapses the damage to
+ * its extents.
+ */
+void wlr_damage_ring_set_max_rects(struct wlr_damage_ring *ring, int max_rects);
+
+/**
+ * Set the damage tracking mode. Defaults to WLR_DAMAGE_RING_MODE_BUFFERS.
+ *
+ * Changing the mode forgets all previously tracked buffers: they will be
+ * fully damaged the next time they are rotated.
+ */
+void wlr_damage_ring_set_mode(struct wlr_damage_ring *ring,
+	enum wlr_damage_ring_mode mode);
+
 /**
  * Add a region to the current damage. The region must be in the buffer-local
  * coordinate space.
@@ -76,4 +127,28 @@ void wlr_damage_ring_add_whole(struct wlr_damage_ring *ring);
 void wlr_damage_ring_rotate_buffer(struct wlr_damage_ring *ring,
 	struct wlr_buffer *buffer, pixman_region32_t *damage);
 
+/**
+ * Get the age of a buffer, ie. the number of rotations since the buffer was
+ * last passed to wlr_damage_ring_rotate_buffer(). A buffer rotated by the
+ * last call has an age of 1.
+ *
+ * Returns 0 if the buffer is unknown to the ring.
+ */
+int wlr_damage_ring_get_buffer_age(struct wlr_damage_ring *ring,
+	struct wlr_buffer *buffer);
+
+/**
+ * Get the accumulated damage for a buffer of the given age, ie. the damage
+ * accumulated in the current frame and the buffer_age - 1 previous frames.
+ * This is useful for callers which track buffer ages themselves, for
+ * instance via EGL_EXT_buffer_age.
+ *
+ * Only supported in WLR_DAMAGE_RING_MODE_AGE. Returns false if the damage is
+ * unknown for this age, in which case the whole buffer needs to be redrawn.
+ *
+ * The returned damage will be in the buffer-local coordinate space.
+ */
+bool wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
+	int buffer_age, pixman_region32_t *damage);
+
 #endif
@@ -15,6 +15,7 @@
 #include <time.h>
 
 struct wlr_renderer;
+struct wlr_texture_read_pixels_async;
 
 struct wlr_ext_image_copy_capture_manager_v1 {
 	struct wl_global *global;
@@ -36,6 +37,12 @@ struct wlr_ext_image_copy_capture_frame_v1 {
 
 	struct {
 		struct wlr_ext_image_copy_capture_session_v1 *session;
+
+		// Pending asynchronous shm copy
+		struct wlr_texture_read_pixels_async *read;
+		bool read_failed;
+		// The ready event is deferred until the pending copy completes
+		bool ready_pending;
 	} WLR_PRIVATE;
 };
 
@@ -42,6 +42,7 @@ enum wlr_keyboard_modifier {
 #define WLR_KEYBOARD_KEYS_CAP 32
 
 struct wlr_keyboard_impl;
+struct wlr_keyboard_keymap_entry;
 
 struct wlr_keyboard_modifiers {
 	xkb_mod_mask_t depressed;
@@ -56,6 +57,7 @@ struct wlr_keyboard {
 	const struct wlr_keyboard_impl *impl;
 	struct wlr_keyboard_group *group;
 
+	// Shared by all keyboards with an identical keymap, must not be modified
 	char *keymap_string;
 	size_t keymap_size;
 	int keymap_fd;
@@ -95,6 +97,10 @@ struct wlr_keyboard {
 	} events;
 
 	void *data;
+
+	struct {
+		struct wlr_keyboard_keymap_entry *keymap_entry;
+	} WLR_PRIVATE;
 };
 
 struct wlr_keyboard_key_event {
@@ -115,6 +121,12 @@ struct wlr_keyboard *wlr_keyboard_from_input_device(
 bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 	struct xkb_keymap *keymap);
 
+/**
+ * Check whether two keymaps have the same text representation.
+ *
+ * Keymaps currently in use by a keyboard are compared without being
+ * serialized again.
+ */
 bool wlr_keyboard_keymaps_match(struct xkb_keymap *km1, struct xkb_keymap *km2);
 
 /**
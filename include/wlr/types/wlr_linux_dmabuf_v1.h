@@ -59,6 +59,7 @@ struct wlr_linux_dmabuf_v1 {
 		struct wlr_linux_dmabuf_feedback_v1_compiled *default_feedback;
 		struct wlr_drm_format_set default_formats; // for legacy clients
 		struct wl_list surfaces; // wlr_linux_dmabuf_v1_surface.link
+		struct wl_list feedback_cache; // wlr_linux_dmabuf_v1_feedback_cache_entry.link
 
 		int main_device_fd; // to sanity check FDs sent by clients, -1 if unavailable
 
@@ -134,4 +135,16 @@ struct wlr_linux_dmabuf_feedback_v1_init_options {
 bool wlr_linux_dmabuf_feedback_v1_init_with_options(struct wlr_linux_dmabuf_feedback_v1 *feedback,
 	const struct wlr_linux_dmabuf_feedback_v1_init_options *options);
 
+/**
+ * Set a surface's DMA-BUF feedback from the provided options.
+ *
+ * This is equivalent to initializing a feedback object with
+ * wlr_linux_dmabuf_feedback_v1_init_with_options() and passing it to
+ * wlr_linux_dmabuf_v1_set_surface_feedback(), except that the compiled
+ * feedback is cached and shared between all surfaces using the same options.
+ */
+bool wlr_linux_dmabuf_v1_set_surface_feedback_with_options(
+	struct wlr_linux_dmabuf_v1 *linux_dmabuf, struct wlr_surface *surface,
+	const struct wlr_linux_dmabuf_feedback_v1_init_options *options);
+
 #endif
@@ -53,6 +53,9 @@ struct wlr_output_cursor {
 
 	struct {
 		struct wl_listener renderer_destroy;
+
+		bool cache_texture;
+		struct wl_list buffer_cache; // output_cursor_buffer.link
 	} WLR_PRIVATE;
 };
 
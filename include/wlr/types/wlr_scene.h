@@ -92,6 +92,16 @@ struct wlr_scene_tree {
 	struct wlr_scene_node node;
 
 	struct wl_list children; // wlr_scene_node.link
+
+	struct {
+		// Bounding box of all enabled descendants, relative to this tree.
+		// Only up-to-date if bounds_dirty is false.
+		struct wlr_box bounds;
+		bool bounds_dirty;
+		// If true, node.visible needs to be re-computed as the union of the
+		// visible regions of all enabled descendants.
+		bool visible_dirty;
+	} WLR_PRIVATE;
 };
 
 /** The root scene-graph node. */
@@ -111,10 +121,16 @@ struct wlr_scene {
 		struct wl_listener gamma_control_manager_v1_set_gamma;
 		struct wl_listener color_manager_v1_destroy;
 
+		// Incremented whenever the geometry, visibility or stacking order of
+		// nodes changes
+		uint64_t generation;
+
 		enum wlr_scene_debug_damage_option debug_damage_option;
 		bool direct_scanout;
+		bool output_layers;
 		bool calculate_visibility;
 		bool highlight_transparent_region;
+		bool frame_done_active_only;
 	} WLR_PRIVATE;
 };
 
@@ -200,6 +216,11 @@ struct wlr_scene_buffer {
 
 	struct {
 		uint64_t active_outputs;
+		// Outputs on which this buffer was displayed via an output layer
+		// during the last frame
+		uint64_t layer_outputs;
+		// One entry per output in active_outputs
+		struct wl_list output_entries; // scene_output_buffer.buffer_link
 		struct wlr_texture *texture;
 		struct wlr_linux_dmabuf_feedback_v1_init_options prev_feedback_options;
 
@@ -261,6 +282,31 @@ struct wlr_scene_output {
 
 		struct wl_array render_list;
 
+		// Scratch rectangle array for region_map()
+		struct wl_array region_scratch; // pixman_box32_t
+
+		// Scene generation and output geometry the render list has been
+		// built for. The render list is re-used as long as these don't
+		// change.
+		uint64_t render_list_generation;
+		struct wlr_box render_list_box;
+		float render_list_scale;
+		enum wl_output_transform render_list_transform;
+		int render_list_width, render_list_height;
+		// Union of the opaque regions of all render list entries, in
+		// output buffer-local coordinates
+		pixman_region32_t render_list_opaque;
+
+		// Output layers used to display the top-most scene buffers without
+		// compositing them, see WLR_SCENE_OUTPUT_LAYERS
+		struct wl_array layers; // struct wlr_output_layer *
+		struct wl_array layer_states; // struct wlr_output_layer_state
+
+		// Buffers for which this output is active
+		struct wl_list active_buffers; // scene_output_buffer.output_link
+		// Incremented each time frame done events are sent to active buffers
+		uint64_t frame_done_seq;
+
 		struct wlr_drm_syncobj_timeline *in_timeline;
 		uint64_t in_point;
 	} WLR_PRIVATE;
@@ -269,6 +315,10 @@ struct wlr_scene_output {
 struct wlr_scene_timer {
 	int64_t pre_render_duration;
 	struct wlr_render_timer *render_timer;
+
+	// Number of output buffer pixels drawn for scene nodes, with and without
+	// blending
+	uint64_t blended_pixels, copied_pixels;
 };
 
 /** A layer shell scene helper */
@@ -376,6 +426,19 @@ void wlr_scene_set_gamma_control_manager_v1(struct wlr_scene *scene,
  */
 void wlr_scene_set_color_manager_v1(struct wlr_scene *scene, struct wlr_color_manager_v1 *manager);
 
+/**
+ * Only send frame done events to buffers active on the output.
+ *
+ * By default, wlr_scene_output_send_frame_done() walks the whole scene-graph
+ * and emits the frame_done event on every enabled buffer. When enabled, the
+ * event is only emitted on buffers for which the output is one of the active
+ * outputs, which is cheaper with many buffers or outputs. Scene surfaces are
+ * unaffected, since they ignore events from outputs other than their frame
+ * pacing output, which is always active.
+ */
+void wlr_scene_set_frame_done_active_only(struct wlr_scene *scene,
+	bool active_only);
+
 /**
  * Add a node displaying nothing but its children.
  */
@@ -630,6 +693,9 @@ void wlr_scene_timer_finish(struct wlr_scene_timer *timer);
  * Call wlr_surface_send_frame_done() on all surfaces in the scene rendered by
  * wlr_scene_output_commit() for which wlr_scene_surface.primary_output
  * matches the given scene_output.
+ *
+ * See wlr_scene_set_frame_done_active_only() for the buffers on which the
+ * frame_done event is emitted.
  */
 void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
 	struct timespec *now);
@@ -9,7 +9,9 @@
 #ifndef WLR_TYPES_WLR_SCREENCOPY_V1_H
 #define WLR_TYPES_WLR_SCREENCOPY_V1_H
 
+#include <pixman.h>
 #include <stdbool.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/util/box.h>
@@ -65,6 +67,11 @@ struct wlr_screencopy_frame_v1 {
 	struct {
 		struct wl_listener output_commit;
 		struct wl_listener output_destroy;
+
+		// Pending asynchronous shm copy, with the state sent on completion
+		struct wlr_texture_read_pixels_async *read;
+		struct timespec read_when;
+		pixman_region32_t read_damage;
 	} WLR_PRIVATE;
 };
 
@@ -70,6 +70,8 @@ struct wlr_xcursor {
 	uint32_t total_delay; /* total duration of the animation in ms */
 };
 
+struct wlr_xcursor_theme_file;
+
 /**
  * Container for an Xcursor theme.
  */
@@ -78,6 +80,13 @@ struct wlr_xcursor_theme {
 	struct wlr_xcursor **cursors;
 	char *name;
 	int size;
+
+	struct {
+		// Cursor files indexed by wlr_xcursor_theme_load_lazy(), decoded on
+		// first use
+		struct wlr_xcursor_theme_file *files;
+		size_t files_len, files_cap;
+	} WLR_PRIVATE;
 };
 
 /**
@@ -97,6 +106,16 @@ struct wlr_xcursor_theme {
  */
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size);
 
+/**
+ * Loads the named Xcursor theme lazily.
+ *
+ * This behaves like wlr_xcursor_theme_load(), except that cursor files are
+ * only listed when the theme is loaded. Each cursor is decoded the first time
+ * it's requested via wlr_xcursor_theme_get_cursor(), so cursor_count and
+ * cursors only contain the cursors requested so far.
+ */
+struct wlr_xcursor_theme *wlr_xcursor_theme_load_lazy(const char *name, int size);
+
 /**
  * Destroy a cursor theme.
  *
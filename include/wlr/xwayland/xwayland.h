@@ -234,6 +234,8 @@ struct wlr_xwayland_surface {
 	struct {
 		char *wm_name, *net_wm_name;
 
+		struct wl_list window_link; // wlr_xwm.surface_buckets
+
 		struct wl_listener surface_commit;
 		struct wl_listener surface_map;
 		struct wl_listener surface_unmap;
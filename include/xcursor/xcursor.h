@@ -55,4 +55,12 @@ void
 xcursor_load_theme(const char *theme, int size,
 		   void (*load_callback)(struct xcursor_images *, void *),
 		   void *user_data);
+
+void
+xcursor_scan_theme(const char *theme,
+		   void (*scan_callback)(const char *, const char *, void *),
+		   void *user_data);
+
+struct xcursor_images *
+xcursor_load_images(const char *path, int size);
 #endif
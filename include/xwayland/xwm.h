@@ -134,6 +134,18 @@ struct wlr_xwm {
 	// Surfaces in bottom-to-top stacking order, for _NET_CLIENT_LIST_STACKING
 	struct wl_list surfaces_in_stack_order; // wlr_xwayland_surface.stack_link
 	struct wl_list unpaired_surfaces; // wlr_xwayland_surface.unpaired_link
+	// Hash table of surfaces indexed by window ID, the number of buckets is a
+	// power of two
+	struct wl_list *surface_buckets; // wlr_xwayland_surface.window_link
+	size_t surface_buckets_len;
+	size_t surfaces_len;
+
+	// Window IDs of mapped surfaces in map order, for _NET_CLIENT_LIST
+	struct wl_array client_list; // xcb_window_t
+	// Last _NET_CLIENT_LIST_STACKING sent to the X server
+	struct wl_array client_list_stacking; // xcb_window_t
+	// Whether the lists need to be sent on the next flush
+	bool client_list_dirty, client_list_stacking_dirty;
 	struct wl_list pending_startup_ids; // pending_startup_id
 
 	struct wlr_drag *drag;
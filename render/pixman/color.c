@@ -0,0 +1,515 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
+#include "render/color.h"
+#include "render/pixman.h"
+#include "util/matrix.h"
+
+// Same grid size as the Vulkan renderer's 3D LUT
+#define LUT_3D_DIM 33
+// Maximum number of look-up tables cached per renderer
+#define COLOR_TRANSFORM_CACHE_SIZE 8
+
+/**
+ * Steps applied to a linear color value before it is written back, mirroring
+ * the Vulkan output shader.
+ */
+struct color_pipeline {
+	enum wlr_color_transform_type type;
+	struct wlr_color_transform *tr; // NULL for inverse EOTF transforms
+	enum wlr_color_transfer_function tf;
+	float luminance_multiplier;
+	bool has_matrix;
+	float matrix[9];
+};
+
+static float linear_to_srgb(float x) {
+	return fmaxf(fminf(x * 12.92f, 0.04045f), 1.055f * powf(x, 1.f / 2.4f) - 0.055f);
+}
+
+static float linear_to_pq(float x) {
+	// H.273 TransferCharacteristics code point 16
+	const float c1 = 0.8359375f;
+	const float c2 = 18.8515625f;
+	const float c3 = 18.6875f;
+	const float m = 78.84375f;
+	const float n = 0.1593017578125f;
+	float pow_n = powf(fminf(fmaxf(x, 0.f), 1.f), n);
+	return powf((c1 + c2 * pow_n) / (1.f + c3 * pow_n), m);
+}
+
+static float linear_to_bt1886(float x) {
+	const float lb = powf(0.0001f, 1.f / 2.4f);
+	const float lw = 1.f;
+	const float a = powf(lw - lb, 2.4f);
+	const float b = lb / (lw - lb);
+	return powf(x / a, 1.f / 2.4f) - b;
+}
+
+static float apply_inverse_eotf(enum wlr_color_transfer_function tf, float x) {
+	switch (tf) {
+	case WLR_COLOR_TRANSFER_FUNCTION_EXT_LINEAR:
+		return x;
+	case WLR_COLOR_TRANSFER_FUNCTION_SRGB:
+		return linear_to_srgb(x);
+	case WLR_COLOR_TRANSFER_FUNCTION_ST2084_PQ:
+		return linear_to_pq(x);
+	case WLR_COLOR_TRANSFER_FUNCTION_GAMMA22:
+		return powf(x, 1.f / 2.2f);
+	case WLR_COLOR_TRANSFER_FUNCTION_BT1886:
+		return linear_to_bt1886(x);
+	}
+	abort(); // unreachable
+}
+
+static float clamp_unit(float x) {
+	if (!(x > 0)) { // also catches NaN
+		return 0;
+	}
+	return x < 1 ? x : 1;
+}
+
+static void color_pipeline_init(struct color_pipeline *p,
+		const struct wlr_pixman_color_transform *transform) {
+	*p = (struct color_pipeline){
+		.type = transform->type,
+		.tr = transform->color_transform,
+		.tf = WLR_COLOR_TRANSFER_FUNCTION_GAMMA22,
+		.luminance_multiplier = 1,
+	};
+
+	if (transform->type == COLOR_TRANSFORM_INVERSE_EOTF) {
+		p->tf = transform->tf;
+
+		struct wlr_color_luminances srgb_lum, dst_lum;
+		wlr_color_transfer_function_get_default_luminance(
+			WLR_COLOR_TRANSFER_FUNCTION_SRGB, &srgb_lum);
+		wlr_color_transfer_function_get_default_luminance(p->tf, &dst_lum);
+		p->luminance_multiplier = (dst_lum.reference / srgb_lum.reference) *
+			(srgb_lum.max / dst_lum.max);
+	}
+
+	const struct wlr_color_primaries *primaries =
+		transform->has_primaries ? &transform->primaries : NULL;
+
+	struct wlr_color_primaries srgb;
+	wlr_color_primaries_from_named(&srgb, WLR_COLOR_NAMED_PRIMARIES_SRGB);
+	if (primaries != NULL && memcmp(primaries, &srgb, sizeof(srgb)) != 0) {
+		float srgb_to_xyz[9];
+		wlr_color_primaries_to_xyz(&srgb, srgb_to_xyz);
+		float dst_primaries_to_xyz[9];
+		wlr_color_primaries_to_xyz(primaries, dst_primaries_to_xyz);
+		float xyz_to_dst_primaries[9];
+		matrix_invert(xyz_to_dst_primaries, dst_primaries_to_xyz);
+
+		wlr_matrix_multiply(p->matrix, xyz_to_dst_primaries, srgb_to_xyz);
+		p->has_matrix = true;
+	}
+}
+
+/**
+ * Evaluate the pipeline for a color encoded the way pixman blends it, ie. with
+ * the default gamma 2.2 encoding.
+ */
+static void color_pipeline_eval(const struct color_pipeline *p,
+		float out[static 3], const float in[static 3]) {
+	float rgb[3];
+	for (size_t i = 0; i < 3; i++) {
+		rgb[i] = powf(in[i], 2.2f) * p->luminance_multiplier;
+	}
+
+	if (p->has_matrix) {
+		const float *m = p->matrix;
+		float v[3] = { rgb[0], rgb[1], rgb[2] };
+		for (size_t i = 0; i < 3; i++) {
+			rgb[i] = fmaxf(m[3 * i] * v[0] + m[3 * i + 1] * v[1] + m[3 * i + 2] * v[2], 0);
+		}
+	}
+
+	switch (p->type) {
+	case COLOR_TRANSFORM_INVERSE_EOTF:
+		for (size_t i = 0; i < 3; i++) {
+			rgb[i] = apply_inverse_eotf(p->tf, rgb[i]);
+		}
+		break;
+	case COLOR_TRANSFORM_LCMS2:;
+		float lcms2_in[3] = { rgb[0], rgb[1], rgb[2] };
+		color_transform_lcms2_eval(color_transform_lcms2_from_base(p->tr),
+			rgb, lcms2_in);
+		break;
+	case COLOR_TRANSFORM_LUT_3X1D:;
+		float lut_in[3] = { clamp_unit(rgb[0]), clamp_unit(rgb[1]), clamp_unit(rgb[2]) };
+		color_transform_lut_3x1d_eval(color_transform_lut_3x1d_from_base(p->tr),
+			rgb, lut_in);
+		break;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		out[i] = clamp_unit(rgb[i]);
+	}
+}
+
+static void build_lut_1d(struct wlr_pixman_color_transform *transform,
+		const struct color_pipeline *p) {
+	for (int v = 0; v < 256; v++) {
+		float in[3] = { v / 255.f, v / 255.f, v / 255.f };
+		float out[3];
+		color_pipeline_eval(p, out, in);
+		for (size_t c = 0; c < 3; c++) {
+			transform->lut_1d[c][v] = lroundf(out[c] * 255);
+		}
+	}
+}
+
+static bool build_lut_3d(struct wlr_pixman_color_transform *transform,
+		const struct color_pipeline *p) {
+	const size_t dim = LUT_3D_DIM;
+	uint16_t *lut = malloc(dim * dim * dim * 3 * sizeof(lut[0]));
+	if (lut == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	for (size_t b = 0; b < dim; b++) {
+		for (size_t g = 0; g < dim; g++) {
+			for (size_t r = 0; r < dim; r++) {
+				float in[3] = {
+					(float)r / (dim - 1),
+					(float)g / (dim - 1),
+					(float)b / (dim - 1),
+				};
+				float out[3];
+				color_pipeline_eval(p, out, in);
+
+				// Entries are 8-bit values with 8 fractional bits, so that
+				// interpolation can stay in integer arithmetic
+				uint16_t *entry = &lut[3 * (r + dim * (g + dim * b))];
+				for (size_t c = 0; c < 3; c++) {
+					entry[c] = lroundf(out[c] * 255 * 256);
+				}
+			}
+		}
+	}
+
+	// Map each 8-bit input value to a grid cell and a 8-bit weight
+	for (int v = 0; v < 256; v++) {
+		uint32_t pos = v * (dim - 1) * 256 / 255;
+		uint32_t index = pos >> 8;
+		uint32_t frac = pos & 0xFF;
+		if (index >= dim - 1) {
+			index = dim - 2;
+			frac = 256;
+		}
+		transform->lut_3d_index[v] = index;
+		transform->lut_3d_frac[v] = frac;
+	}
+
+	transform->lut_3d = lut;
+	return true;
+}
+
+static bool color_transform_build(struct wlr_pixman_color_transform *transform) {
+	struct color_pipeline p;
+	color_pipeline_init(&p, transform);
+
+	// Without a primaries conversion, transforms other than LCMS2 act on each
+	// channel independently
+	transform->separable = !p.has_matrix &&
+		transform->type != COLOR_TRANSFORM_LCMS2;
+	if (transform->separable) {
+		build_lut_1d(transform, &p);
+		transform->identity = true;
+		for (size_t c = 0; c < 3; c++) {
+			for (int v = 0; v < 256; v++) {
+				if (transform->lut_1d[c][v] != v) {
+					transform->identity = false;
+				}
+			}
+		}
+		return true;
+	}
+
+	transform->identity = false;
+	return build_lut_3d(transform, &p);
+}
+
+void pixman_color_transform_destroy(struct wlr_pixman_color_transform *transform) {
+	assert(transform->passes == 0);
+	wl_list_remove(&transform->link);
+	if (transform->color_transform != NULL) {
+		wlr_addon_finish(&transform->addon);
+	}
+	free(transform->lut_3d);
+	free(transform);
+}
+
+static void color_transform_handle_addon_destroy(struct wlr_addon *addon) {
+	struct wlr_pixman_color_transform *transform =
+		wl_container_of(addon, transform, addon);
+	pixman_color_transform_destroy(transform);
+}
+
+static const struct wlr_addon_interface color_transform_addon_impl = {
+	.name = "wlr_pixman_color_transform",
+	.destroy = color_transform_handle_addon_destroy,
+};
+
+static bool color_transform_matches(const struct wlr_pixman_color_transform *transform,
+		struct wlr_color_transform *tr, const struct wlr_color_primaries *primaries) {
+	if (transform->type != tr->type) {
+		return false;
+	}
+	if (primaries != NULL ? !transform->has_primaries ||
+			memcmp(&transform->primaries, primaries, sizeof(*primaries)) != 0 :
+			transform->has_primaries) {
+		return false;
+	}
+	if (tr->type == COLOR_TRANSFORM_INVERSE_EOTF) {
+		return transform->tf == wlr_color_transform_inverse_eotf_from_base(tr)->tf;
+	}
+	return transform->color_transform == tr;
+}
+
+static void color_transforms_evict(struct wlr_pixman_renderer *renderer) {
+	// Tables are kept in most recently used order, drop the least recently
+	// used ones which aren't in use by a render pass
+	int len = wl_list_length(&renderer->color_transforms);
+	struct wlr_pixman_color_transform *transform, *tmp;
+	wl_list_for_each_reverse_safe(transform, tmp, &renderer->color_transforms, link) {
+		if (len <= COLOR_TRANSFORM_CACHE_SIZE) {
+			break;
+		}
+		if (transform->passes == 0) {
+			pixman_color_transform_destroy(transform);
+			len--;
+		}
+	}
+}
+
+struct wlr_pixman_color_transform *pixman_color_transform_get_or_create(
+		struct wlr_pixman_renderer *renderer, struct wlr_color_transform *tr,
+		const struct wlr_color_primaries *primaries) {
+	struct wlr_pixman_color_transform *transform;
+	wl_list_for_each(transform, &renderer->color_transforms, link) {
+		if (color_transform_matches(transform, tr, primaries)) {
+			wl_list_remove(&transform->link);
+			wl_list_insert(&renderer->color_transforms, &transform->link);
+			return transform;
+		}
+	}
+
+	transform = calloc(1, sizeof(*transform));
+	if (transform == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	transform->type = tr->type;
+	if (tr->type == COLOR_TRANSFORM_INVERSE_EOTF) {
+		transform->tf = wlr_color_transform_inverse_eotf_from_base(tr)->tf;
+	} else {
+		transform->color_transform = tr;
+	}
+	transform->has_primaries = primaries != NULL;
+	if (primaries != NULL) {
+		transform->primaries = *primaries;
+	}
+
+	if (!color_transform_build(transform)) {
+		free(transform);
+		return NULL;
+	}
+
+	// Inverse EOTF tables don't depend on the transform object, and outlive it
+	if (transform->color_transform != NULL) {
+		wlr_addon_init(&transform->addon, &tr->addons, transform,
+			&color_transform_addon_impl);
+	}
+	wl_list_insert(&renderer->color_transforms, &transform->link);
+	color_transforms_evict(renderer);
+	return transform;
+}
+
+/**
+ * Get the position of each 8-bit channel of a 32-bit format. The alpha position
+ * is also returned for formats without alpha, where it holds padding bits.
+ */
+static bool get_channel_shifts(pixman_format_code_t format,
+		int *r, int *g, int *b, int *a) {
+	if (PIXMAN_FORMAT_BPP(format) != 32 || PIXMAN_FORMAT_R(format) != 8 ||
+			PIXMAN_FORMAT_G(format) != 8 || PIXMAN_FORMAT_B(format) != 8) {
+		return false;
+	}
+
+	switch (PIXMAN_FORMAT_TYPE(format)) {
+	case PIXMAN_TYPE_ARGB:
+		*a = 24, *r = 16, *g = 8, *b = 0;
+		break;
+	case PIXMAN_TYPE_ABGR:
+		*a = 24, *b = 16, *g = 8, *r = 0;
+		break;
+	case PIXMAN_TYPE_BGRA:
+		*b = 24, *g = 16, *r = 8, *a = 0;
+		break;
+	case PIXMAN_TYPE_RGBA:
+		*r = 24, *g = 16, *b = 8, *a = 0;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+static inline uint32_t lerp(uint32_t a, uint32_t b, uint32_t frac) {
+	return (a * (256 - frac) + b * frac) >> 8;
+}
+
+static void lut_3d_sample(const struct wlr_pixman_color_transform *transform,
+		uint8_t out[static 3], const uint8_t in[static 3]) {
+	const size_t dim = LUT_3D_DIM;
+	uint32_t ir = transform->lut_3d_index[in[0]], fr = transform->lut_3d_frac[in[0]];
+	uint32_t ig = transform->lut_3d_index[in[1]], fg = transform->lut_3d_frac[in[1]];
+	uint32_t ib = transform->lut_3d_index[in[2]], fb = transform->lut_3d_frac[in[2]];
+
+	const uint16_t *c000 = &transform->lut_3d[3 * (ir + dim * (ig + dim * ib))];
+	const uint16_t *c100 = c000 + 3;
+	const uint16_t *c010 = c000 + 3 * dim;
+	const uint16_t *c110 = c010 + 3;
+	const uint16_t *c001 = c000 + 3 * dim * dim;
+	const uint16_t *c101 = c001 + 3;
+	const uint16_t *c011 = c001 + 3 * dim;
+	const uint16_t *c111 = c011 + 3;
+
+	for (size_t c = 0; c < 3; c++) {
+		uint32_t c00 = lerp(c000[c], c100[c], fr);
+		uint32_t c10 = lerp(c010[c], c110[c], fr);
+		uint32_t c01 = lerp(c001[c], c101[c], fr);
+		uint32_t c11 = lerp(c011[c], c111[c], fr);
+		uint32_t c0 = lerp(c00, c10, fg);
+		uint32_t c1 = lerp(c01, c11, fg);
+		out[c] = (lerp(c0, c1, fb) + 128) >> 8;
+	}
+}
+
+struct pixel_layout {
+	int r_shift, g_shift, b_shift, a_shift;
+};
+
+static inline void transform_rgb(const struct wlr_pixman_color_transform *transform,
+		uint8_t rgb[static 3]) {
+	if (transform->separable) {
+		rgb[0] = transform->lut_1d[0][rgb[0]];
+		rgb[1] = transform->lut_1d[1][rgb[1]];
+		rgb[2] = transform->lut_1d[2][rgb[2]];
+	} else {
+		uint8_t in[3] = { rgb[0], rgb[1], rgb[2] };
+		lut_3d_sample(transform, rgb, in);
+	}
+}
+
+static inline uint32_t pack_pixel(const struct pixel_layout *layout,
+		const uint8_t rgb[static 3], uint32_t alpha) {
+	return ((uint32_t)rgb[0] << layout->r_shift) |
+		((uint32_t)rgb[1] << layout->g_shift) |
+		((uint32_t)rgb[2] << layout->b_shift) |
+		(alpha << layout->a_shift);
+}
+
+static void transform_row_opaque(const struct wlr_pixman_color_transform *transform,
+		const struct pixel_layout *layout, uint32_t *dst, const uint32_t *src,
+		int len) {
+	for (int x = 0; x < len; x++) {
+		uint32_t px = src[x];
+		uint8_t rgb[3] = { (px >> 16) & 0xFF, (px >> 8) & 0xFF, px & 0xFF };
+		transform_rgb(transform, rgb);
+		dst[x] = pack_pixel(layout, rgb, 0xFF);
+	}
+}
+
+static void transform_row_premultiplied(const struct wlr_pixman_color_transform *transform,
+		const struct pixel_layout *layout, uint32_t *dst, const uint32_t *src,
+		int len) {
+	for (int x = 0; x < len; x++) {
+		uint32_t px = src[x];
+		uint32_t alpha = px >> 24;
+		if (alpha == 0) {
+			dst[x] = 0;
+			continue;
+		}
+
+		uint8_t rgb[3] = { (px >> 16) & 0xFF, (px >> 8) & 0xFF, px & 0xFF };
+		if (alpha == 0xFF) {
+			transform_rgb(transform, rgb);
+			dst[x] = pack_pixel(layout, rgb, alpha);
+			continue;
+		}
+
+		// Look-up tables take straight alpha values
+		for (size_t c = 0; c < 3; c++) {
+			uint32_t v = (rgb[c] * 0xFF + alpha / 2) / alpha;
+			rgb[c] = v < 0xFF ? v : 0xFF;
+		}
+		transform_rgb(transform, rgb);
+		for (size_t c = 0; c < 3; c++) {
+			rgb[c] = (rgb[c] * alpha + 0x7F) / 0xFF;
+		}
+		dst[x] = pack_pixel(layout, rgb, alpha);
+	}
+}
+
+bool pixman_color_transform_supports_format(pixman_format_code_t format) {
+	int r, g, b, a;
+	return get_channel_shifts(format, &r, &g, &b, &a);
+}
+
+pixman_format_code_t pixman_color_transform_get_blend_format(pixman_format_code_t format) {
+	// Blending onto a format without alpha treats the destination as opaque,
+	// make sure the blend image does the same
+	return PIXMAN_FORMAT_A(format) != 0 ? PIXMAN_a8r8g8b8 : PIXMAN_x8r8g8b8;
+}
+
+void pixman_color_transform_apply(const struct wlr_pixman_color_transform *transform,
+		pixman_image_t *dst, pixman_image_t *blend, const pixman_region32_t *region) {
+	struct pixel_layout layout;
+	pixman_format_code_t format = pixman_image_get_format(dst);
+	if (!get_channel_shifts(format, &layout.r_shift, &layout.g_shift,
+			&layout.b_shift, &layout.a_shift)) {
+		// Checked when beginning the render pass
+		abort(); // unreachable
+	}
+	bool premultiplied = pixman_image_get_format(blend) == PIXMAN_a8r8g8b8;
+
+	uint8_t *dst_data = (uint8_t *)pixman_image_get_data(dst);
+	int dst_stride = pixman_image_get_stride(dst);
+	const uint8_t *blend_data = (const uint8_t *)pixman_image_get_data(blend);
+	int blend_stride = pixman_image_get_stride(blend);
+	int width = pixman_image_get_width(dst);
+	int height = pixman_image_get_height(dst);
+
+	int rects_len;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		int x1 = rects[i].x1 > 0 ? rects[i].x1 : 0;
+		int y1 = rects[i].y1 > 0 ? rects[i].y1 : 0;
+		int x2 = rects[i].x2 < width ? rects[i].x2 : width;
+		int y2 = rects[i].y2 < height ? rects[i].y2 : height;
+		if (x1 >= x2) {
+			continue;
+		}
+
+		for (int y = y1; y < y2; y++) {
+			uint32_t *dst_row = (uint32_t *)(dst_data + (ptrdiff_t)y * dst_stride);
+			const uint32_t *blend_row =
+				(const uint32_t *)(blend_data + (ptrdiff_t)y * blend_stride);
+			if (premultiplied) {
+				transform_row_premultiplied(transform, &layout,
+					&dst_row[x1], &blend_row[x1], x2 - x1);
+			} else {
+				transform_row_opaque(transform, &layout,
+					&dst_row[x1], &blend_row[x1], x2 - x1);
+			}
+		}
+	}
+}
@@ -1,6 +1,49 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
+#include <wlr/render/color.h>
+#include <wlr/util/log.h>
 #include "render/pixman.h"
+#include "util/time.h"
+
+// Minimum height of the bands the damage is split into by deferred passes
+#define TILE_MIN_HEIGHT 16
+// Number of tiles per thread, to balance unevenly expensive tiles
+#define TILES_PER_THREAD 4
+
+enum pixman_render_op_type {
+	PIXMAN_RENDER_OP_TEXTURE,
+	PIXMAN_RENDER_OP_RECT,
+};
+
+/**
+ * A single composite operation, either executed right away or recorded by a
+ * deferred pass.
+ */
+struct pixman_render_op {
+	enum pixman_render_op_type type;
+	pixman_op_t op;
+	int dst_x, dst_y, width, height;
+
+	// Area of the destination affected by the operation, only set for
+	// recorded operations
+	pixman_region32_t clip;
+
+	// PIXMAN_RENDER_OP_TEXTURE
+	struct {
+		pixman_format_code_t format;
+		uint32_t *data;
+		int width, height, stride;
+	} src;
+	int src_x, src_y;
+	bool has_transform;
+	struct pixman_transform transform;
+	pixman_filter_t filter;
+	float alpha;
+
+	// PIXMAN_RENDER_OP_RECT
+	struct pixman_color color;
+};
 
 static const struct wlr_render_pass_impl render_pass_impl;
 
@@ -16,14 +59,240 @@ static struct wlr_pixman_texture *get_texture(struct wlr_texture *wlr_texture) {
 	return texture;
 }
 
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static void get_op_region(pixman_region32_t *region,
+		const struct wlr_box *box, const pixman_region32_t *clip) {
+	pixman_region32_init_rect(region, box->x, box->y, box->width, box->height);
+	if (clip != NULL) {
+		pixman_region32_intersect(region, region, clip);
+	}
+}
+
+static void add_damage(struct wlr_pixman_render_pass *pass,
+		const struct wlr_box *box, const pixman_region32_t *clip) {
+	if (pass->color_transform == NULL && !pass->deferred) {
+		return;
+	}
+
+	pixman_region32_t region;
+	get_op_region(&region, box, clip);
+	pixman_region32_union(&pass->damage, &pass->damage, &region);
+	pixman_region32_fini(&region);
+}
+
+static void execute_op(const struct pixman_render_op *rop, pixman_image_t *src,
+		pixman_image_t *dst, const pixman_region32_t *clip) {
+	pixman_image_t *mask = NULL;
+	if (rop->type == PIXMAN_RENDER_OP_RECT) {
+		src = pixman_image_create_solid_fill(&rop->color);
+	} else {
+		if (rop->alpha != 1) {
+			mask = pixman_image_create_solid_fill(&(struct pixman_color){
+				.alpha = 0xFFFF * rop->alpha,
+			});
+		}
+
+		if (rop->has_transform) {
+			pixman_image_set_transform(src, &rop->transform);
+			pixman_image_set_filter(src, rop->filter, NULL, 0);
+		} else {
+			pixman_image_set_transform(src, NULL);
+		}
+	}
+
+	pixman_image_set_clip_region32(dst, clip);
+	pixman_image_composite32(rop->op, src, mask, dst,
+		rop->src_x, rop->src_y, 0, 0, rop->dst_x, rop->dst_y,
+		rop->width, rop->height);
+	pixman_image_set_clip_region32(dst, NULL);
+
+	if (rop->type == PIXMAN_RENDER_OP_RECT) {
+		pixman_image_unref(src);
+	} else if (rop->has_transform) {
+		pixman_image_set_transform(src, NULL);
+	}
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+}
+
+struct tile_job {
+	struct wlr_pixman_render_pass *pass;
+	const struct pixman_render_op *ops;
+	size_t ops_len;
+	// May be NULL, applied after all operations
+	const struct wlr_pixman_color_transform *color_transform;
+
+	pixman_box32_t extents;
+	int tile_height;
+};
+
+static void run_tile(void *data, size_t index) {
+	struct tile_job *job = data;
+	pixman_image_t *target = job->pass->target;
+
+	int y1 = job->extents.y1 + (int)index * job->tile_height;
+	int y2 = y1 + job->tile_height;
+	if (y2 > job->extents.y2) {
+		y2 = job->extents.y2;
+	}
+	pixman_region32_t tile;
+	pixman_region32_init_rect(&tile, job->extents.x1, y1,
+		job->extents.x2 - job->extents.x1, y2 - y1);
+
+	// Pixman images carry state (clip, transform) and aren't safe to share
+	// across threads, so each tile uses its own images on top of the same
+	// pixel data
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(target),
+		pixman_image_get_width(target),
+		pixman_image_get_height(target),
+		pixman_image_get_data(target),
+		pixman_image_get_stride(target));
+	if (dst == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image for tile");
+		pixman_region32_fini(&tile);
+		return;
+	}
+
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+	for (size_t i = 0; i < job->ops_len; i++) {
+		const struct pixman_render_op *rop = &job->ops[i];
+		pixman_region32_intersect(&clip, &tile, &rop->clip);
+		if (!pixman_region32_not_empty(&clip)) {
+			continue;
+		}
+
+		pixman_image_t *src = NULL;
+		if (rop->type == PIXMAN_RENDER_OP_TEXTURE) {
+			src = pixman_image_create_bits_no_clear(rop->src.format,
+				rop->src.width, rop->src.height, rop->src.data, rop->src.stride);
+			if (src == NULL) {
+				wlr_log(WLR_ERROR, "Failed to create pixman image for tile");
+				continue;
+			}
+		}
+
+		execute_op(rop, src, dst, &clip);
+
+		if (src != NULL) {
+			pixman_image_unref(src);
+		}
+	}
+
+	if (job->color_transform != NULL) {
+		// Only reads the pixel data of the images, which is safe to share
+		pixman_region32_intersect(&clip, &tile, &job->pass->damage);
+		pixman_color_transform_apply(job->color_transform,
+			job->pass->buffer->image, target, &clip);
+	}
+
+	pixman_region32_fini(&clip);
+	pixman_image_unref(dst);
+	pixman_region32_fini(&tile);
+}
+
+static void run_tiles(struct wlr_pixman_render_pass *pass,
+		const struct wlr_pixman_color_transform *color_transform) {
+	struct wlr_pixman_renderer *renderer = pass->buffer->renderer;
+	pixman_image_t *buffer_image = pass->buffer->image;
+
+	pixman_region32_t region;
+	pixman_region32_init_rect(&region, 0, 0,
+		pixman_image_get_width(buffer_image), pixman_image_get_height(buffer_image));
+	pixman_region32_intersect(&region, &region, &pass->damage);
+	struct tile_job job = {
+		.pass = pass,
+		.ops = pass->ops.data,
+		.ops_len = pass->ops.size / sizeof(struct pixman_render_op),
+		.color_transform = color_transform,
+		.extents = *pixman_region32_extents(&region),
+	};
+	pixman_region32_fini(&region);
+
+	int height = job.extents.y2 - job.extents.y1;
+	if (height <= 0 || (job.ops_len == 0 && color_transform == NULL)) {
+		return;
+	}
+
+	size_t max_tiles = pixman_worker_pool_get_threads(renderer->workers) *
+		TILES_PER_THREAD;
+	job.tile_height = (height + max_tiles - 1) / max_tiles;
+	if (job.tile_height < TILE_MIN_HEIGHT) {
+		job.tile_height = TILE_MIN_HEIGHT;
+	}
+	size_t tiles_len = (height + job.tile_height - 1) / job.tile_height;
+
+	pixman_worker_pool_run(renderer->workers, tiles_len, run_tile, &job);
+}
+
+/**
+ * Execute the operations recorded so far and release the resources they use.
+ */
+static void release_ops(struct wlr_pixman_render_pass *pass) {
+	struct pixman_render_op *rop;
+	wl_array_for_each(rop, &pass->ops) {
+		pixman_region32_fini(&rop->clip);
+	}
+	pass->ops.size = 0;
+
+	struct wlr_buffer **buffer_ptr;
+	wl_array_for_each(buffer_ptr, &pass->texture_buffers) {
+		wlr_buffer_end_data_ptr_access(*buffer_ptr);
+	}
+	pass->texture_buffers.size = 0;
+}
+
+void pixman_render_pass_flush(struct wlr_pixman_render_pass *pass) {
+	assert(pass->deferred);
+	run_tiles(pass, NULL);
+	release_ops(pass);
+}
+
 static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
 	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
+	struct wlr_pixman_buffer *buffer = pass->buffer;
+	struct wlr_pixman_render_timer *timer = pass->timer;
+	int64_t start_ns = timer != NULL ? get_time_nsec() : 0;
+	// Operations which couldn't be recorded are missing from the buffer
+	bool ok = !pass->failed;
+
+	// Operations were drawn on the blend image, write the pixels they touched
+	// to the buffer
+	struct wlr_pixman_color_transform *transform = pass->color_transform;
+	if (pass->deferred) {
+		run_tiles(pass, transform);
+		release_ops(pass);
+		wl_array_release(&pass->ops);
+		wl_array_release(&pass->texture_buffers);
+		wl_list_remove(&pass->link);
+	} else if (transform != NULL) {
+		pixman_color_transform_apply(transform, buffer->image, pass->target,
+			&pass->damage);
+	}
+
+	if (transform != NULL) {
+		transform->passes--;
+	}
+	wlr_color_transform_unref(pass->color_transform_ref);
+	pixman_region32_fini(&pass->damage);
 
-	wlr_buffer_end_data_ptr_access(pass->buffer->buffer);
-	wlr_buffer_unlock(pass->buffer->buffer);
+	wlr_buffer_end_data_ptr_access(buffer->buffer);
+	wlr_buffer_unlock(buffer->buffer);
 	free(pass);
 
-	return true;
+	if (timer != NULL) {
+		timer->timings.submit_ns = get_time_nsec() - start_ns;
+		timer->submitted = true;
+	}
+
+	return ok;
 }
 
 static pixman_op_t get_pixman_blending(enum wlr_render_blend_mode mode) {
@@ -36,20 +305,85 @@ static pixman_op_t get_pixman_blending(enum wlr_render_blend_mode mode) {
 	abort();
 }
 
+static bool begin_texture_access(struct wlr_pixman_render_pass *pass,
+		struct wlr_pixman_texture *texture) {
+	if (texture->buffer == NULL) {
+		return true;
+	}
+	if (!pass->deferred) {
+		return begin_pixman_data_ptr_access(texture->buffer,
+			&texture->image, WLR_BUFFER_DATA_PTR_ACCESS_READ);
+	}
+
+	// Deferred passes keep accessing texture buffers until the operations
+	// have been executed, and a buffer can't be accessed twice at once
+	struct wlr_buffer **buffer_ptr;
+	wl_array_for_each(buffer_ptr, &pass->texture_buffers) {
+		if (*buffer_ptr == texture->buffer) {
+			return true;
+		}
+	}
+
+	buffer_ptr = wl_array_add(&pass->texture_buffers, sizeof(*buffer_ptr));
+	if (buffer_ptr == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to record texture buffer");
+		pass->failed = true;
+		return false;
+	}
+	if (!begin_pixman_data_ptr_access(texture->buffer,
+			&texture->image, WLR_BUFFER_DATA_PTR_ACCESS_READ)) {
+		pass->texture_buffers.size -= sizeof(*buffer_ptr);
+		return false;
+	}
+	*buffer_ptr = texture->buffer;
+	return true;
+}
+
+static void submit_op(struct wlr_pixman_render_pass *pass,
+		struct pixman_render_op *rop, pixman_image_t *src,
+		const pixman_region32_t *clip) {
+	struct wlr_box box = {
+		.x = rop->dst_x,
+		.y = rop->dst_y,
+		.width = rop->width,
+		.height = rop->height,
+	};
+	add_damage(pass, &box, clip);
+
+	if (!pass->deferred) {
+		execute_op(rop, src, pass->target, clip);
+		return;
+	}
+
+	struct pixman_render_op *recorded = wl_array_add(&pass->ops, sizeof(*recorded));
+	if (recorded == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to record render operation");
+		pass->failed = true;
+		return;
+	}
+	*recorded = *rop;
+	get_op_region(&recorded->clip, &box, clip);
+
+	if (src != NULL) {
+		recorded->src.format = pixman_image_get_format(src);
+		recorded->src.data = pixman_image_get_data(src);
+		recorded->src.width = pixman_image_get_width(src);
+		recorded->src.height = pixman_image_get_height(src);
+		recorded->src.stride = pixman_image_get_stride(src);
+	}
+}
+
 static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 		const struct wlr_render_texture_options *options) {
 	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
 	struct wlr_pixman_texture *texture = get_texture(options->texture);
 	struct wlr_pixman_buffer *buffer = pass->buffer;
+	int64_t start_ns = pass->timer != NULL ? get_time_nsec() : 0;
 
-	if (texture->buffer != NULL && !begin_pixman_data_ptr_access(texture->buffer,
-			&texture->image, WLR_BUFFER_DATA_PTR_ACCESS_READ)) {
+	if (!begin_texture_access(pass, texture)) {
 		return;
 	}
 
-	pixman_op_t op = get_pixman_blending(options->blend_mode);
-	pixman_image_set_clip_region32(buffer->image, options->clip);
-
 	struct wlr_fbox src_fbox;
 	wlr_render_texture_options_get_src_box(options, &src_fbox);
 	struct wlr_box src_box = {
@@ -62,13 +396,11 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 	struct wlr_box dst_box;
 	wlr_render_texture_options_get_dst_box(options, &dst_box);
 
-	pixman_image_t *mask = NULL;
-	float alpha = wlr_render_texture_options_get_alpha(options);
-	if (alpha != 1) {
-		mask = pixman_image_create_solid_fill(&(struct pixman_color){
-			.alpha = 0xFFFF * alpha,
-		});
-	}
+	struct pixman_render_op rop = {
+		.type = PIXMAN_RENDER_OP_TEXTURE,
+		.op = get_pixman_blending(options->blend_mode),
+		.alpha = wlr_render_texture_options_get_alpha(options),
+	};
 
 	// Rotate the source size into destination coordinates
 	struct wlr_box src_box_transformed;
@@ -118,51 +450,50 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 		// coordinates.  But this only applies to internal wlroots code - the viewporter
 		// extension code makes sure that to clients everything works as it should.
 
-		struct pixman_transform transform;
-		pixman_transform_init_identity(&transform);
+		struct pixman_transform *transform = &rop.transform;
+		pixman_transform_init_identity(transform);
 
 		// Apply scaling to get to the dst_box size.  Because the scaling is applied last
 		// it depends on the whether the rotation swapped width and height, which is why
 		// we use src_box_transformed instead of src_box.
-		pixman_transform_scale(&transform, NULL,
+		pixman_transform_scale(transform, NULL,
 			pixman_double_to_fixed(src_box_transformed.width / (double)dst_box.width),
 			pixman_double_to_fixed(src_box_transformed.height / (double)dst_box.height));
 
 		// pixman rotates about the origin which again leaves everything outside of the
 		// viewport.  Translate the result so that its new top-left corner is back at the
 		// origin.
-		pixman_transform_translate(&transform, NULL,
+		pixman_transform_translate(transform, NULL,
 			-pixman_int_to_fixed(tr_x), -pixman_int_to_fixed(tr_y));
 
 		// Apply the rotation
-		pixman_transform_rotate(&transform, NULL,
+		pixman_transform_rotate(transform, NULL,
 			pixman_int_to_fixed(tr_cos), pixman_int_to_fixed(tr_sin));
 
 		// Apply flip before rotation
 		if (options->transform >= WL_OUTPUT_TRANSFORM_FLIPPED) {
 			// The flip leaves everything left of the Y axis which is outside the
 			// viewport. So translate everything back into the viewport.
-			pixman_transform_translate(&transform, NULL,
+			pixman_transform_translate(transform, NULL,
 				-pixman_int_to_fixed(src_box.width), pixman_int_to_fixed(0));
 			// Flip by applying a scale of -1 to the X axis
-			pixman_transform_scale(&transform, NULL,
+			pixman_transform_scale(transform, NULL,
 				pixman_int_to_fixed(-1), pixman_int_to_fixed(1));
 		}
 
 		// Apply the translation for source crop so the origin is now at the top-left of
 		// the region we're actually using.  Do this last so all the other transforms
 		// apply on top of this.
-		pixman_transform_translate(&transform, NULL,
+		pixman_transform_translate(transform, NULL,
 			pixman_int_to_fixed(src_box.x), pixman_int_to_fixed(src_box.y));
 
-		pixman_image_set_transform(texture->image, &transform);
-
+		rop.has_transform = true;
 		switch (options->filter_mode) {
 		case WLR_SCALE_FILTER_BILINEAR:
-			pixman_image_set_filter(texture->image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+			rop.filter = PIXMAN_FILTER_BILINEAR;
 			break;
 		case WLR_SCALE_FILTER_NEAREST:
-			pixman_image_set_filter(texture->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+			rop.filter = PIXMAN_FILTER_NEAREST;
 			break;
 		}
 
@@ -171,58 +502,68 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 		// width,height part of source crop is done here by the width and height we pass:
 		// because of the scaling, cropping at the end by dst_box.{width,height} is
 		// equivalent to if we cropped at the start by src_box.{width,height}.
-		pixman_image_composite32(op, texture->image, mask, buffer->image,
-			0, 0, // source x,y
-			0, 0, // mask x,y
-			dst_box.x, dst_box.y, // dest x,y
-			dst_box.width, dst_box.height // composite width,height
-		);
-
-		pixman_image_set_transform(texture->image, NULL);
+		rop.dst_x = dst_box.x;
+		rop.dst_y = dst_box.y;
+		rop.width = dst_box.width;
+		rop.height = dst_box.height;
 	} else {
 		// No transforms or crop needed, just a straight blit from the source
-		pixman_image_set_transform(texture->image, NULL);
-		pixman_image_composite32(op, texture->image, mask, buffer->image,
-			src_box.x, src_box.y, 0, 0, dst_box.x, dst_box.y,
-			src_box.width, src_box.height);
+		rop.src_x = src_box.x;
+		rop.src_y = src_box.y;
+		rop.dst_x = dst_box.x;
+		rop.dst_y = dst_box.y;
+		rop.width = src_box.width;
+		rop.height = src_box.height;
 	}
 
-	pixman_image_set_clip_region32(buffer->image, NULL);
+	submit_op(pass, &rop, texture->image, options->clip);
 
-	if (texture->buffer != NULL) {
+	if (texture->buffer != NULL && !pass->deferred) {
 		wlr_buffer_end_data_ptr_access(texture->buffer);
 	}
 
-	if (mask != NULL) {
-		pixman_image_unref(mask);
+	if (pass->timer != NULL) {
+		struct wlr_pixman_render_timings *timings = &pass->timer->timings;
+		int64_t duration_ns = get_time_nsec() - start_ns;
+		if (rop.has_transform) {
+			timings->composite_ns += duration_ns;
+			timings->composite_count++;
+		} else {
+			timings->blit_ns += duration_ns;
+			timings->blit_count++;
+		}
 	}
 }
 
 static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
 		const struct wlr_render_rect_options *options) {
 	struct wlr_pixman_render_pass *pass = get_render_pass(wlr_pass);
-	struct wlr_pixman_buffer *buffer = pass->buffer;
+	int64_t start_ns = pass->timer != NULL ? get_time_nsec() : 0;
 	struct wlr_box box;
 	wlr_render_rect_options_get_box(options, pass->buffer->buffer, &box);
 
-	pixman_op_t op = get_pixman_blending(options->color.a == 1 ?
-		WLR_RENDER_BLEND_MODE_NONE : options->blend_mode);
-
-	struct pixman_color color = {
-		.red = options->color.r * 0xFFFF,
-		.green = options->color.g * 0xFFFF,
-		.blue = options->color.b * 0xFFFF,
-		.alpha = options->color.a * 0xFFFF,
+	struct pixman_render_op rop = {
+		.type = PIXMAN_RENDER_OP_RECT,
+		.op = get_pixman_blending(options->color.a == 1 ?
+			WLR_RENDER_BLEND_MODE_NONE : options->blend_mode),
+		.dst_x = box.x,
+		.dst_y = box.y,
+		.width = box.width,
+		.height = box.height,
+		.color = {
+			.red = options->color.r * 0xFFFF,
+			.green = options->color.g * 0xFFFF,
+			.blue = options->color.b * 0xFFFF,
+			.alpha = options->color.a * 0xFFFF,
+		},
 	};
 
-	pixman_image_t *fill = pixman_image_create_solid_fill(&color);
+	submit_op(pass, &rop, NULL, options->clip);
 
-	pixman_image_set_clip_region32(buffer->image, options->clip);
-	pixman_image_composite32(op, fill, NULL, buffer->image,
-		0, 0, 0, 0, box.x, box.y, box.width, box.height);
-	pixman_image_set_clip_region32(buffer->image, NULL);
-
-	pixman_image_unref(fill);
+	if (pass->timer != NULL) {
+		pass->timer->timings.fill_ns += get_time_nsec() - start_ns;
+		pass->timer->timings.fill_count++;
+	}
 }
 
 static const struct wlr_render_pass_impl render_pass_impl = {
@@ -231,8 +572,25 @@ static const struct wlr_render_pass_impl render_pass_impl = {
 	.add_rect = render_pass_add_rect,
 };
 
+static bool ensure_blend_image(struct wlr_pixman_buffer *buffer) {
+	if (buffer->blend_image != NULL) {
+		return true;
+	}
+
+	pixman_format_code_t format = pixman_color_transform_get_blend_format(
+		pixman_image_get_format(buffer->image));
+	buffer->blend_image = pixman_image_create_bits(format,
+		buffer->buffer->width, buffer->buffer->height, NULL, 0);
+	if (buffer->blend_image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to allocate pixman blend image");
+		return false;
+	}
+	return true;
+}
+
 struct wlr_pixman_render_pass *begin_pixman_render_pass(
-		struct wlr_pixman_buffer *buffer) {
+		struct wlr_pixman_buffer *buffer, const struct wlr_buffer_pass_options *options) {
+	struct wlr_pixman_renderer *renderer = buffer->renderer;
 	struct wlr_pixman_render_pass *pass = calloc(1, sizeof(*pass));
 	if (pass == NULL) {
 		return NULL;
@@ -246,8 +604,57 @@ struct wlr_pixman_render_pass *begin_pixman_render_pass(
 		return NULL;
 	}
 
+	pass->target = buffer->image;
+	if (options != NULL && options->color_transform != NULL) {
+		struct wlr_pixman_color_transform *transform =
+			pixman_color_transform_get_or_create(renderer,
+				options->color_transform, options->primaries);
+		if (transform == NULL) {
+			wlr_buffer_end_data_ptr_access(buffer->buffer);
+			free(pass);
+			return NULL;
+		}
+
+		// The transform can only be applied to some formats. Render without
+		// it instead of leaving the buffer untouched.
+		pixman_format_code_t format = pixman_image_get_format(buffer->image);
+		bool supported = pixman_color_transform_supports_format(format);
+		if (!transform->identity && !supported) {
+			wlr_log(WLR_ERROR, "Unsupported pixman format 0x%08X for color "
+				"transforms, rendering without the transform", (unsigned int)format);
+		}
+
+		// Blending needs to happen before the transform is applied, and the
+		// transform can't be undone: draw on an intermediate image in
+		// blending space which persists across passes, like the buffer does
+		if (!transform->identity && supported) {
+			if (!ensure_blend_image(buffer)) {
+				wlr_buffer_end_data_ptr_access(buffer->buffer);
+				free(pass);
+				return NULL;
+			}
+			transform->passes++;
+			pass->color_transform = transform;
+			pass->color_transform_ref = wlr_color_transform_ref(options->color_transform);
+			pass->target = buffer->blend_image;
+		}
+	}
+
 	wlr_buffer_lock(buffer->buffer);
 	pass->buffer = buffer;
+	pixman_region32_init(&pass->damage);
 
+	if (renderer->workers != NULL) {
+		pass->deferred = true;
+		wl_array_init(&pass->ops);
+		wl_array_init(&pass->texture_buffers);
+		wl_list_insert(&renderer->deferred_passes, &pass->link);
+	}
+
+	if (options != NULL && options->timer != NULL) {
+		pass->timer = pixman_get_render_timer(options->timer);
+		pass->timer->submitted = false;
+		pass->timer->timings = (struct wlr_pixman_render_timings){0};
+	}
 	return pass;
 }
@@ -1,7 +1,10 @@
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <errno.h>
 #include <pixman.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <wayland-util.h>
 #include <wlr/render/interface.h>
 #include <wlr/util/box.h>
@@ -10,12 +13,27 @@
 #include "render/pixman.h"
 #include "types/wlr_buffer.h"
 
+// Upper bound for WLR_PIXMAN_THREADS
+#define MAX_THREADS 64
+
 static const struct wlr_renderer_impl renderer_impl;
+static const struct wlr_render_timer_impl render_timer_impl;
 
 bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer) {
 	return wlr_renderer->impl == &renderer_impl;
 }
 
+bool wlr_render_timer_is_pixman(struct wlr_render_timer *timer) {
+	return timer->impl == &render_timer_impl;
+}
+
+struct wlr_pixman_render_timer *pixman_get_render_timer(
+		struct wlr_render_timer *wlr_timer) {
+	assert(wlr_render_timer_is_pixman(wlr_timer));
+	struct wlr_pixman_render_timer *timer = wl_container_of(wlr_timer, timer, base);
+	return timer;
+}
+
 static struct wlr_pixman_renderer *get_renderer(
 		struct wlr_renderer *wlr_renderer) {
 	assert(wlr_renderer_is_pixman(wlr_renderer));
@@ -82,6 +100,13 @@ static struct wlr_pixman_texture *get_texture(
 
 static void texture_destroy(struct wlr_texture *wlr_texture) {
 	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+
+	// Deferred passes may still reference the texture's pixels
+	struct wlr_pixman_render_pass *pass;
+	wl_list_for_each(pass, &texture->renderer->deferred_passes, link) {
+		pixman_render_pass_flush(pass);
+	}
+
 	wl_list_remove(&texture->link);
 	pixman_image_unref(texture->image);
 	wlr_buffer_unlock(texture->buffer);
@@ -133,6 +158,9 @@ static void destroy_buffer(struct wlr_pixman_buffer *buffer) {
 	wl_list_remove(&buffer->buffer_destroy.link);
 
 	pixman_image_unref(buffer->image);
+	if (buffer->blend_image != NULL) {
+		pixman_image_unref(buffer->blend_image);
+	}
 
 	free(buffer);
 }
@@ -287,6 +315,14 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 		wlr_texture_destroy(&tex->wlr_texture);
 	}
 
+	struct wlr_pixman_color_transform *transform, *transform_tmp;
+	wl_list_for_each_safe(transform, transform_tmp, &renderer->color_transforms, link) {
+		pixman_color_transform_destroy(transform);
+	}
+
+	assert(wl_list_empty(&renderer->deferred_passes));
+	pixman_worker_pool_destroy(renderer->workers);
+
 	wlr_drm_format_set_finish(&renderer->drm_formats);
 
 	free(renderer);
@@ -304,21 +340,85 @@ static struct wlr_render_pass *pixman_begin_buffer_pass(struct wlr_renderer *wlr
 		return NULL;
 	}
 
-	struct wlr_pixman_render_pass *pass = begin_pixman_render_pass(buffer);
+	struct wlr_pixman_render_pass *pass = begin_pixman_render_pass(buffer, options);
 	if (pass == NULL) {
 		return NULL;
 	}
 	return &pass->base;
 }
 
+static struct wlr_render_timer *pixman_render_timer_create(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_render_timer *timer = calloc(1, sizeof(*timer));
+	if (timer == NULL) {
+		return NULL;
+	}
+	timer->base.impl = &render_timer_impl;
+	return &timer->base;
+}
+
+static int pixman_get_render_time(struct wlr_render_timer *wlr_timer) {
+	struct wlr_pixman_render_timer *timer = pixman_get_render_timer(wlr_timer);
+	if (!timer->submitted) {
+		return -1;
+	}
+	const struct wlr_pixman_render_timings *t = &timer->timings;
+	return t->blit_ns + t->composite_ns + t->fill_ns + t->submit_ns;
+}
+
+static void pixman_render_timer_destroy(struct wlr_render_timer *wlr_timer) {
+	struct wlr_pixman_render_timer *timer = pixman_get_render_timer(wlr_timer);
+	free(timer);
+}
+
+bool wlr_pixman_render_timer_get_timings(struct wlr_render_timer *wlr_timer,
+		struct wlr_pixman_render_timings *timings) {
+	struct wlr_pixman_render_timer *timer = pixman_get_render_timer(wlr_timer);
+	if (!timer->submitted) {
+		memset(timings, 0, sizeof(*timings));
+		return false;
+	}
+	*timings = timer->timings;
+	return true;
+}
+
 static const struct wlr_renderer_impl renderer_impl = {
 	.get_texture_formats = pixman_get_texture_formats,
 	.get_render_formats = pixman_get_render_formats,
 	.texture_from_buffer = pixman_texture_from_buffer,
 	.destroy = pixman_destroy,
 	.begin_buffer_pass = pixman_begin_buffer_pass,
+	.render_timer_create = pixman_render_timer_create,
+};
+
+static const struct wlr_render_timer_impl render_timer_impl = {
+	.get_duration_ns = pixman_get_render_time,
+	.destroy = pixman_render_timer_destroy,
 };
 
+static size_t get_threads_from_env(void) {
+	const char *str = getenv("WLR_PIXMAN_THREADS");
+	if (str == NULL) {
+		return 1;
+	}
+
+	char *end;
+	errno = 0;
+	long threads = strtol(str, &end, 10);
+	if (errno != 0 || *end != '\0' || threads < 0 || threads > MAX_THREADS) {
+		wlr_log(WLR_ERROR, "Invalid WLR_PIXMAN_THREADS value: %s", str);
+		return 1;
+	}
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+		if (threads > MAX_THREADS) {
+			threads = MAX_THREADS;
+		}
+	}
+	return threads;
+}
+
 struct wlr_renderer *wlr_pixman_renderer_create(void) {
 	struct wlr_pixman_renderer *renderer = calloc(1, sizeof(*renderer));
 	if (renderer == NULL) {
@@ -327,9 +427,23 @@ struct wlr_renderer *wlr_pixman_renderer_create(void) {
 
 	wlr_log(WLR_INFO, "Creating pixman renderer");
 	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl, WLR_BUFFER_CAP_DATA_PTR);
-	renderer->wlr_renderer.features.output_color_transform = false;
+	renderer->wlr_renderer.features.output_color_transform = true;
 	wl_list_init(&renderer->buffers);
 	wl_list_init(&renderer->textures);
+	wl_list_init(&renderer->color_transforms);
+	wl_list_init(&renderer->deferred_passes);
+
+	size_t threads = get_threads_from_env();
+	if (threads > 1) {
+		// The thread submitting the render pass takes part in the work
+		renderer->workers = pixman_worker_pool_create(threads - 1);
+		if (renderer->workers != NULL) {
+			wlr_log(WLR_INFO, "Using %zu threads for pixman render passes", threads);
+		} else {
+			wlr_log(WLR_ERROR, "Failed to create pixman worker threads, "
+				"rendering on a single thread");
+		}
+	}
 
 	size_t len = 0;
 	const uint32_t *formats = get_pixman_drm_formats(&len);
@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+struct wlr_pixman_worker_pool {
+	pthread_t *threads;
+	size_t threads_len;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond, done_cond;
+	bool stopping;
+
+	// Current job, protected by mutex
+	void (*run)(void *data, size_t index);
+	void *data;
+	size_t tasks_len, next_task, tasks_done;
+};
+
+// Must be called with the mutex locked, returns with the mutex locked
+static void run_tasks(struct wlr_pixman_worker_pool *pool) {
+	while (pool->next_task < pool->tasks_len) {
+		size_t index = pool->next_task++;
+		void (*run)(void *data, size_t index) = pool->run;
+		void *data = pool->data;
+
+		pthread_mutex_unlock(&pool->mutex);
+		run(data, index);
+		pthread_mutex_lock(&pool->mutex);
+
+		pool->tasks_done++;
+		if (pool->tasks_done == pool->tasks_len) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+	}
+}
+
+static void *worker_main(void *data) {
+	struct wlr_pixman_worker_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stopping && pool->next_task >= pool->tasks_len) {
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		}
+		if (pool->stopping) {
+			break;
+		}
+		run_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads_len) {
+	struct wlr_pixman_worker_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	pool->threads = calloc(threads_len, sizeof(pool->threads[0]));
+	if (pool->threads == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	// Workers must not steal asynchronous signals from the compositor (e.g.
+	// signals handled via a signalfd). Synchronous signals are still allowed
+	// since they can't be handled elsewhere, in particular SIGBUS raised when
+	// a client truncates a wl_shm pool.
+	sigset_t mask, prev_mask;
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_SETMASK, &mask, &prev_mask);
+
+	for (size_t i = 0; i < threads_len; i++) {
+		int ret = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+		if (ret != 0) {
+			wlr_log(WLR_ERROR, "Failed to create pixman worker thread: %s",
+				strerror(ret));
+			break;
+		}
+		pool->threads_len++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &prev_mask, NULL);
+
+	if (pool->threads_len != threads_len) {
+		pixman_worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < pool->threads_len; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->job_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+size_t pixman_worker_pool_get_threads(struct wlr_pixman_worker_pool *pool) {
+	// The calling thread takes part in running the tasks
+	return pool->threads_len + 1;
+}
+
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool, size_t tasks_len,
+		void (*run)(void *data, size_t index), void *data) {
+	pthread_mutex_lock(&pool->mutex);
+	assert(pool->tasks_len == 0);
+
+	pool->run = run;
+	pool->data = data;
+	pool->tasks_len = tasks_len;
+	pool->next_task = 0;
+	pool->tasks_done = 0;
+	pthread_cond_broadcast(&pool->job_cond);
+
+	run_tasks(pool);
+	while (pool->tasks_done < pool->tasks_len) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+
+	pool->run = NULL;
+	pool->data = NULL;
+	pool->tasks_len = 0;
+	pool->next_task = 0;
+	pool->tasks_done = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
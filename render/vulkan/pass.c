@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
 #include <wlr/render/color.h>
@@ -56,6 +57,77 @@ static void convert_pixman_box_to_vk_rect(const pixman_box32_t *box, VkRect2D *r
 	};
 }
 
+/**
+ * Draw the parts of a quad inside a list of rectangles with a single instanced
+ * draw call. box_matrix maps the unit quad to buffer-local coordinates, and the
+ * rectangles are additionally clipped to bounds if not NULL.
+ */
+static void draw_quad(struct wlr_vk_render_pass *pass, VkCommandBuffer cb,
+		const float box_matrix[static 9], const struct wlr_box *bounds,
+		const pixman_box32_t *rects, int rects_len) {
+	float matrix[9];
+	memcpy(matrix, box_matrix, sizeof(matrix));
+	if (rects_len == 0 || matrix[0] * matrix[4] - matrix[1] * matrix[3] == 0) {
+		return;
+	}
+	float inverse[9];
+	matrix_invert(inverse, matrix);
+
+	struct wlr_vk_buffer_span span = vulkan_get_stage_span(pass->renderer,
+		rects_len * sizeof(struct wlr_vk_quad_instance), sizeof(float) * 4);
+	if (span.buffer == NULL) {
+		pass->failed = true;
+		return;
+	}
+	struct wlr_vk_quad_instance *instances =
+		(void *)((char *)span.buffer->cpu_mapping + span.alloc.start);
+
+	uint32_t instances_len = 0;
+	for (int i = 0; i < rects_len; i++) {
+		pixman_box32_t rect = rects[i];
+		if (bounds != NULL) {
+			rect.x1 = rect.x1 > bounds->x ? rect.x1 : bounds->x;
+			rect.y1 = rect.y1 > bounds->y ? rect.y1 : bounds->y;
+			int x2 = bounds->x + bounds->width, y2 = bounds->y + bounds->height;
+			rect.x2 = rect.x2 < x2 ? rect.x2 : x2;
+			rect.y2 = rect.y2 < y2 ? rect.y2 : y2;
+		}
+		if (rect.x1 >= rect.x2 || rect.y1 >= rect.y2) {
+			continue;
+		}
+
+		// Quad transforms are multiples of 90° rotations and flips, so the
+		// rectangle stays axis-aligned in unit quad coordinates
+		float ax = inverse[0] * rect.x1 + inverse[1] * rect.y1 + inverse[2];
+		float ay = inverse[3] * rect.x1 + inverse[4] * rect.y1 + inverse[5];
+		float bx = inverse[0] * rect.x2 + inverse[1] * rect.y2 + inverse[2];
+		float by = inverse[3] * rect.x2 + inverse[4] * rect.y2 + inverse[5];
+		instances[instances_len++] = (struct wlr_vk_quad_instance){
+			.rect = {
+				ax < bx ? ax : bx,
+				ay < by ? ay : by,
+				ax < bx ? bx : ax,
+				ay < by ? by : ay,
+			},
+		};
+	}
+	if (instances_len == 0) {
+		return;
+	}
+
+	struct wlr_buffer *buffer = pass->render_buffer->wlr_buffer;
+	VkRect2D scissor = {
+		.extent = { .width = buffer->width, .height = buffer->height },
+	};
+	VkDeviceSize offset = span.alloc.start;
+	vkCmdBindVertexBuffers(cb, 0, 1, &span.buffer->buffer, &offset);
+	vkCmdSetScissor(cb, 0, 1, &scissor);
+	vkCmdDraw(cb, 4, instances_len, 0, 0);
+
+	pass->draw_calls++;
+	pass->quad_instances += instances_len;
+}
+
 static float color_to_linear(float non_linear) {
 	return pow(non_linear, 2.2);
 }
@@ -87,6 +159,9 @@ static void encode_color_matrix(const float mat3[9], float mat4[4][4]) {
 }
 
 static void render_pass_destroy(struct wlr_vk_render_pass *pass) {
+	assert(pass->renderer->stage.recording_passes > 0);
+	pass->renderer->stage.recording_passes--;
+
 	struct wlr_vk_render_pass_texture *pass_texture;
 	wl_array_for_each(pass_texture, &pass->textures) {
 		wlr_drm_syncobj_timeline_unref(pass_texture->wait_timeline);
@@ -179,10 +254,11 @@ static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
 		int width = pass->render_buffer->wlr_buffer->width;
 		int height = pass->render_buffer->wlr_buffer->height;
 
+		// Map the unit quad to the whole framebuffer
 		float final_matrix[9] = {
-			width, 0, -1,
-			0, height, -1,
-			0, 0, 0,
+			2, 0, -1,
+			0, 2, -1,
+			0, 0, 1,
 		};
 		struct wlr_vk_vert_pcr_data vert_pcr_data = {
 			.uv_off = { 0, 0 },
@@ -283,12 +359,12 @@ static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
 		int clip_rects_len;
 		const pixman_box32_t *clip_rects = pixman_region32_rectangles(
 			clip, &clip_rects_len);
-		for (int i = 0; i < clip_rects_len; i++) {
-			VkRect2D rect;
-			convert_pixman_box_to_vk_rect(&clip_rects[i], &rect);
-			vkCmdSetScissor(render_cb->vk, 0, 1, &rect);
-			vkCmdDraw(render_cb->vk, 4, 1, 0, 0);
-		}
+		float box_matrix[9] = {
+			width, 0, 0,
+			0, height, 0,
+			0, 0, 1,
+		};
+		draw_quad(pass, render_cb->vk, box_matrix, NULL, clip_rects, clip_rects_len);
 	}
 
 	vkCmdEndRenderPass(render_cb->vk);
@@ -535,21 +611,8 @@ static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
 		.value = render_timeline_point,
 	};
 	if (renderer->dev->implicit_sync_interop || pass->signal_timeline != NULL) {
-		if (render_cb->binary_semaphore == VK_NULL_HANDLE) {
-			VkExportSemaphoreCreateInfo export_info = {
-				.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
-				.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
-			};
-			VkSemaphoreCreateInfo semaphore_info = {
-				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-				.pNext = &export_info,
-			};
-			VkResult res = vkCreateSemaphore(renderer->dev->dev, &semaphore_info,
-				NULL, &render_cb->binary_semaphore);
-			if (res != VK_SUCCESS) {
-				wlr_vk_error("vkCreateSemaphore", res);
-				goto error;
-			}
+		if (!vulkan_command_buffer_init_binary_semaphore(render_cb, renderer)) {
+			goto error;
 		}
 
 		render_signal[render_signal_len++] = (VkSemaphoreSubmitInfoKHR){
@@ -583,20 +646,20 @@ static bool render_pass_submit(struct wlr_render_pass *wlr_pass) {
 
 	free(render_wait);
 
-	struct wlr_vk_shared_buffer *stage_buf, *stage_buf_tmp;
-	wl_list_for_each_safe(stage_buf, stage_buf_tmp, &renderer->stage.buffers, link) {
-		if (stage_buf->allocs.size == 0) {
-			continue;
-		}
-		wl_list_remove(&stage_buf->link);
-		wl_list_insert(&stage_cb->stage_buffers, &stage_buf->link);
-	}
+	// Stage allocations may hold vertex data, so they're released along
+	// with the render command buffer, which completes last
+	vulkan_stage_mark_submit(renderer, render_timeline_point);
 
 	if (!vulkan_sync_render_buffer(renderer, render_buffer, render_cb,
 			pass->signal_timeline, pass->signal_point)) {
 		wlr_log(WLR_ERROR, "Failed to sync render buffer");
 	}
 
+	if (renderer->log_draw_calls) {
+		wlr_log(WLR_DEBUG, "Vulkan render pass: %zu draw calls, %zu quad instances",
+			pass->draw_calls, pass->quad_instances);
+	}
+
 	render_pass_destroy(pass);
 	wlr_buffer_unlock(render_buffer->wlr_buffer);
 	return true;
@@ -672,10 +735,10 @@ static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
 
 	switch (options->blend_mode) {
 	case WLR_RENDER_BLEND_MODE_PREMULTIPLIED:;
-		float proj[9], matrix[9];
+		float proj[9], box_matrix[9], matrix[9];
 		wlr_matrix_identity(proj);
-		wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, proj);
-		wlr_matrix_multiply(matrix, pass->projection, matrix);
+		wlr_matrix_project_box(box_matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, proj);
+		wlr_matrix_multiply(matrix, pass->projection, box_matrix);
 
 		struct wlr_vk_pipeline *pipe = setup_get_or_create_pipeline(
 			pass->render_setup,
@@ -701,12 +764,7 @@ static void render_pass_add_rect(struct wlr_render_pass *wlr_pass,
 			VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float) * 4,
 			linear_color);
 
-		for (int i = 0; i < clip_rects_len; i++) {
-			VkRect2D rect;
-			convert_pixman_box_to_vk_rect(&clip_rects[i], &rect);
-			vkCmdSetScissor(cb, 0, 1, &rect);
-			vkCmdDraw(cb, 4, 1, 0, 0);
-		}
+		draw_quad(pass, cb, box_matrix, &box, clip_rects, clip_rects_len);
 		break;
 	case WLR_RENDER_BLEND_MODE_NONE:;
 		VkClearAttachment clear_att = {
@@ -760,10 +818,10 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 	wlr_render_texture_options_get_dst_box(options, &dst_box);
 	float alpha = wlr_render_texture_options_get_alpha(options);
 
-	float proj[9], matrix[9];
+	float proj[9], box_matrix[9], matrix[9];
 	wlr_matrix_identity(proj);
-	wlr_matrix_project_box(matrix, &dst_box, options->transform, proj);
-	wlr_matrix_multiply(matrix, pass->projection, matrix);
+	wlr_matrix_project_box(box_matrix, &dst_box, options->transform, proj);
+	wlr_matrix_multiply(matrix, pass->projection, box_matrix);
 
 	struct wlr_vk_vert_pcr_data vert_pcr_data = {
 		.uv_off = {
@@ -880,12 +938,8 @@ static void render_pass_add_texture(struct wlr_render_pass *wlr_pass,
 
 	int clip_rects_len;
 	const pixman_box32_t *clip_rects = pixman_region32_rectangles(&clip, &clip_rects_len);
+	draw_quad(pass, cb, box_matrix, &dst_box, clip_rects, clip_rects_len);
 	for (int i = 0; i < clip_rects_len; i++) {
-		VkRect2D rect;
-		convert_pixman_box_to_vk_rect(&clip_rects[i], &rect);
-		vkCmdSetScissor(cb, 0, 1, &rect);
-		vkCmdDraw(cb, 4, 1, 0, 0);
-
 		struct wlr_box clip_box = {
 			.x = clip_rects[i].x1,
 			.y = clip_rects[i].y1,
@@ -1316,5 +1370,6 @@ struct wlr_vk_render_pass *vulkan_begin_render_pass(struct wlr_vk_renderer *rend
 	pass->render_buffer_out = buffer_out;
 	pass->render_setup = render_setup;
 	pass->command_buffer = cb;
+	renderer->stage.recording_passes++;
 	return pass;
 }
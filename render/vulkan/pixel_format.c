@@ -329,8 +329,8 @@ static bool query_modifier_usage_support(struct wlr_vk_device *dev, VkFormat vk_
 }
 
 static bool query_shm_support(struct wlr_vk_device *dev, VkFormat vk_format,
-		VkFormat vk_format_variant, VkImageFormatProperties *out,
-		const char **errmsg) {
+		VkFormat vk_format_variant, VkImageUsageFlags usage, void *props_next,
+		VkImageFormatProperties *out, const char **errmsg) {
 	VkResult res;
 	*errmsg = NULL;
 
@@ -349,12 +349,13 @@ static bool query_shm_support(struct wlr_vk_device *dev, VkFormat vk_format,
 		.type = VK_IMAGE_TYPE_2D,
 		.format = vk_format,
 		.tiling = VK_IMAGE_TILING_OPTIMAL,
-		.usage = vulkan_shm_tex_usage,
+		.usage = usage,
 		.flags = vk_format_variant ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT : 0,
 		.pNext = &listi,
 	};
 	VkImageFormatProperties2 ifmtp = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+		.pNext = props_next,
 	};
 
 	res = vkGetPhysicalDeviceImageFormatProperties2(dev->phdev, &fmti, &ifmtp);
@@ -372,6 +373,35 @@ static bool query_shm_support(struct wlr_vk_device *dev, VkFormat vk_format,
 	return true;
 }
 
+// Host image copies are only used if they don't make the image slower to
+// access from the GPU, and don't restrict its size
+static bool query_shm_host_image_copy(struct wlr_vk_device *dev,
+		VkFormat vk_format, VkFormat vk_format_variant,
+		const VkImageFormatProperties *shm_props) {
+#ifdef VK_EXT_host_image_copy
+	if (!dev->host_image_copy) {
+		return false;
+	}
+
+	VkHostImageCopyDevicePerformanceQueryEXT perf = {
+		.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT,
+	};
+	VkImageFormatProperties ifmtp;
+	const char *errmsg;
+	if (!query_shm_support(dev, vk_format, vk_format_variant,
+			vulkan_shm_tex_usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT,
+			&perf, &ifmtp, &errmsg)) {
+		return false;
+	}
+
+	return perf.optimalDeviceAccess &&
+		ifmtp.maxExtent.width >= shm_props->maxExtent.width &&
+		ifmtp.maxExtent.height >= shm_props->maxExtent.height;
+#else
+	return false;
+#endif
+}
+
 static bool query_modifier_support(struct wlr_vk_device *dev,
 		struct wlr_vk_format_props *props, size_t modifier_count) {
 	VkDrmFormatModifierPropertiesListEXT modp = {
@@ -522,12 +552,14 @@ void vulkan_format_props_query(struct wlr_vk_device *dev,
 			!format->is_ycbcr && format_info != NULL) {
 		VkImageFormatProperties ifmtp;
 		bool supported = false, has_mutable_srgb = false;
-		if (query_shm_support(dev, format->vk, format->vk_srgb, &ifmtp, &errmsg)) {
+		if (query_shm_support(dev, format->vk, format->vk_srgb,
+				vulkan_shm_tex_usage, NULL, &ifmtp, &errmsg)) {
 			supported = true;
 			has_mutable_srgb = format->vk_srgb != 0;
 		}
 		if (!supported && format->vk_srgb) {
-			supported = query_shm_support(dev, format->vk, 0, &ifmtp, &errmsg);
+			supported = query_shm_support(dev, format->vk, 0,
+				vulkan_shm_tex_usage, NULL, &ifmtp, &errmsg);
 		}
 
 		if (supported) {
@@ -535,6 +567,8 @@ void vulkan_format_props_query(struct wlr_vk_device *dev,
 			props.shm.max_extent.height = ifmtp.maxExtent.height;
 			props.shm.features = fmtp.formatProperties.optimalTilingFeatures;
 			props.shm.has_mutable_srgb = has_mutable_srgb;
+			props.shm.host_image_copy = query_shm_host_image_copy(dev,
+				format->vk, has_mutable_srgb ? format->vk_srgb : 0, &ifmtp);
 
 			wlr_drm_format_set_add(&dev->shm_texture_formats,
 				format->drm, DRM_FORMAT_MOD_LINEAR);
@@ -548,7 +582,8 @@ void vulkan_format_props_query(struct wlr_vk_device *dev,
 	if (errmsg != NULL) {
 		snprintf(shm_texture_status, sizeof(shm_texture_status), "✗ texture (%s)", errmsg);
 	} else {
-		snprintf(shm_texture_status, sizeof(shm_texture_status), "✓ texture");
+		snprintf(shm_texture_status, sizeof(shm_texture_status), "✓ texture%s",
+			props.shm.host_image_copy ? " (host image copy)" : "");
 	}
 	wlr_log(WLR_DEBUG, "    Shared memory: %s", shm_texture_status);
 
@@ -2,8 +2,10 @@
 #include <fcntl.h>
 #include <math.h>
 #include <poll.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <drm_fourcc.h>
@@ -27,10 +29,10 @@
 #include "render/vulkan/shaders/quad.frag.h"
 #include "render/vulkan/shaders/output.frag.h"
 #include "types/wlr_buffer.h"
+#include "util/env.h"
 #include "util/time.h"
 
 // TODO:
-// - simplify stage allocation, don't track allocations but use ringbuffer-like
 // - use a pipeline cache (not sure when to save though, after every pipeline
 //   creation?)
 // - create pipelines as derivatives of each other
@@ -41,6 +43,12 @@
 
 static const VkDeviceSize min_stage_size = 1024 * 1024; // 1MB
 static const VkDeviceSize max_stage_size = 256 * min_stage_size; // 256MB
+// Unused stage buffers are destroyed after this delay. The peak usage of each
+// buffer is halved every interval, unless exceeded during that interval.
+// Oversized buffers (whose decayed peak is less than a quarter of their size)
+// are destroyed as soon as they're empty, so a buffer needs to remain mostly
+// unused for a few intervals before being trimmed.
+static const int64_t stage_trim_interval_ms = 10000;
 static const size_t start_descriptor_pool_size = 256u;
 static bool default_debug = true;
 
@@ -187,18 +195,35 @@ static void destroy_render_format_setup(struct wlr_vk_renderer *renderer,
 	free(setup);
 }
 
+static bool shared_buffer_is_empty(const struct wlr_vk_shared_buffer *buf) {
+	return !buf->pending && buf->segments.size == 0;
+}
+
+static VkDeviceSize shared_buffer_get_used(const struct wlr_vk_shared_buffer *buf) {
+	if (shared_buffer_is_empty(buf)) {
+		return 0;
+	} else if (buf->head > buf->tail) {
+		return buf->head - buf->tail;
+	} else {
+		return buf->buf_size - buf->tail + buf->head;
+	}
+}
+
 static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 		struct wlr_vk_shared_buffer *buffer) {
 	if (!buffer) {
 		return;
 	}
 
-	if (buffer->allocs.size > 0) {
-		wlr_log(WLR_ERROR, "shared_buffer_finish: %zu allocations left",
-			buffer->allocs.size / sizeof(struct wlr_vk_allocation));
+	if (!shared_buffer_is_empty(buffer)) {
+		wlr_log(WLR_ERROR, "shared_buffer_finish: %zu bytes still in use",
+			(size_t)shared_buffer_get_used(buffer));
+	}
+	if (buffer->buf_size > 0) {
+		r->stage.buffers_destroyed++;
 	}
 
-	wl_array_release(&buffer->allocs);
+	wl_array_release(&buffer->segments);
 	if (buffer->cpu_mapping) {
 		vkUnmapMemory(r->dev->dev, buffer->memory);
 		buffer->cpu_mapping = NULL;
@@ -214,85 +239,24 @@ static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 	free(buffer);
 }
 
-struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
-		VkDeviceSize size, VkDeviceSize alignment) {
-	// try to find free span
-	// simple greedy allocation algorithm - should be enough for this usecase
-	// since all allocations are freed together after the frame
-	struct wlr_vk_shared_buffer *buf;
-	wl_list_for_each_reverse(buf, &r->stage.buffers, link) {
-		VkDeviceSize start = 0u;
-		if (buf->allocs.size > 0) {
-			const struct wlr_vk_allocation *allocs = buf->allocs.data;
-			size_t allocs_len = buf->allocs.size / sizeof(struct wlr_vk_allocation);
-			const struct wlr_vk_allocation *last = &allocs[allocs_len - 1];
-			start = last->start + last->size;
-		}
-
-		assert(start <= buf->buf_size);
-
-		// ensure the proposed start is a multiple of alignment
-		start += alignment - 1 - ((start + alignment - 1) % alignment);
-
-		if (buf->buf_size - start < size) {
-			continue;
-		}
-
-		struct wlr_vk_allocation *a = wl_array_add(&buf->allocs, sizeof(*a));
-		if (a == NULL) {
-			wlr_log_errno(WLR_ERROR, "Allocation failed");
-			goto error_alloc;
-		}
-
-		*a = (struct wlr_vk_allocation){
-			.start = start,
-			.size = size,
-		};
-		return (struct wlr_vk_buffer_span) {
-			.buffer = buf,
-			.alloc = *a,
-		};
-	}
-
-	if (size > max_stage_size) {
-		wlr_log(WLR_ERROR, "cannot vulkan stage buffer: "
-			"requested size (%zu bytes) exceeds maximum (%zu bytes)",
-			(size_t)size, (size_t)max_stage_size);
-		goto error_alloc;
-	}
-
-	// we didn't find a free buffer - create one
-	// size = clamp(max(size * 2, prev_size * 2), min_size, max_size)
-	VkDeviceSize bsize = size * 2;
-	bsize = bsize < min_stage_size ? min_stage_size : bsize;
-	if (!wl_list_empty(&r->stage.buffers)) {
-		struct wl_list *last_link = r->stage.buffers.prev;
-		struct wlr_vk_shared_buffer *prev = wl_container_of(
-			last_link, prev, link);
-		VkDeviceSize last_size = 2 * prev->buf_size;
-		bsize = bsize < last_size ? last_size : bsize;
-	}
-
-	if (bsize > max_stage_size) {
-		wlr_log(WLR_INFO, "vulkan stage buffers have reached max size");
-		bsize = max_stage_size;
-	}
-
-	// create buffer
-	buf = calloc(1, sizeof(*buf));
+static struct wlr_vk_shared_buffer *shared_buffer_create(struct wlr_vk_renderer *r,
+		VkDeviceSize size) {
+	struct wlr_vk_shared_buffer *buf = calloc(1, sizeof(*buf));
 	if (!buf) {
 		wlr_log_errno(WLR_ERROR, "Allocation failed");
-		goto error_alloc;
+		return NULL;
 	}
 
 	wl_list_init(&buf->link);
+	wl_array_init(&buf->segments);
 
 	VkResult res;
 	VkBufferCreateInfo buf_info = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = bsize,
+		.size = size,
 		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
 	res = vkCreateBuffer(r->dev->dev, &buf_info, NULL, &buf->buffer);
@@ -335,34 +299,220 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 		goto error;
 	}
 
-	struct wlr_vk_allocation *a = wl_array_add(&buf->allocs, sizeof(*a));
-	if (a == NULL) {
-		wlr_log_errno(WLR_ERROR, "Allocation failed");
+	buf->buf_size = size;
+	// Consider new buffers fully used, to avoid trimming them right away
+	buf->decayed_peak = size;
+	buf->last_used_ms = get_current_time_msec();
+	r->stage.buffers_created++;
+
+	// Keep the list sorted by size, so that small buffers are filled first
+	// and large ones can become idle and get trimmed after a burst
+	struct wl_list *prev = r->stage.buffers.prev;
+	struct wlr_vk_shared_buffer *other;
+	wl_list_for_each(other, &r->stage.buffers, link) {
+		if (other->buf_size > size) {
+			prev = other->link.prev;
+			break;
+		}
+	}
+	wl_list_insert(prev, &buf->link);
+
+	return buf;
+
+error:
+	shared_buffer_destroy(r, buf);
+	return NULL;
+}
+
+static bool shared_buffer_alloc(struct wlr_vk_shared_buffer *buf,
+		VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *out) {
+	if (size == 0) {
+		*out = 0;
+		return true;
+	}
+
+	if (shared_buffer_is_empty(buf)) {
+		buf->head = buf->tail = 0;
+	}
+
+	// ensure the proposed start is a multiple of alignment
+	VkDeviceSize start = buf->head;
+	start += alignment - 1 - ((start + alignment - 1) % alignment);
+
+	if (!shared_buffer_is_empty(buf) && buf->head <= buf->tail) {
+		// Wrapped around: the free space lies between head and tail
+		if (start > buf->tail || buf->tail - start < size) {
+			return false;
+		}
+	} else if (start > buf->buf_size || buf->buf_size - start < size) {
+		// Not enough space left at the end, wrap around
+		start = 0;
+		if (buf->tail < size) {
+			return false;
+		}
+	}
+
+	buf->head = start + size;
+	buf->pending = true;
+
+	VkDeviceSize used = shared_buffer_get_used(buf);
+	if (used > buf->peak) {
+		buf->peak = used;
+	}
+
+	*out = start;
+	return true;
+}
+
+struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
+		VkDeviceSize size, VkDeviceSize alignment) {
+	VkDeviceSize start;
+	VkDeviceSize capacity = 0;
+	struct wlr_vk_shared_buffer *buf;
+	wl_list_for_each(buf, &r->stage.buffers, link) {
+		if (shared_buffer_alloc(buf, size, alignment, &start)) {
+			goto out;
+		}
+		capacity += buf->buf_size;
+	}
+
+	if (size > max_stage_size) {
+		wlr_log(WLR_ERROR, "cannot vulkan stage buffer: "
+			"requested size (%zu bytes) exceeds maximum (%zu bytes)",
+			(size_t)size, (size_t)max_stage_size);
 		goto error;
 	}
 
-	buf->buf_size = bsize;
-	wl_list_insert(&r->stage.buffers, &buf->link);
+	// we didn't find a buffer with enough free space - create one
+	// size = clamp(max(size * 2, capacity), min_size, max_size), which
+	// doubles the total staging capacity
+	VkDeviceSize bsize = size * 2;
+	bsize = bsize < min_stage_size ? min_stage_size : bsize;
+	bsize = bsize < capacity ? capacity : bsize;
+	if (bsize > max_stage_size) {
+		wlr_log(WLR_INFO, "vulkan stage buffers have reached max size");
+		bsize = max_stage_size;
+	}
 
-	*a = (struct wlr_vk_allocation){
-		.start = 0,
-		.size = size,
-	};
+	buf = shared_buffer_create(r, bsize);
+	if (buf == NULL) {
+		goto error;
+	}
+	wlr_log(WLR_DEBUG, "Created %zu byte vulkan stage buffer (total: %zu bytes)",
+		(size_t)bsize, (size_t)(capacity + bsize));
+
+	if (!shared_buffer_alloc(buf, size, alignment, &start)) {
+		abort(); // unreachable
+	}
+
+out:
 	return (struct wlr_vk_buffer_span) {
 		.buffer = buf,
-		.alloc = *a,
+		.alloc = (struct wlr_vk_allocation) {
+			.start = start,
+			.size = size,
+		},
 	};
 
 error:
-	shared_buffer_destroy(r, buf);
-
-error_alloc:
 	return (struct wlr_vk_buffer_span) {
 		.buffer = NULL,
 		.alloc = (struct wlr_vk_allocation) {0, 0},
 	};
 }
 
+void vulkan_stage_mark_submit(struct wlr_vk_renderer *r, uint64_t timeline_point) {
+	struct wlr_vk_shared_buffer *buf;
+	wl_list_for_each(buf, &r->stage.buffers, link) {
+		if (!buf->pending) {
+			continue;
+		}
+
+		struct wlr_vk_stage_segment *segment =
+			wl_array_add(&buf->segments, sizeof(*segment));
+		if (segment == NULL) {
+			// Keep the allocations pending, they'll be released along with
+			// the next submission
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			continue;
+		}
+		*segment = (struct wlr_vk_stage_segment){
+			.timeline_point = timeline_point,
+			.end = buf->head,
+		};
+		buf->pending = false;
+	}
+}
+
+static void release_stage_allocations(struct wlr_vk_renderer *r,
+		uint64_t current_point, int64_t now) {
+	struct wlr_vk_shared_buffer *buf;
+	wl_list_for_each(buf, &r->stage.buffers, link) {
+		struct wlr_vk_stage_segment *segments = buf->segments.data;
+		size_t segments_len = buf->segments.size / sizeof(segments[0]);
+
+		size_t completed = 0;
+		while (completed < segments_len &&
+				segments[completed].timeline_point <= current_point) {
+			buf->tail = segments[completed].end;
+			completed++;
+		}
+		if (completed == 0) {
+			continue;
+		}
+
+		memmove(segments, &segments[completed],
+			(segments_len - completed) * sizeof(segments[0]));
+		buf->segments.size -= completed * sizeof(segments[0]);
+		buf->last_used_ms = now;
+	}
+}
+
+static void trim_stage_buffers(struct wlr_vk_renderer *r, int64_t now) {
+	bool check_peak = r->stage.last_trim_ms + stage_trim_interval_ms < now;
+
+	struct wlr_vk_shared_buffer *buf, *buf_tmp;
+	wl_list_for_each_safe(buf, buf_tmp, &r->stage.buffers, link) {
+		if (check_peak) {
+			VkDeviceSize decayed = buf->decayed_peak / 2;
+			buf->decayed_peak = buf->peak > decayed ? buf->peak : decayed;
+		}
+
+		bool empty = shared_buffer_is_empty(buf);
+		bool idle = empty && buf->last_used_ms + stage_trim_interval_ms < now;
+		bool oversized = check_peak && empty && buf->buf_size > min_stage_size &&
+			buf->decayed_peak < buf->buf_size / 4;
+		if (idle || oversized) {
+			wlr_log(WLR_DEBUG, "Destroying %s %zu byte vulkan stage buffer",
+				idle ? "idle" : "oversized", (size_t)buf->buf_size);
+			shared_buffer_destroy(r, buf);
+			continue;
+		}
+
+		if (check_peak) {
+			buf->peak = shared_buffer_get_used(buf);
+		}
+	}
+
+	if (check_peak) {
+		r->stage.last_trim_ms = now;
+	}
+}
+
+void vulkan_trim_stage(struct wlr_vk_renderer *renderer) {
+	uint64_t current_point;
+	VkResult res = renderer->dev->api.vkGetSemaphoreCounterValueKHR(
+		renderer->dev->dev, renderer->timeline_semaphore, &current_point);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkGetSemaphoreCounterValueKHR", res);
+		return;
+	}
+
+	int64_t now = get_current_time_msec();
+	release_stage_allocations(renderer, current_point, now);
+	trim_stage_buffers(renderer, now);
+}
+
 VkCommandBuffer vulkan_record_stage_cb(struct wlr_vk_renderer *renderer) {
 	if (renderer->stage.cb == NULL) {
 		renderer->stage.cb = vulkan_acquire_command_buffer(renderer);
@@ -379,6 +529,18 @@ VkCommandBuffer vulkan_record_stage_cb(struct wlr_vk_renderer *renderer) {
 	return renderer->stage.cb->vk;
 }
 
+/**
+ * Attach stage allocations to a stage command buffer submission. Allocations
+ * of render passes being recorded may be used by their command buffer, so in
+ * that case they're left for the render pass submission to attach.
+ */
+static void stage_mark_submit_outside_pass(struct wlr_vk_renderer *renderer,
+		uint64_t timeline_point) {
+	if (renderer->stage.recording_passes == 0) {
+		vulkan_stage_mark_submit(renderer, timeline_point);
+	}
+}
+
 bool vulkan_submit_stage_wait(struct wlr_vk_renderer *renderer) {
 	if (renderer->stage.cb == NULL) {
 		return false;
@@ -411,12 +573,95 @@ bool vulkan_submit_stage_wait(struct wlr_vk_renderer *renderer) {
 		return false;
 	}
 
-	// NOTE: don't release stage allocations here since they may still be
-	// used for reading. Will be done next frame.
+	stage_mark_submit_outside_pass(renderer, timeline_point);
 
 	return vulkan_wait_command_buffer(cb, renderer);
 }
 
+bool vulkan_command_buffer_init_binary_semaphore(struct wlr_vk_command_buffer *cb,
+		struct wlr_vk_renderer *renderer) {
+	if (cb->binary_semaphore != VK_NULL_HANDLE) {
+		return true;
+	}
+
+	VkExportSemaphoreCreateInfo export_info = {
+		.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+	};
+	VkSemaphoreCreateInfo semaphore_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &export_info,
+	};
+	VkResult res = vkCreateSemaphore(renderer->dev->dev, &semaphore_info,
+		NULL, &cb->binary_semaphore);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkCreateSemaphore", res);
+		return false;
+	}
+
+	return true;
+}
+
+int vulkan_submit_stage_sync_file(struct wlr_vk_renderer *renderer) {
+	if (renderer->stage.cb == NULL) {
+		return -1;
+	}
+
+	struct wlr_vk_command_buffer *cb = renderer->stage.cb;
+	if (!vulkan_command_buffer_init_binary_semaphore(cb, renderer)) {
+		return -1;
+	}
+	renderer->stage.cb = NULL;
+
+	uint64_t timeline_point = vulkan_end_command_buffer(cb, renderer);
+	if (timeline_point == 0) {
+		return -1;
+	}
+
+	VkSemaphore signal_semaphores[] = {
+		renderer->timeline_semaphore,
+		cb->binary_semaphore,
+	};
+	uint64_t signal_values[] = { timeline_point, 0 };
+	VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		.signalSemaphoreValueCount = 2,
+		.pSignalSemaphoreValues = signal_values,
+	};
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_submit_info,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cb->vk,
+		.signalSemaphoreCount = 2,
+		.pSignalSemaphores = signal_semaphores,
+	};
+	VkResult res = vkQueueSubmit(renderer->dev->queue, 1, &submit_info, VK_NULL_HANDLE);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkQueueSubmit", res);
+		return -1;
+	}
+
+	stage_mark_submit_outside_pass(renderer, timeline_point);
+
+	// Note: vkGetSemaphoreFdKHR implicitly resets the semaphore
+	const VkSemaphoreGetFdInfoKHR get_fence_fd_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+		.semaphore = cb->binary_semaphore,
+		.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+	};
+	int sync_file_fd = -1;
+	res = renderer->dev->api.vkGetSemaphoreFdKHR(renderer->dev->dev,
+		&get_fence_fd_info, &sync_file_fd);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkGetSemaphoreFdKHR", res);
+		vulkan_wait_command_buffer(cb, renderer);
+		return -1;
+	}
+
+	return sync_file_fd;
+}
+
 struct wlr_vk_format_props *vulkan_format_props_from_drm(
 		struct wlr_vk_device *dev, uint32_t drm_fmt) {
 	for (size_t i = 0u; i < dev->format_prop_count; ++i) {
@@ -448,7 +693,6 @@ static bool init_command_buffer(struct wlr_vk_command_buffer *cb,
 		.vk = vk_cb,
 	};
 	wl_list_init(&cb->destroy_textures);
-	wl_list_init(&cb->stage_buffers);
 	return true;
 }
 
@@ -474,7 +718,7 @@ bool vulkan_wait_command_buffer(struct wlr_vk_command_buffer *cb,
 }
 
 static void release_command_buffer_resources(struct wlr_vk_command_buffer *cb,
-		struct wlr_vk_renderer *renderer, int64_t now) {
+		struct wlr_vk_renderer *renderer) {
 	struct wlr_vk_texture *texture, *texture_tmp;
 	wl_list_for_each_safe(texture, texture_tmp, &cb->destroy_textures, destroy_link) {
 		wl_list_remove(&texture->destroy_link);
@@ -482,15 +726,6 @@ static void release_command_buffer_resources(struct wlr_vk_command_buffer *cb,
 		wlr_texture_destroy(&texture->wlr_texture);
 	}
 
-	struct wlr_vk_shared_buffer *buf, *buf_tmp;
-	wl_list_for_each_safe(buf, buf_tmp, &cb->stage_buffers, link) {
-		buf->allocs.size = 0;
-		buf->last_used_ms = now;
-
-		wl_list_remove(&buf->link);
-		wl_list_insert(&renderer->stage.buffers, &buf->link);
-	}
-
 	if (cb->color_transform) {
 		wlr_color_transform_unref(cb->color_transform);
 		cb->color_transform = NULL;
@@ -509,22 +744,18 @@ static struct wlr_vk_command_buffer *get_command_buffer(
 		return NULL;
 	}
 
-
-	// Garbage collect any buffers that have remained unused for too long
+	// Release stage allocations of completed submissions and garbage
+	// collect any buffers that have remained unused for too long
 	int64_t now = get_current_time_msec();
-	struct wlr_vk_shared_buffer *buf, *buf_tmp;
-	wl_list_for_each_safe(buf, buf_tmp, &renderer->stage.buffers, link) {
-		if (buf->allocs.size == 0 && buf->last_used_ms + 10000 < now) {
-			shared_buffer_destroy(renderer, buf);
-		}
-	}
+	release_stage_allocations(renderer, current_point, now);
+	trim_stage_buffers(renderer, now);
 
 	// Destroy textures for completed command buffers
 	for (size_t i = 0; i < VULKAN_COMMAND_BUFFERS_CAP; i++) {
 		struct wlr_vk_command_buffer *cb = &renderer->command_buffers[i];
 		if (cb->vk != VK_NULL_HANDLE && !cb->recording &&
 				cb->timeline_point <= current_point) {
-			release_command_buffer_resources(cb, renderer, now);
+			release_command_buffer_resources(cb, renderer);
 		}
 	}
 
@@ -647,7 +878,11 @@ static void destroy_render_buffer(struct wlr_vk_render_buffer *buffer) {
 
 static void handle_render_buffer_destroy(struct wlr_addon *addon) {
 	struct wlr_vk_render_buffer *buffer = wl_container_of(addon, buffer, addon);
+	struct wlr_vk_renderer *renderer = buffer->renderer;
 	destroy_render_buffer(buffer);
+	// Outputs release their buffers when disabled, and may not render again
+	// for a while
+	vulkan_trim_stage(renderer);
 }
 
 static struct wlr_addon_interface render_buffer_addon_impl = {
@@ -1085,6 +1320,14 @@ static const struct wlr_drm_format_set *vulkan_get_render_formats(
 	return &renderer->dev->dmabuf_render_formats;
 }
 
+static void destroy_read_pixels_image(struct wlr_vk_renderer *renderer,
+		struct wlr_vk_read_pixels_image *image) {
+	VkDevice dev = renderer->dev->dev;
+	vkFreeMemory(dev, image->memory, NULL);
+	vkDestroyImage(dev, image->image, NULL);
+	free(image);
+}
+
 static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
 	struct wlr_vk_device *dev = renderer->dev;
@@ -1103,7 +1346,7 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		if (cb->vk == VK_NULL_HANDLE) {
 			continue;
 		}
-		release_command_buffer_resources(cb, renderer, 0);
+		release_command_buffer_resources(cb, renderer);
 		if (cb->binary_semaphore != VK_NULL_HANDLE) {
 			vkDestroySemaphore(renderer->dev->dev, cb->binary_semaphore, NULL);
 		}
@@ -1114,7 +1357,11 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		wl_array_release(&cb->wait_semaphores);
 	}
 
-	// stage.cb automatically freed with command pool
+	// stage.cb automatically freed with command pool. The device is idle, so
+	// every submission has reached its timeline point: allocations still
+	// pending were never submitted and can be released along with the rest.
+	vulkan_stage_mark_submit(renderer, renderer->timeline_point);
+	release_stage_allocations(renderer, UINT64_MAX, 0);
 	struct wlr_vk_shared_buffer *buf, *tmp_buf;
 	wl_list_for_each_safe(buf, tmp_buf, &renderer->stage.buffers, link) {
 		shared_buffer_destroy(renderer, buf);
@@ -1184,19 +1431,21 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		vkDestroyImage(dev->dev, renderer->read_pixels_cache.dst_image, NULL);
 	}
 
+	struct wlr_vk_read_pixels_image *read_image, *read_image_tmp;
+	wl_list_for_each_safe(read_image, read_image_tmp,
+			&renderer->read_pixels_pool.images, link) {
+		destroy_read_pixels_image(renderer, read_image);
+	}
+
 	struct wlr_vk_instance *ini = dev->instance;
 	vulkan_device_destroy(dev);
 	vulkan_instance_destroy(ini);
 	free(renderer);
 }
 
-bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
-		VkFormat src_format, VkImage src_image,
-		uint32_t drm_format, uint32_t stride,
-		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
-		uint32_t dst_x, uint32_t dst_y, void *data) {
-	VkDevice dev = vk_renderer->dev->dev;
-
+static bool get_read_pixels_format(struct wlr_vk_renderer *vk_renderer,
+		VkFormat src_format, uint32_t drm_format, VkFormat *dst_format,
+		bool *blit_supported) {
 	const struct wlr_pixel_format_info *pixel_format_info = drm_get_pixel_format_info(drm_format);
 	if (!pixel_format_info) {
 		wlr_log(WLR_ERROR, "vulkan_read_pixels: could not find pixel format info "
@@ -1213,92 +1462,138 @@ bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
 				"matching drm format 0x%08x available", drm_format);
 		return false;
 	}
-	VkFormat dst_format = wlr_vk_format->vk;
+	*dst_format = wlr_vk_format->vk;
 	VkFormatProperties dst_format_props = {0}, src_format_props = {0};
-	vkGetPhysicalDeviceFormatProperties(vk_renderer->dev->phdev, dst_format, &dst_format_props);
+	vkGetPhysicalDeviceFormatProperties(vk_renderer->dev->phdev, *dst_format, &dst_format_props);
 	vkGetPhysicalDeviceFormatProperties(vk_renderer->dev->phdev, src_format, &src_format_props);
 
-	bool blit_supported = src_format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT &&
+	*blit_supported = src_format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT &&
 		dst_format_props.linearTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT;
-	if (!blit_supported && src_format != dst_format) {
+	if (!*blit_supported && src_format != *dst_format) {
 		wlr_log(WLR_ERROR, "vulkan_read_pixels: blit unsupported and no manual "
 					"conversion available from src to dst format.");
 		return false;
 	}
 
+	return true;
+}
+
+static bool create_read_pixels_image(struct wlr_vk_renderer *vk_renderer,
+		VkFormat dst_format, uint32_t width, uint32_t height,
+		VkImage *dst_image, VkDeviceMemory *dst_img_memory) {
+	VkDevice dev = vk_renderer->dev->dev;
 	VkResult res;
-	VkImage dst_image;
-	VkDeviceMemory dst_img_memory;
-	bool use_cached = vk_renderer->read_pixels_cache.initialized &&
-		vk_renderer->read_pixels_cache.drm_format == drm_format &&
-		vk_renderer->read_pixels_cache.width == width &&
-		vk_renderer->read_pixels_cache.height == height;
 
-	if (use_cached) {
-		dst_image = vk_renderer->read_pixels_cache.dst_image;
-		dst_img_memory = vk_renderer->read_pixels_cache.dst_img_memory;
-	} else {
-		VkImageCreateInfo image_create_info = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-			.imageType = VK_IMAGE_TYPE_2D,
-			.format = dst_format,
-			.extent.width = width,
-			.extent.height = height,
-			.extent.depth = 1,
-			.arrayLayers = 1,
-			.mipLevels = 1,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.tiling = VK_IMAGE_TILING_LINEAR,
-			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT
-		};
-		res = vkCreateImage(dev, &image_create_info, NULL, &dst_image);
-		if (res != VK_SUCCESS) {
-			wlr_vk_error("vkCreateImage", res);
-			return false;
-		}
+	VkImageCreateInfo image_create_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = dst_format,
+		.extent.width = width,
+		.extent.height = height,
+		.extent.depth = 1,
+		.arrayLayers = 1,
+		.mipLevels = 1,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_LINEAR,
+		.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT
+	};
+	res = vkCreateImage(dev, &image_create_info, NULL, dst_image);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkCreateImage", res);
+		return false;
+	}
 
-		VkMemoryRequirements mem_reqs;
-		vkGetImageMemoryRequirements(dev, dst_image, &mem_reqs);
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(dev, *dst_image, &mem_reqs);
 
-		int mem_type = vulkan_find_mem_type(vk_renderer->dev,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-				VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
-				mem_reqs.memoryTypeBits);
-		if (mem_type < 0) {
-			wlr_log(WLR_ERROR, "vulkan_read_pixels: could not find adequate memory type");
-			goto destroy_image;
-		}
+	int mem_type = vulkan_find_mem_type(vk_renderer->dev,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			mem_reqs.memoryTypeBits);
+	if (mem_type < 0) {
+		wlr_log(WLR_ERROR, "vulkan_read_pixels: could not find adequate memory type");
+		goto destroy_image;
+	}
 
-		VkMemoryAllocateInfo mem_alloc_info = {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		};
-		mem_alloc_info.allocationSize = mem_reqs.size;
-		mem_alloc_info.memoryTypeIndex = mem_type;
+	VkMemoryAllocateInfo mem_alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+	};
+	mem_alloc_info.allocationSize = mem_reqs.size;
+	mem_alloc_info.memoryTypeIndex = mem_type;
 
-		res = vkAllocateMemory(dev, &mem_alloc_info, NULL, &dst_img_memory);
-		if (res != VK_SUCCESS) {
-			wlr_vk_error("vkAllocateMemory", res);
-			goto destroy_image;
-		}
-		res = vkBindImageMemory(dev, dst_image, dst_img_memory, 0);
-		if (res != VK_SUCCESS) {
-			wlr_vk_error("vkBindImageMemory", res);
-			goto free_memory;
-		}
+	res = vkAllocateMemory(dev, &mem_alloc_info, NULL, dst_img_memory);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkAllocateMemory", res);
+		goto destroy_image;
+	}
+	res = vkBindImageMemory(dev, *dst_image, *dst_img_memory, 0);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkBindImageMemory", res);
+		goto free_memory;
+	}
 
-		if (vk_renderer->read_pixels_cache.initialized) {
-			vkFreeMemory(dev, vk_renderer->read_pixels_cache.dst_img_memory, NULL);
-			vkDestroyImage(dev, vk_renderer->read_pixels_cache.dst_image, NULL);
+	return true;
+
+free_memory:
+	vkFreeMemory(dev, *dst_img_memory, NULL);
+destroy_image:
+	vkDestroyImage(dev, *dst_image, NULL);
+	return false;
+}
+
+// Takes an idle image of the given format and size from the pool, or creates
+// a new one
+static struct wlr_vk_read_pixels_image *acquire_read_pixels_image(
+		struct wlr_vk_renderer *vk_renderer, VkFormat dst_format,
+		uint32_t drm_format, uint32_t width, uint32_t height) {
+	struct wlr_vk_read_pixels_image *image;
+	wl_list_for_each(image, &vk_renderer->read_pixels_pool.images, link) {
+		if (image->drm_format == drm_format && image->width == width &&
+				image->height == height) {
+			wl_list_remove(&image->link);
+			vk_renderer->read_pixels_pool.len--;
+			return image;
 		}
-		vk_renderer->read_pixels_cache.initialized = true;
-		vk_renderer->read_pixels_cache.drm_format = drm_format;
-		vk_renderer->read_pixels_cache.dst_image = dst_image;
-		vk_renderer->read_pixels_cache.dst_img_memory = dst_img_memory;
-		vk_renderer->read_pixels_cache.width = width;
-		vk_renderer->read_pixels_cache.height = height;
 	}
 
+	image = calloc(1, sizeof(*image));
+	if (image == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	if (!create_read_pixels_image(vk_renderer, dst_format, width, height,
+			&image->image, &image->memory)) {
+		free(image);
+		return NULL;
+	}
+	image->drm_format = drm_format;
+	image->width = width;
+	image->height = height;
+	return image;
+}
+
+// Returns an image the GPU is done with to the pool, evicting the least
+// recently released one if the pool is full
+static void release_read_pixels_image(struct wlr_vk_renderer *vk_renderer,
+		struct wlr_vk_read_pixels_image *image) {
+	wl_list_insert(&vk_renderer->read_pixels_pool.images, &image->link);
+	vk_renderer->read_pixels_pool.len++;
+
+	if (vk_renderer->read_pixels_pool.len > VULKAN_READ_PIXELS_POOL_CAP) {
+		struct wlr_vk_read_pixels_image *oldest = wl_container_of(
+			vk_renderer->read_pixels_pool.images.prev, oldest, link);
+		wl_list_remove(&oldest->link);
+		vk_renderer->read_pixels_pool.len--;
+		destroy_read_pixels_image(vk_renderer, oldest);
+	}
+}
+
+// Records the copy from the source image to the host-visible image into the
+// stage command buffer
+static bool record_read_pixels(struct wlr_vk_renderer *vk_renderer,
+		VkImage src_image, VkImage dst_image, bool blit_supported,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y) {
 	VkCommandBuffer cb = vulkan_record_stage_cb(vk_renderer);
 	if (cb == VK_NULL_HANDLE) {
 		return false;
@@ -1380,9 +1675,20 @@ bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_ACCESS_MEMORY_READ_BIT);
 
-	if (!vulkan_submit_stage_wait(vk_renderer)) {
-		return false;
-	}
+	return true;
+}
+
+// Copies the pixels from the host-visible image to the destination, once the
+// GPU is done writing to it
+static bool copy_read_pixels(struct wlr_vk_renderer *vk_renderer,
+		VkImage dst_image, VkDeviceMemory dst_img_memory,
+		uint32_t drm_format, uint32_t stride, uint32_t width, uint32_t height,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	VkDevice dev = vk_renderer->dev->dev;
+	VkResult res;
+
+	const struct wlr_pixel_format_info *pixel_format_info = drm_get_pixel_format_info(drm_format);
+	assert(pixel_format_info);
 
 	VkImageSubresource img_sub_res = {
 		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -1425,15 +1731,164 @@ bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
 	}
 
 	vkUnmapMemory(dev, dst_img_memory);
-	// Don't need to free anything else, since memory and image are cached
 	return true;
+}
 
-free_memory:
-	vkFreeMemory(dev, dst_img_memory, NULL);
-destroy_image:
-	vkDestroyImage(dev, dst_image, NULL);
+bool vulkan_read_pixels(struct wlr_vk_renderer *vk_renderer,
+		VkFormat src_format, VkImage src_image,
+		uint32_t drm_format, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	VkDevice dev = vk_renderer->dev->dev;
 
-	return false;
+	VkFormat dst_format;
+	bool blit_supported;
+	if (!get_read_pixels_format(vk_renderer, src_format, drm_format,
+			&dst_format, &blit_supported)) {
+		return false;
+	}
+
+	VkImage dst_image;
+	VkDeviceMemory dst_img_memory;
+	bool use_cached = vk_renderer->read_pixels_cache.initialized &&
+		vk_renderer->read_pixels_cache.drm_format == drm_format &&
+		vk_renderer->read_pixels_cache.width == width &&
+		vk_renderer->read_pixels_cache.height == height;
+
+	if (use_cached) {
+		dst_image = vk_renderer->read_pixels_cache.dst_image;
+		dst_img_memory = vk_renderer->read_pixels_cache.dst_img_memory;
+	} else {
+		if (!create_read_pixels_image(vk_renderer, dst_format, width, height,
+				&dst_image, &dst_img_memory)) {
+			return false;
+		}
+
+		if (vk_renderer->read_pixels_cache.initialized) {
+			vkFreeMemory(dev, vk_renderer->read_pixels_cache.dst_img_memory, NULL);
+			vkDestroyImage(dev, vk_renderer->read_pixels_cache.dst_image, NULL);
+		}
+		vk_renderer->read_pixels_cache.initialized = true;
+		vk_renderer->read_pixels_cache.drm_format = drm_format;
+		vk_renderer->read_pixels_cache.dst_image = dst_image;
+		vk_renderer->read_pixels_cache.dst_img_memory = dst_img_memory;
+		vk_renderer->read_pixels_cache.width = width;
+		vk_renderer->read_pixels_cache.height = height;
+	}
+
+	if (!record_read_pixels(vk_renderer, src_image, dst_image, blit_supported,
+			width, height, src_x, src_y)) {
+		return false;
+	}
+
+	if (!vulkan_submit_stage_wait(vk_renderer)) {
+		return false;
+	}
+
+	// Don't need to free anything, since memory and image are cached
+	return copy_read_pixels(vk_renderer, dst_image, dst_img_memory,
+		drm_format, stride, width, height, dst_x, dst_y, data);
+}
+
+static const struct wlr_texture_read_pixels_async_impl read_pixels_async_impl;
+
+static struct wlr_vk_read_pixels_async *get_read_pixels_async(
+		struct wlr_texture_read_pixels_async *base) {
+	assert(base->impl == &read_pixels_async_impl);
+	struct wlr_vk_read_pixels_async *read = wl_container_of(base, read, base);
+	return read;
+}
+
+static bool read_pixels_async_finish(struct wlr_texture_read_pixels_async *base,
+		void *data, uint32_t stride) {
+	struct wlr_vk_read_pixels_async *read = get_read_pixels_async(base);
+	struct wlr_vk_read_pixels_image *image = read->image;
+	return copy_read_pixels(read->renderer, image->image, image->memory,
+		image->drm_format, stride, image->width, image->height, 0, 0, data);
+}
+
+static void read_pixels_async_destroy(struct wlr_texture_read_pixels_async *base) {
+	struct wlr_vk_read_pixels_async *read = get_read_pixels_async(base);
+	struct wlr_vk_renderer *renderer = read->renderer;
+	VkDevice dev = renderer->dev->dev;
+
+	if (!base->ready) {
+		// The GPU may still be writing to the image
+		VkSemaphoreWaitInfoKHR wait_info = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+			.semaphoreCount = 1,
+			.pSemaphores = &renderer->timeline_semaphore,
+			.pValues = &read->timeline_point,
+		};
+		VkResult res = renderer->dev->api.vkWaitSemaphoresKHR(dev, &wait_info, UINT64_MAX);
+		if (res != VK_SUCCESS) {
+			wlr_vk_error("vkWaitSemaphoresKHR", res);
+		}
+	}
+
+	release_read_pixels_image(renderer, read->image);
+	free(read);
+}
+
+static const struct wlr_texture_read_pixels_async_impl read_pixels_async_impl = {
+	.finish = read_pixels_async_finish,
+	.destroy = read_pixels_async_destroy,
+};
+
+struct wlr_vk_read_pixels_async *vulkan_read_pixels_async(
+		struct wlr_vk_renderer *vk_renderer,
+		VkFormat src_format, VkImage src_image, uint32_t drm_format,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y) {
+	if (!vk_renderer->dev->sync_file_import_export) {
+		return NULL;
+	}
+
+	VkFormat dst_format;
+	bool blit_supported;
+	if (!get_read_pixels_format(vk_renderer, src_format, drm_format,
+			&dst_format, &blit_supported)) {
+		return NULL;
+	}
+
+	struct wlr_vk_read_pixels_async *read = calloc(1, sizeof(*read));
+	if (read == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	read->renderer = vk_renderer;
+
+	// Each read gets its own image, since multiple reads may be in flight
+	read->image = acquire_read_pixels_image(vk_renderer, dst_format, drm_format,
+		width, height);
+	if (read->image == NULL) {
+		free(read);
+		return NULL;
+	}
+
+	if (!record_read_pixels(vk_renderer, src_image, read->image->image, blit_supported,
+			width, height, src_x, src_y)) {
+		goto error;
+	}
+
+	read->cb = vk_renderer->stage.cb;
+	int sync_file_fd = vulkan_submit_stage_sync_file(vk_renderer);
+	if (sync_file_fd < 0) {
+		goto error;
+	}
+	read->timeline_point = read->cb->timeline_point;
+
+	wlr_texture_read_pixels_async_init(&read->base, &read_pixels_async_impl,
+		sync_file_fd);
+	return read;
+
+error:
+	if (read->cb != NULL && read->cb == vk_renderer->stage.cb) {
+		// The copy was recorded but not submitted, and references the image
+		vulkan_submit_stage_wait(vk_renderer);
+	}
+	destroy_read_pixels_image(vk_renderer, read->image);
+	free(read);
+	return NULL;
 }
 
 static int vulkan_get_drm_fd(struct wlr_renderer *wlr_renderer) {
@@ -1627,6 +2082,21 @@ static bool init_blend_to_output_layouts(struct wlr_vk_renderer *renderer) {
 	return true;
 }
 
+// Quads are drawn as instances of a 4-vertex triangle fan, each instance
+// restricting the quad to a struct wlr_vk_quad_instance rectangle
+static const VkVertexInputBindingDescription quad_instance_binding = {
+	.binding = 0,
+	.stride = sizeof(struct wlr_vk_quad_instance),
+	.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+};
+
+static const VkVertexInputAttributeDescription quad_instance_attribute = {
+	.location = 0,
+	.binding = 0,
+	.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+	.offset = offsetof(struct wlr_vk_quad_instance, rect),
+};
+
 static bool pipeline_layout_key_equals(
 		const struct wlr_vk_pipeline_layout_key *a,
 		const struct wlr_vk_pipeline_layout_key *b) {
@@ -1799,6 +2269,10 @@ struct wlr_vk_pipeline *setup_get_or_create_pipeline(
 
 	VkPipelineVertexInputStateCreateInfo vertex = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &quad_instance_binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &quad_instance_attribute,
 	};
 
 	VkGraphicsPipelineCreateInfo pinfo = {
@@ -1916,6 +2390,10 @@ static bool init_blend_to_output_pipeline(struct wlr_vk_renderer *renderer,
 
 	VkPipelineVertexInputStateCreateInfo vertex = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &quad_instance_binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &quad_instance_attribute,
 	};
 
 	VkGraphicsPipelineCreateInfo pinfo = {
@@ -2486,6 +2964,7 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl, WLR_BUFFER_CAP_DMABUF);
 	renderer->wlr_renderer.features.input_color_transform = true;
 	renderer->wlr_renderer.features.output_color_transform = true;
+	renderer->log_draw_calls = env_parse_bool("WLR_VK_LOG_DRAW_CALLS");
 	wl_list_init(&renderer->stage.buffers);
 	wl_list_init(&renderer->foreign_textures);
 	wl_list_init(&renderer->textures);
@@ -2495,6 +2974,7 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 	wl_list_init(&renderer->render_buffers);
 	wl_list_init(&renderer->color_transforms);
 	wl_list_init(&renderer->pipeline_layouts);
+	wl_list_init(&renderer->read_pixels_pool.images);
 
 	uint64_t cap_syncobj_timeline;
 	if (dev->drm_fd >= 0 && drmGetCap(dev->drm_fd, DRM_CAP_SYNCOBJ_TIMELINE, &cap_syncobj_timeline) == 0) {
@@ -2595,3 +3075,22 @@ uint32_t wlr_vk_renderer_get_queue_family(struct wlr_renderer *renderer) {
 	struct wlr_vk_renderer *vk_renderer = vulkan_get_renderer(renderer);
 	return vk_renderer->dev->queue_family;
 }
+
+void wlr_vk_renderer_get_stage_stats(struct wlr_renderer *renderer,
+		struct wlr_vk_renderer_stage_stats *stats) {
+	struct wlr_vk_renderer *vk_renderer = vulkan_get_renderer(renderer);
+
+	*stats = (struct wlr_vk_renderer_stage_stats){
+		.buffers_created = vk_renderer->stage.buffers_created,
+		.buffers_destroyed = vk_renderer->stage.buffers_destroyed,
+		.host_image_copies = vk_renderer->stage.host_image_copies,
+	};
+
+	struct wlr_vk_shared_buffer *buf;
+	wl_list_for_each(buf, &vk_renderer->stage.buffers, link) {
+		stats->buffers++;
+		stats->capacity += buf->buf_size;
+		stats->used += shared_buffer_get_used(buf);
+		stats->peak += buf->peak;
+	}
+}
@@ -35,6 +35,117 @@ static VkImageAspectFlagBits mem_plane_aspect(unsigned i) {
 	}
 }
 
+#ifdef VK_EXT_host_image_copy
+// Whether the GPU is done with the texture, so that the CPU can write to it
+static bool texture_is_idle(struct wlr_vk_texture *texture) {
+	struct wlr_vk_command_buffer *cb = texture->last_used_cb;
+	if (cb == NULL) {
+		return true;
+	} else if (cb->recording) {
+		return false;
+	}
+
+	struct wlr_vk_device *dev = texture->renderer->dev;
+	uint64_t current_point;
+	VkResult res = dev->api.vkGetSemaphoreCounterValueKHR(dev->dev,
+		texture->renderer->timeline_semaphore, &current_point);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkGetSemaphoreCounterValueKHR", res);
+		return false;
+	}
+
+	return cb->timeline_point <= current_point;
+}
+
+// Copies the pixels directly from the CPU, without any staging buffer or
+// command buffer. The texture must not be in use by the GPU.
+static bool write_pixels_host(struct wlr_vk_texture *texture,
+		uint32_t stride, const pixman_region32_t *region, const void *vdata,
+		VkImageLayout old_layout) {
+	struct wlr_vk_renderer *renderer = texture->renderer;
+	struct wlr_vk_device *dev = renderer->dev;
+	VkResult res;
+
+	const struct wlr_pixel_format_info *format_info = drm_get_pixel_format_info(texture->format->drm);
+	assert(format_info);
+
+	// Row lengths are specified in texels
+	if (pixel_format_info_pixels_per_block(format_info) != 1 ||
+			stride % format_info->bytes_per_block != 0) {
+		return false;
+	}
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+
+	VkMemoryToImageCopyEXT *copies = calloc((size_t)rects_len, sizeof(*copies));
+	if (rects_len > 0 && copies == NULL) {
+		wlr_log(WLR_ERROR, "Failed to allocate image copy parameters");
+		return false;
+	}
+
+	for (int i = 0; i < rects_len; i++) {
+		pixman_box32_t rect = rects[i];
+		const char *pdata = vdata;
+		pdata += stride * rect.y1;
+		pdata += format_info->bytes_per_block * rect.x1;
+
+		copies[i] = (VkMemoryToImageCopyEXT){
+			.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+			.pHostPointer = pdata,
+			.memoryRowLength = stride / format_info->bytes_per_block,
+			.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.imageSubresource.layerCount = 1,
+			.imageOffset.x = rect.x1,
+			.imageOffset.y = rect.y1,
+			.imageExtent.width = rect.x2 - rect.x1,
+			.imageExtent.height = rect.y2 - rect.y1,
+			.imageExtent.depth = 1,
+		};
+	}
+
+	if (old_layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		VkHostImageLayoutTransitionInfoEXT transition = {
+			.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+			.image = texture->image,
+			.oldLayout = old_layout,
+			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.levelCount = 1,
+				.layerCount = 1,
+			},
+		};
+		res = dev->api.vkTransitionImageLayoutEXT(dev->dev, 1, &transition);
+		if (res != VK_SUCCESS) {
+			wlr_vk_error("vkTransitionImageLayoutEXT", res);
+			free(copies);
+			return false;
+		}
+	}
+
+	if (rects_len > 0) {
+		VkCopyMemoryToImageInfoEXT copy_info = {
+			.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+			.dstImage = texture->image,
+			.dstImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.regionCount = (uint32_t)rects_len,
+			.pRegions = copies,
+		};
+		res = dev->api.vkCopyMemoryToImageEXT(dev->dev, &copy_info);
+		if (res != VK_SUCCESS) {
+			wlr_vk_error("vkCopyMemoryToImageEXT", res);
+			free(copies);
+			return false;
+		}
+	}
+
+	free(copies);
+	renderer->stage.host_image_copies++;
+	return true;
+}
+#endif
+
 // Will transition the texture to shaderReadOnlyOptimal layout for reading
 // from fragment shader later on
 static bool write_pixels(struct wlr_vk_texture *texture,
@@ -43,6 +154,13 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		VkAccessFlags src_access) {
 	struct wlr_vk_renderer *renderer = texture->renderer;
 
+#ifdef VK_EXT_host_image_copy
+	if (texture->host_image_copy && texture_is_idle(texture) &&
+			write_pixels_host(texture, stride, region, vdata, old_layout)) {
+		return true;
+	}
+#endif
+
 	const struct wlr_pixel_format_info *format_info = drm_get_pixel_format_info(texture->format->drm);
 	assert(format_info);
 
@@ -224,7 +342,9 @@ static void vulkan_texture_unref(struct wlr_texture *wlr_texture) {
 		// still listening to the buffer's destroy event.
 		wlr_buffer_unlock(texture->buffer);
 	} else {
+		struct wlr_vk_renderer *renderer = texture->renderer;
 		vulkan_texture_destroy(texture);
+		vulkan_trim_stage(renderer);
 	}
 }
 
@@ -241,6 +361,32 @@ static bool vulkan_texture_read_pixels(struct wlr_texture *wlr_texture,
 		options->format, options->stride, src.width, src.height, src.x, src.y, 0, 0, p);
 }
 
+static struct wlr_texture_read_pixels_async *vulkan_texture_read_pixels_async(
+		struct wlr_texture *wlr_texture,
+		const struct wlr_texture_read_pixels_async_options *options) {
+	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
+
+	struct wlr_box src = options->src_box;
+	if (wlr_box_empty(&src)) {
+		src = (struct wlr_box){
+			.width = wlr_texture->width,
+			.height = wlr_texture->height,
+		};
+	}
+
+	struct wlr_vk_read_pixels_async *read = vulkan_read_pixels_async(
+		texture->renderer, texture->format->vk, texture->image,
+		options->format, src.width, src.height, src.x, src.y);
+	if (read == NULL) {
+		return NULL;
+	}
+
+	// Defer the texture destruction until the copy has completed
+	texture->last_used_cb = read->cb;
+
+	return &read->base;
+}
+
 static uint32_t vulkan_texture_preferred_read_format(struct wlr_texture *wlr_texture) {
 	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
 	return texture->format->drm;
@@ -251,6 +397,7 @@ static const struct wlr_texture_impl texture_impl = {
 	.read_pixels = vulkan_texture_read_pixels,
 	.preferred_read_format = vulkan_texture_preferred_read_format,
 	.destroy = vulkan_texture_unref,
+	.read_pixels_async = vulkan_texture_read_pixels_async,
 };
 
 static struct wlr_vk_texture *vulkan_texture_create(
@@ -425,6 +572,12 @@ static struct wlr_texture *vulkan_texture_from_pixels(
 	if (fmt->shm.has_mutable_srgb) {
 		img_info.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
 	}
+#ifdef VK_EXT_host_image_copy
+	if (fmt->shm.host_image_copy) {
+		img_info.usage |= VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+		texture->host_image_copy = true;
+	}
+#endif
 
 	res = vkCreateImage(dev, &img_info, NULL, &texture->image);
 	if (res != VK_SUCCESS) {
@@ -772,7 +925,9 @@ static void texture_handle_buffer_destroy(struct wlr_addon *addon) {
 		wl_container_of(addon, texture, buffer_addon);
 	// We might keep the texture around, waiting for pending command buffers to
 	// complete before free'ing descriptor sets.
+	struct wlr_vk_renderer *renderer = texture->renderer;
 	vulkan_texture_destroy(texture);
+	vulkan_trim_stage(renderer);
 }
 
 static const struct wlr_addon_interface buffer_addon_impl = {
@@ -16,6 +16,7 @@
 #include <wlr/config.h>
 #include "render/dmabuf.h"
 #include "render/vulkan.h"
+#include "util/env.h"
 
 #if defined(__linux__)
 #include <sys/sysmacros.h>
@@ -416,6 +417,47 @@ int vulkan_open_phdev_drm_fd(VkPhysicalDevice phdev) {
 	return drm_fd;
 }
 
+#ifdef VK_EXT_host_image_copy
+// Checks whether the CPU can write into images in the layout used for sampling,
+// so that uploads don't need any layout transition
+static bool check_host_image_copy_layouts(VkPhysicalDevice phdev) {
+	VkPhysicalDeviceHostImageCopyPropertiesEXT host_copy_props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT,
+	};
+	VkPhysicalDeviceProperties2 props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &host_copy_props,
+	};
+	vkGetPhysicalDeviceProperties2(phdev, &props);
+
+	if (host_copy_props.copyDstLayoutCount == 0) {
+		return false;
+	}
+
+	VkImageLayout *layouts = calloc(host_copy_props.copyDstLayoutCount,
+		sizeof(*layouts));
+	if (layouts == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	host_copy_props.copySrcLayoutCount = 0;
+	host_copy_props.pCopySrcLayouts = NULL;
+	host_copy_props.pCopyDstLayouts = layouts;
+	vkGetPhysicalDeviceProperties2(phdev, &props);
+
+	bool found = false;
+	for (uint32_t i = 0; i < host_copy_props.copyDstLayoutCount; i++) {
+		if (layouts[i] == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+			found = true;
+			break;
+		}
+	}
+
+	free(layouts);
+	return found;
+}
+#endif
+
 static void load_device_proc(struct wlr_vk_device *dev, const char *name,
 		void *proc_ptr) {
 	void *proc = (void *)vkGetDeviceProcAddr(dev->dev, name);
@@ -550,12 +592,42 @@ struct wlr_vk_device *vulkan_device_create(struct wlr_vk_instance *ini,
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
 		.pNext = &phdev_sampler_ycbcr_features,
 	};
+
+	bool has_host_image_copy = false;
+#ifdef VK_EXT_host_image_copy
+	// The extension depends on copy_commands2 and format_feature_flags2
+	has_host_image_copy =
+		check_extension(avail_ext_props, avail_extc, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) &&
+		check_extension(avail_ext_props, avail_extc, VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME) &&
+		check_extension(avail_ext_props, avail_extc, VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME) &&
+		!env_parse_bool("WLR_VK_DISABLE_HOST_IMAGE_COPY");
+	VkPhysicalDeviceHostImageCopyFeaturesEXT phdev_host_image_copy_features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+	};
+	if (has_host_image_copy) {
+		phdev_sampler_ycbcr_features.pNext = &phdev_host_image_copy_features;
+	}
+#endif
+
 	vkGetPhysicalDeviceFeatures2(phdev, &phdev_features);
 
 	dev->sampler_ycbcr_conversion = phdev_sampler_ycbcr_features.samplerYcbcrConversion;
 	wlr_log(WLR_DEBUG, "Sampler YCbCr conversion %s",
 		dev->sampler_ycbcr_conversion ? "supported" : "not supported");
 
+#ifdef VK_EXT_host_image_copy
+	dev->host_image_copy = has_host_image_copy &&
+		phdev_host_image_copy_features.hostImageCopy &&
+		check_host_image_copy_layouts(phdev);
+	if (dev->host_image_copy) {
+		extensions[extensions_len++] = VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME;
+		extensions[extensions_len++] = VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME;
+		extensions[extensions_len++] = VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME;
+	}
+#endif
+	wlr_log(WLR_DEBUG, "Host image copy %s",
+		dev->host_image_copy ? "supported" : "not supported");
+
 	const float prio = 1.f;
 	VkDeviceQueueCreateInfo qinfo = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -603,6 +675,16 @@ struct wlr_vk_device *vulkan_device_create(struct wlr_vk_instance *ini,
 		.enabledExtensionCount = extensions_len,
 		.ppEnabledExtensionNames = extensions,
 	};
+#ifdef VK_EXT_host_image_copy
+	VkPhysicalDeviceHostImageCopyFeaturesEXT host_image_copy_features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+		.pNext = &timeline_features,
+		.hostImageCopy = VK_TRUE,
+	};
+	if (dev->host_image_copy) {
+		dev_info.pNext = &host_image_copy_features;
+	}
+#endif
 
 	assert(extensions_len <= sizeof(extensions) / sizeof(extensions[0]));
 
@@ -630,6 +712,14 @@ struct wlr_vk_device *vulkan_device_create(struct wlr_vk_instance *ini,
 	load_device_proc(dev, "vkGetSemaphoreCounterValueKHR",
 		&dev->api.vkGetSemaphoreCounterValueKHR);
 	load_device_proc(dev, "vkQueueSubmit2KHR", &dev->api.vkQueueSubmit2KHR);
+#ifdef VK_EXT_host_image_copy
+	if (dev->host_image_copy) {
+		load_device_proc(dev, "vkCopyMemoryToImageEXT",
+			&dev->api.vkCopyMemoryToImageEXT);
+		load_device_proc(dev, "vkTransitionImageLayoutEXT",
+			&dev->api.vkTransitionImageLayoutEXT);
+	}
+#endif
 
 	if (has_external_semaphore_fd) {
 		load_device_proc(dev, "vkGetSemaphoreFdKHR", &dev->api.vkGetSemaphoreFdKHR);
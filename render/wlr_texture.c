@@ -3,8 +3,10 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_texture.h>
+#include <wlr/util/log.h>
 #include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
 
@@ -62,6 +64,74 @@ bool wlr_texture_read_pixels(struct wlr_texture *texture,
 	return texture->impl->read_pixels(texture, options);
 }
 
+void wlr_texture_read_pixels_async_init(struct wlr_texture_read_pixels_async *read,
+		const struct wlr_texture_read_pixels_async_impl *impl, int sync_file_fd) {
+	assert(impl->finish && impl->destroy);
+	*read = (struct wlr_texture_read_pixels_async){
+		.impl = impl,
+		.sync_file_fd = sync_file_fd,
+	};
+}
+
+static int handle_read_pixels_async_ready(int fd, uint32_t mask, void *data) {
+	struct wlr_texture_read_pixels_async *read = data;
+
+	wl_event_source_remove(read->event_source);
+	read->event_source = NULL;
+	read->ready = true;
+
+	read->callback(read, read->data);
+	return 0;
+}
+
+struct wlr_texture_read_pixels_async *wlr_texture_read_pixels_async_begin(
+		struct wlr_texture *texture,
+		const struct wlr_texture_read_pixels_async_options *options,
+		struct wl_event_loop *loop, wlr_texture_read_pixels_async_ready_callback callback,
+		void *data) {
+	assert(callback);
+
+	if (!texture->impl->read_pixels_async) {
+		return NULL;
+	}
+
+	struct wlr_texture_read_pixels_async *read =
+		texture->impl->read_pixels_async(texture, options);
+	if (read == NULL) {
+		return NULL;
+	}
+
+	// sync_files become readable once signalled
+	read->event_source = wl_event_loop_add_fd(loop, read->sync_file_fd,
+		WL_EVENT_READABLE, handle_read_pixels_async_ready, read);
+	if (read->event_source == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add FD to event loop");
+		wlr_texture_read_pixels_async_destroy(read);
+		return NULL;
+	}
+
+	read->callback = callback;
+	read->data = data;
+	return read;
+}
+
+bool wlr_texture_read_pixels_async_finish(struct wlr_texture_read_pixels_async *read,
+		void *data, uint32_t stride) {
+	assert(read->ready);
+	return read->impl->finish(read, data, stride);
+}
+
+void wlr_texture_read_pixels_async_destroy(struct wlr_texture_read_pixels_async *read) {
+	if (read == NULL) {
+		return;
+	}
+	if (read->event_source != NULL) {
+		wl_event_source_remove(read->event_source);
+	}
+	close(read->sync_file_fd);
+	read->impl->destroy(read);
+}
+
 uint32_t wlr_texture_preferred_read_format(struct wlr_texture *texture) {
 	if (!texture->impl->preferred_read_format) {
 		return DRM_FORMAT_INVALID;
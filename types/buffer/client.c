@@ -143,5 +143,15 @@ bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		return false;
 	}
 
-	return wlr_texture_update_from_buffer(client_buffer->texture, next, damage);
+	if (!wlr_texture_update_from_buffer(client_buffer->texture, next, damage)) {
+		return false;
+	}
+
+	if (client_buffer->source != next) {
+		wl_list_remove(&client_buffer->source_destroy.link);
+		wl_signal_add(&next->events.destroy, &client_buffer->source_destroy);
+		client_buffer->source = next;
+	}
+
+	return true;
 }
@@ -13,6 +13,24 @@
 #include "types/wlr_buffer.h"
 #include "types/wlr_output.h"
 
+// Enough to hold all frames of common animated cursors
+#define CURSOR_BUFFER_CACHE_SIZE 64
+
+/**
+ * A hardware cursor buffer rendered from a texture which never changes.
+ * Re-using it turns an animation step into a plain cursor plane buffer swap.
+ */
+struct output_cursor_buffer {
+	struct wl_list link; // wlr_output_cursor.buffer_cache
+
+	struct wlr_texture *texture;
+	struct wlr_fbox src_box;
+	int width, height;
+	enum wl_output_transform transform, output_transform;
+
+	struct wlr_buffer *buffer;
+};
+
 static bool output_set_hardware_cursor(struct wlr_output *output,
 		struct wlr_buffer *buffer, int hotspot_x, int hotspot_y) {
 	if (!output->impl->set_cursor) {
@@ -181,6 +199,80 @@ static bool output_pick_cursor_format(struct wlr_output *output,
 	return output_pick_format(output, display_formats, format, DRM_FORMAT_ARGB8888);
 }
 
+static void cursor_buffer_destroy(struct output_cursor_buffer *entry) {
+	wl_list_remove(&entry->link);
+	wlr_buffer_drop(entry->buffer);
+	free(entry);
+}
+
+static void output_cursor_clear_buffer_cache(struct wlr_output_cursor *cursor) {
+	struct output_cursor_buffer *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cursor->buffer_cache, link) {
+		cursor_buffer_destroy(entry);
+	}
+}
+
+void output_cursor_forget_texture(struct wlr_output_cursor *cursor,
+		struct wlr_texture *texture) {
+	struct output_cursor_buffer *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cursor->buffer_cache, link) {
+		if (entry->texture == texture) {
+			cursor_buffer_destroy(entry);
+		}
+	}
+}
+
+void output_destroy_cursor_swapchain(struct wlr_output *output) {
+	// Cached buffers have been allocated with the swapchain parameters
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &output->cursors, link) {
+		output_cursor_clear_buffer_cache(cursor);
+	}
+
+	wlr_swapchain_destroy(output->cursor_swapchain);
+	output->cursor_swapchain = NULL;
+}
+
+static struct output_cursor_buffer *output_cursor_find_buffer(
+		struct wlr_output_cursor *cursor) {
+	struct output_cursor_buffer *entry;
+	wl_list_for_each(entry, &cursor->buffer_cache, link) {
+		if (entry->texture == cursor->texture &&
+				wlr_fbox_equal(&entry->src_box, &cursor->src_box) &&
+				entry->width == (int)cursor->width &&
+				entry->height == (int)cursor->height &&
+				entry->transform == cursor->transform &&
+				entry->output_transform == cursor->output->transform) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static void output_cursor_add_buffer(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *buffer) {
+	struct output_cursor_buffer *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_buffer_drop(buffer);
+		return;
+	}
+
+	entry->texture = cursor->texture;
+	entry->src_box = cursor->src_box;
+	entry->width = cursor->width;
+	entry->height = cursor->height;
+	entry->transform = cursor->transform;
+	entry->output_transform = cursor->output->transform;
+	entry->buffer = buffer;
+	wl_list_insert(&cursor->buffer_cache, &entry->link);
+
+	if (wl_list_length(&cursor->buffer_cache) > CURSOR_BUFFER_CACHE_SIZE) {
+		struct output_cursor_buffer *last =
+			wl_container_of(cursor->buffer_cache.prev, last, link);
+		cursor_buffer_destroy(last);
+	}
+}
+
 static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor) {
 	struct wlr_output *output = cursor->output;
 
@@ -233,7 +325,7 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 			return NULL;
 		}
 
-		wlr_swapchain_destroy(output->cursor_swapchain);
+		output_destroy_cursor_swapchain(output);
 		output->cursor_swapchain = wlr_swapchain_create(allocator,
 			width, height, &format);
 		wlr_drm_format_finish(&format);
@@ -243,9 +335,29 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 		}
 	}
 
-	struct wlr_buffer *buffer = wlr_swapchain_acquire(output->cursor_swapchain);
-	if (buffer == NULL) {
-		return NULL;
+	bool cache = cursor->cache_texture && cursor->wait_timeline == NULL;
+	struct wlr_buffer *buffer;
+	if (cache) {
+		struct output_cursor_buffer *entry = output_cursor_find_buffer(cursor);
+		if (entry != NULL) {
+			// Keep the list ordered from most to least recently used
+			wl_list_remove(&entry->link);
+			wl_list_insert(&cursor->buffer_cache, &entry->link);
+			return wlr_buffer_lock(entry->buffer);
+		}
+
+		// Cached buffers are kept around, so they can't be swapchain slots
+		buffer = wlr_allocator_create_buffer(allocator, width, height,
+			&output->cursor_swapchain->format);
+		if (buffer == NULL) {
+			return NULL;
+		}
+		wlr_buffer_lock(buffer);
+	} else {
+		buffer = wlr_swapchain_acquire(output->cursor_swapchain);
+		if (buffer == NULL) {
+			return NULL;
+		}
 	}
 
 	struct wlr_box dst_box = {
@@ -257,8 +369,7 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 
 	struct wlr_render_pass *pass = wlr_renderer_begin_buffer_pass(renderer, buffer, NULL);
 	if (pass == NULL) {
-		wlr_buffer_unlock(buffer);
-		return NULL;
+		goto error;
 	}
 
 	enum wl_output_transform transform = wlr_output_transform_invert(cursor->transform);
@@ -278,11 +389,21 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 	});
 
 	if (!wlr_render_pass_submit(pass)) {
-		wlr_buffer_unlock(buffer);
-		return NULL;
+		goto error;
+	}
+
+	if (cache) {
+		output_cursor_add_buffer(cursor, buffer);
 	}
 
 	return buffer;
+
+error:
+	wlr_buffer_unlock(buffer);
+	if (cache) {
+		wlr_buffer_drop(buffer);
+	}
+	return NULL;
 }
 
 static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
@@ -349,7 +470,7 @@ bool wlr_output_cursor_set_buffer(struct wlr_output_cursor *cursor,
 	hotspot_x /= cursor->output->scale;
 	hotspot_y /= cursor->output->scale;
 
-	return output_cursor_set_texture(cursor, texture, true, &src_box,
+	return output_cursor_set_texture(cursor, texture, true, false, &src_box,
 		dst_width, dst_height, WL_OUTPUT_TRANSFORM_NORMAL, hotspot_x, hotspot_y,
 		NULL, 0);
 }
@@ -357,14 +478,15 @@ bool wlr_output_cursor_set_buffer(struct wlr_output_cursor *cursor,
 static void output_cursor_handle_renderer_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_output_cursor *cursor = wl_container_of(listener, cursor, renderer_destroy);
-	output_cursor_set_texture(cursor, NULL, false, NULL, 0, 0,
+	output_cursor_set_texture(cursor, NULL, false, false, NULL, 0, 0,
 		WL_OUTPUT_TRANSFORM_NORMAL, 0, 0, NULL, 0);
+	output_cursor_clear_buffer_cache(cursor);
 }
 
 bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
-		struct wlr_texture *texture, bool own_texture, const struct wlr_fbox *src_box,
-		int dst_width, int dst_height, enum wl_output_transform transform,
-		int32_t hotspot_x, int32_t hotspot_y,
+		struct wlr_texture *texture, bool own_texture, bool cache_texture,
+		const struct wlr_fbox *src_box, int dst_width, int dst_height,
+		enum wl_output_transform transform, int32_t hotspot_x, int32_t hotspot_y,
 		struct wlr_drm_syncobj_timeline *wait_timeline, uint64_t wait_point) {
 	if (texture == NULL && !cursor->enabled) {
 		// Cursor is still disabled, do nothing
@@ -398,6 +520,7 @@ bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
 	}
 	cursor->texture = texture;
 	cursor->own_texture = own_texture;
+	cursor->cache_texture = cache_texture;
 
 	wlr_drm_syncobj_timeline_unref(cursor->wait_timeline);
 	if (wait_timeline != NULL) {
@@ -470,6 +593,7 @@ struct wlr_output_cursor *wlr_output_cursor_create(struct wlr_output *output) {
 	wl_list_insert(&output->cursors, &cursor->link);
 	cursor->visible = true; // default position is at (0, 0)
 	wl_list_init(&cursor->renderer_destroy.link);
+	wl_list_init(&cursor->buffer_cache);
 	return cursor;
 }
 
@@ -484,6 +608,7 @@ void wlr_output_cursor_destroy(struct wlr_output_cursor *cursor) {
 		output_cursor_damage_whole(cursor);
 	}
 	wl_list_remove(&cursor->renderer_destroy.link);
+	output_cursor_clear_buffer_cache(cursor);
 	if (cursor->own_texture) {
 		wlr_texture_destroy(cursor->texture);
 	}
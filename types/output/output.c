@@ -250,8 +250,7 @@ static void output_apply_state(struct wlr_output *output,
 	if ((state->committed & WLR_OUTPUT_STATE_ENABLED) && !state->enabled) {
 		wlr_swapchain_destroy(output->swapchain);
 		output->swapchain = NULL;
-		wlr_swapchain_destroy(output->cursor_swapchain);
-		output->cursor_swapchain = NULL;
+		output_destroy_cursor_swapchain(output);
 	}
 
 	if (state->committed & WLR_OUTPUT_STATE_LAYERS) {
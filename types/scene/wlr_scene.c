@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <drm_fourcc.h>
 #include <wlr/backend.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/drm_syncobj.h>
@@ -10,6 +11,7 @@
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_output_layer.h>
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
@@ -20,6 +22,7 @@
 #include "types/wlr_scene.h"
 #include "util/array.h"
 #include "util/env.h"
+#include "util/region.h"
 #include "util/time.h"
 
 #include <wlr/config.h>
@@ -30,6 +33,12 @@
 
 #define DMABUF_FEEDBACK_DEBOUNCE_FRAMES  30
 #define HIGHLIGHT_DAMAGE_FADEOUT_TIME   250
+#define SCENE_OUTPUT_MAX_LAYERS          4
+// Maximum number of clip rectangles of each draw when splitting an entry into
+// an opaque and a translucent part
+#define SPLIT_BLENDING_MAX_RECTS         16
+// Minimum number of opaque pixels for the split to be worth an extra draw
+#define SPLIT_BLENDING_MIN_AREA     (64 * 64)
 
 struct wlr_scene_tree *wlr_scene_tree_from_node(struct wlr_scene_node *node) {
 	assert(node->type == WLR_SCENE_NODE_TREE);
@@ -96,6 +105,22 @@ static void scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
 static void scene_buffer_set_texture(struct wlr_scene_buffer *scene_buffer,
 	struct wlr_texture *texture);
 
+// Links a scene buffer to one of its active outputs
+struct scene_output_buffer {
+	struct wlr_scene_buffer *buffer;
+	struct wlr_scene_output *output;
+	struct wl_list buffer_link; // wlr_scene_buffer.output_entries
+	struct wl_list output_link; // wlr_scene_output.active_buffers
+	// wlr_scene_output.frame_done_seq when frame done was last sent
+	uint64_t frame_done_seq;
+};
+
+static void scene_output_buffer_destroy(struct scene_output_buffer *entry) {
+	wl_list_remove(&entry->buffer_link);
+	wl_list_remove(&entry->output_link);
+	free(entry);
+}
+
 void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 	if (node == NULL) {
 		return;
@@ -124,6 +149,11 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 			}
 		}
 
+		struct scene_output_buffer *entry, *tmp_entry;
+		wl_list_for_each_safe(entry, tmp_entry, &scene_buffer->output_entries, buffer_link) {
+			scene_output_buffer_destroy(entry);
+		}
+
 		scene_buffer_set_buffer(scene_buffer, NULL);
 		scene_buffer_set_texture(scene_buffer, NULL);
 		pixman_region32_fini(&scene_buffer->opaque_region);
@@ -192,8 +222,10 @@ struct wlr_scene *wlr_scene_create(void) {
 		NULL
 	};
 
+	scene->generation = 1;
 	scene->debug_damage_option = env_parse_switch("WLR_SCENE_DEBUG_DAMAGE", debug_damage_options);
 	scene->direct_scanout = !env_parse_bool("WLR_SCENE_DISABLE_DIRECT_SCANOUT");
+	scene->output_layers = env_parse_bool("WLR_SCENE_OUTPUT_LAYERS");
 	scene->calculate_visibility = !env_parse_bool("WLR_SCENE_DISABLE_VISIBILITY");
 	scene->highlight_transparent_region = env_parse_bool("WLR_SCENE_HIGHLIGHT_TRANSPARENT_REGION");
 
@@ -212,6 +244,96 @@ struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_tree *parent) {
 	return tree;
 }
 
+static void box_union(struct wlr_box *dest, const struct wlr_box *box_a,
+		const struct wlr_box *box_b) {
+	if (wlr_box_empty(box_a)) {
+		*dest = wlr_box_empty(box_b) ? (struct wlr_box){0} : *box_b;
+		return;
+	} else if (wlr_box_empty(box_b)) {
+		*dest = *box_a;
+		return;
+	}
+
+	int x1 = box_a->x < box_b->x ? box_a->x : box_b->x;
+	int y1 = box_a->y < box_b->y ? box_a->y : box_b->y;
+	int x2 = box_a->x + box_a->width > box_b->x + box_b->width ?
+		box_a->x + box_a->width : box_b->x + box_b->width;
+	int y2 = box_a->y + box_a->height > box_b->y + box_b->height ?
+		box_a->y + box_a->height : box_b->y + box_b->height;
+
+	*dest = (struct wlr_box){
+		.x = x1,
+		.y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
+}
+
+/**
+ * Mark the cached bounds of all ancestors of this node as stale. This needs
+ * to be called whenever the node's position, size or enabled state changes,
+ * or when it's added to or removed from a tree.
+ *
+ * If a tree is dirty, its ancestors are dirty too, so we can stop walking up
+ * as soon as we find a dirty tree.
+ */
+static void scene_node_invalidate_bounds(struct wlr_scene_node *node) {
+	struct wlr_scene_tree *tree = node->parent;
+	while (tree != NULL && !tree->bounds_dirty) {
+		tree->bounds_dirty = true;
+		tree = tree->node.parent;
+	}
+}
+
+/**
+ * Mark the cached visible region of all ancestors of this node as stale. This
+ * needs to be called whenever the node's visible region changes, in addition
+ * to the cases listed in scene_node_invalidate_bounds().
+ */
+static void scene_node_invalidate_visibility(struct wlr_scene_node *node) {
+	struct wlr_scene_tree *tree = node->parent;
+	while (tree != NULL && !tree->visible_dirty) {
+		tree->visible_dirty = true;
+		tree = tree->node.parent;
+	}
+}
+
+/**
+ * Get the bounding box of the node and all of its enabled descendants,
+ * relative to the node. The node's own enabled state is not taken into
+ * account.
+ */
+static void scene_node_get_bounds(struct wlr_scene_node *node,
+		struct wlr_box *bounds) {
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		*bounds = (struct wlr_box){0};
+		scene_node_get_size(node, &bounds->width, &bounds->height);
+		return;
+	}
+
+	struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
+	if (scene_tree->bounds_dirty) {
+		struct wlr_box tree_bounds = {0};
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			if (!child->enabled) {
+				continue;
+			}
+
+			struct wlr_box child_bounds;
+			scene_node_get_bounds(child, &child_bounds);
+			child_bounds.x += child->x;
+			child_bounds.y += child->y;
+			box_union(&tree_bounds, &tree_bounds, &child_bounds);
+		}
+
+		scene_tree->bounds = tree_bounds;
+		scene_tree->bounds_dirty = false;
+	}
+
+	*bounds = scene_tree->bounds;
+}
+
 typedef bool (*scene_node_box_iterator_func_t)(struct wlr_scene_node *node,
 	int sx, int sy, void *data);
 
@@ -223,6 +345,15 @@ static bool _scene_nodes_in_box(struct wlr_scene_node *node, struct wlr_box *box
 
 	switch (node->type) {
 	case WLR_SCENE_NODE_TREE:;
+		// Skip the whole sub-tree if none of its descendants intersect
+		struct wlr_box tree_box;
+		scene_node_get_bounds(node, &tree_box);
+		tree_box.x += lx;
+		tree_box.y += ly;
+		if (!wlr_box_intersection(&tree_box, &tree_box, box)) {
+			break;
+		}
+
 		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
 		struct wlr_scene_node *child;
 		wl_list_for_each_reverse(child, &scene_tree->children, link) {
@@ -311,14 +442,6 @@ static uint32_t region_area(pixman_region32_t *region) {
 	return area;
 }
 
-static void scale_region(pixman_region32_t *region, float scale, bool round_up) {
-	wlr_region_scale(region, region, scale);
-
-	if (round_up && floor(scale) != scale) {
-		wlr_region_expand(region, region, 1);
-	}
-}
-
 struct render_data {
 	enum wl_output_transform transform;
 	float scale;
@@ -326,24 +449,68 @@ struct render_data {
 	int trans_width, trans_height;
 
 	struct wlr_scene_output *output;
+	struct wlr_scene_timer *timer;
 
 	struct wlr_render_pass *render_pass;
 	pixman_region32_t damage;
 };
 
-static void logical_to_buffer_coords(pixman_region32_t *region, const struct render_data *data,
-		bool round_up) {
-	enum wl_output_transform transform = wlr_output_transform_invert(data->transform);
-	scale_region(region, data->scale, round_up);
-	wlr_region_transform(region, region, transform, data->trans_width, data->trans_height);
+/**
+ * Map a region from layout coordinates to output buffer coordinates, clipped
+ * to the output. If round_up is set, the result is expanded to cover
+ * fractionally scaled pixels.
+ */
+static void logical_to_buffer_coords(pixman_region32_t *dst, const pixman_region32_t *src,
+		const struct render_data *data, bool round_up) {
+	struct wlr_output *output = data->output->output;
+	pixman_box32_t clip = {
+		.x2 = output->width,
+		.y2 = output->height,
+	};
+	struct region_map_options options = {
+		.dx = -data->logical.x,
+		.dy = -data->logical.y,
+		.scale_x = data->scale,
+		.scale_y = data->scale,
+		.expand = round_up && floor(data->scale) != data->scale ? 1 : 0,
+		.transform = wlr_output_transform_invert(data->transform),
+		.width = data->trans_width,
+		.height = data->trans_height,
+		.clip = &clip,
+	};
+	if (!region_map(dst, src, &options, &data->output->region_scratch) && !round_up) {
+		// The mapped extents may cover more than the region
+		pixman_region32_clear(dst);
+	}
 }
 
-static void output_to_buffer_coords(pixman_region32_t *damage, struct wlr_output *output) {
+/**
+ * Map damage from output-local logical coordinates, translated by (dx, dy)
+ * and scaled by scale_x and scale_y, to output buffer coordinates.
+ */
+static void output_damage_to_buffer_coords(struct wlr_scene_output *scene_output,
+		pixman_region32_t *dst, const pixman_region32_t *src, int dx, int dy,
+		float scale_x, float scale_y, int expand) {
+	struct wlr_output *output = scene_output->output;
+
 	int width, height;
 	wlr_output_transformed_resolution(output, &width, &height);
 
-	wlr_region_transform(damage, damage,
-		wlr_output_transform_invert(output->transform), width, height);
+	pixman_box32_t clip = {
+		.x2 = output->width,
+		.y2 = output->height,
+	};
+	region_map(dst, src, &(struct region_map_options){
+		.dx = dx,
+		.dy = dy,
+		.scale_x = scale_x,
+		.scale_y = scale_y,
+		.expand = expand,
+		.transform = wlr_output_transform_invert(output->transform),
+		.width = width,
+		.height = height,
+		.clip = &clip,
+	}, &scene_output->region_scratch);
 }
 
 static int scale_length(int length, int offset, float scale) {
@@ -363,23 +530,29 @@ static void transform_output_box(struct wlr_box *box, const struct render_data *
 	wlr_box_transform(box, box, transform, data->trans_width, data->trans_height);
 }
 
+/**
+ * Add damage in output buffer coordinates. The damage must already be clipped
+ * to the output, which the coordinate mapping helpers take care of.
+ */
 static void scene_output_damage(struct wlr_scene_output *scene_output,
 		const pixman_region32_t *damage) {
-	struct wlr_output *output = scene_output->output;
-
-	pixman_region32_t clipped;
-	pixman_region32_init(&clipped);
-	pixman_region32_intersect_rect(&clipped, damage, 0, 0, output->width, output->height);
+	if (pixman_region32_empty(damage)) {
+		return;
+	}
 
-	if (!pixman_region32_empty(&clipped)) {
-		wlr_output_schedule_frame(scene_output->output);
-		wlr_damage_ring_add(&scene_output->damage_ring, &clipped);
+	wlr_output_schedule_frame(scene_output->output);
+	wlr_damage_ring_add(&scene_output->damage_ring, damage);
 
-		pixman_region32_union(&scene_output->pending_commit_damage,
-			&scene_output->pending_commit_damage, &clipped);
-	}
+	pixman_region32_union(&scene_output->pending_commit_damage,
+		&scene_output->pending_commit_damage, damage);
+}
 
-	pixman_region32_fini(&clipped);
+static void scene_output_state_set_damage(struct wlr_scene_output *scene_output,
+		struct wlr_output_state *state) {
+	// Damage is accumulated as-is and only simplified here, when it's consumed
+	region_coalesce(&scene_output->pending_commit_damage,
+		scene_output->damage_ring.max_rects);
+	wlr_output_state_set_damage(state, &scene_output->pending_commit_damage);
 }
 
 static void scene_output_damage_whole(struct wlr_scene_output *scene_output) {
@@ -400,16 +573,48 @@ static void scene_damage_outputs(struct wlr_scene *scene, pixman_region32_t *dam
 	wl_list_for_each(scene_output, &scene->outputs, link) {
 		pixman_region32_t output_damage;
 		pixman_region32_init(&output_damage);
-		pixman_region32_copy(&output_damage, damage);
-		pixman_region32_translate(&output_damage,
-			-scene_output->x, -scene_output->y);
-		scale_region(&output_damage, scene_output->output->scale, true);
-		output_to_buffer_coords(&output_damage, scene_output->output);
+
+		float scale = scene_output->output->scale;
+		output_damage_to_buffer_coords(scene_output, &output_damage, damage,
+			-scene_output->x, -scene_output->y, scale, scale,
+			floor(scale) != scale ? 1 : 0);
 		scene_output_damage(scene_output, &output_damage);
 		pixman_region32_fini(&output_damage);
 	}
 }
 
+static void scene_buffer_update_output_entries(struct wlr_scene_buffer *scene_buffer,
+		struct wl_list *outputs) {
+	uint64_t present = 0;
+	struct scene_output_buffer *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &scene_buffer->output_entries, buffer_link) {
+		uint64_t mask = 1ull << entry->output->index;
+		if (scene_buffer->active_outputs & mask) {
+			present |= mask;
+		} else {
+			scene_output_buffer_destroy(entry);
+		}
+	}
+
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, outputs, link) {
+		uint64_t mask = 1ull << scene_output->index;
+		if (!(scene_buffer->active_outputs & mask) || (present & mask)) {
+			continue;
+		}
+
+		entry = calloc(1, sizeof(*entry));
+		if (entry == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			continue;
+		}
+		entry->buffer = scene_buffer;
+		entry->output = scene_output;
+		wl_list_insert(&scene_buffer->output_entries, &entry->buffer_link);
+		wl_list_insert(scene_output->active_buffers.prev, &entry->output_link);
+	}
+}
+
 static void update_node_update_outputs(struct wlr_scene_node *node,
 		struct wl_list *outputs, struct wlr_scene_output *ignore,
 		struct wlr_scene_output *force) {
@@ -478,6 +683,9 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 
 	uint64_t old_active = scene_buffer->active_outputs;
 	scene_buffer->active_outputs = active_outputs;
+	if (old_active != active_outputs) {
+		scene_buffer_update_output_entries(scene_buffer, outputs);
+	}
 
 	wl_list_for_each(scene_output, outputs, link) {
 		uint64_t mask = 1ull << scene_output->index;
@@ -595,6 +803,7 @@ static bool scene_node_update_iterator(struct wlr_scene_node *node,
 	pixman_region32_union(&node->visible, &node->visible, data->visible);
 	pixman_region32_intersect_rect(&node->visible, &node->visible,
 		lx, ly, box.width, box.height);
+	scene_node_invalidate_visibility(node);
 
 	if (data->calculate_visibility) {
 		pixman_region32_t opaque;
@@ -618,13 +827,18 @@ static void scene_node_visibility(struct wlr_scene_node *node,
 		return;
 	}
 
+	// For trees, node->visible caches the union of the visible regions of
+	// all enabled descendants
 	if (node->type == WLR_SCENE_NODE_TREE) {
 		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
-		struct wlr_scene_node *child;
-		wl_list_for_each(child, &scene_tree->children, link) {
-			scene_node_visibility(child, visible);
+		if (scene_tree->visible_dirty) {
+			pixman_region32_clear(&node->visible);
+			struct wlr_scene_node *child;
+			wl_list_for_each(child, &scene_tree->children, link) {
+				scene_node_visibility(child, &node->visible);
+			}
+			scene_tree->visible_dirty = false;
 		}
-		return;
 	}
 
 	pixman_region32_union(visible, visible, &node->visible);
@@ -636,22 +850,16 @@ static void scene_node_bounds(struct wlr_scene_node *node,
 		return;
 	}
 
-	if (node->type == WLR_SCENE_NODE_TREE) {
-		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
-		struct wlr_scene_node *child;
-		wl_list_for_each(child, &scene_tree->children, link) {
-			scene_node_bounds(child, x + child->x, y + child->y, visible);
-		}
-		return;
-	}
-
-	int width, height;
-	scene_node_get_size(node, &width, &height);
-	pixman_region32_union_rect(visible, visible, x, y, width, height);
+	struct wlr_box bounds;
+	scene_node_get_bounds(node, &bounds);
+	pixman_region32_union_rect(visible, visible,
+		x + bounds.x, y + bounds.y, bounds.width, bounds.height);
 }
 
 static void scene_update_region(struct wlr_scene *scene,
 		pixman_region32_t *update_region) {
+	scene->generation++;
+
 	pixman_region32_t visible;
 	pixman_region32_init(&visible);
 	pixman_region32_copy(&visible, update_region);
@@ -680,6 +888,9 @@ static void scene_node_update(struct wlr_scene_node *node,
 		pixman_region32_t *damage) {
 	struct wlr_scene *scene = scene_node_get_root(node);
 
+	scene_node_invalidate_bounds(node);
+	scene_node_invalidate_visibility(node);
+
 	int x, y;
 	if (!wlr_scene_node_coords(node, &x, &y)) {
 #if WLR_HAS_XWAYLAND
@@ -795,6 +1006,9 @@ static void scene_buffer_handle_renderer_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_scene_buffer *scene_buffer = wl_container_of(listener, scene_buffer, renderer_destroy);
 	scene_buffer_set_texture(scene_buffer, NULL);
+
+	// The node may have become invisible
+	scene_node_get_root(&scene_buffer->node)->generation++;
 }
 
 static void scene_buffer_set_texture(struct wlr_scene_buffer *scene_buffer,
@@ -839,6 +1053,7 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	wl_signal_init(&scene_buffer->events.frame_done);
 
 	pixman_region32_init(&scene_buffer->opaque_region);
+	wl_list_init(&scene_buffer->output_entries);
 	wl_list_init(&scene_buffer->buffer_release.link);
 	wl_list_init(&scene_buffer->renderer_destroy.link);
 	scene_buffer->opacity = 1;
@@ -849,6 +1064,15 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	return scene_buffer;
 }
 
+static bool scene_buffer_is_black_opaque(struct wlr_scene_buffer *scene_buffer) {
+	return scene_buffer->is_single_pixel_buffer &&
+		scene_buffer->single_pixel_buffer_color[0] == 0 &&
+		scene_buffer->single_pixel_buffer_color[1] == 0 &&
+		scene_buffer->single_pixel_buffer_color[2] == 0 &&
+		scene_buffer->single_pixel_buffer_color[3] == UINT32_MAX &&
+		scene_buffer->opacity == 1.0;
+}
+
 void wlr_scene_buffer_set_buffer_with_options(struct wlr_scene_buffer *scene_buffer,
 		struct wlr_buffer *buffer, const struct wlr_scene_buffer_set_buffer_options *options) {
 	const struct wlr_scene_buffer_set_buffer_options default_options = {0};
@@ -878,6 +1102,9 @@ void wlr_scene_buffer_set_buffer_with_options(struct wlr_scene_buffer *scene_buf
 			scene_buffer->buffer_height != buffer->height;
 	}
 
+	bool prev_is_opaque = scene_buffer->buffer_is_opaque;
+	bool prev_is_black_opaque = scene_buffer_is_black_opaque(scene_buffer);
+
 	// If this is a buffer change, check if it's a single pixel buffer.
 	// Cache that so we can still apply rendering optimisations even when
 	// the original buffer has been freed after texture upload.
@@ -905,6 +1132,12 @@ void wlr_scene_buffer_set_buffer_with_options(struct wlr_scene_buffer *scene_buf
 	scene_buffer_set_wait_timeline(scene_buffer,
 		options->wait_timeline, options->wait_point);
 
+	// Opaque and black opaque buffers affect the render list
+	if (prev_is_opaque != scene_buffer->buffer_is_opaque ||
+			prev_is_black_opaque != scene_buffer_is_black_opaque(scene_buffer)) {
+		scene_node_get_root(&scene_buffer->node)->generation++;
+	}
+
 	if (update) {
 		scene_node_update(&scene_buffer->node, NULL);
 		// updating the node will already damage the whole node for us. Return
@@ -958,10 +1191,6 @@ void wlr_scene_buffer_set_buffer_with_options(struct wlr_scene_buffer *scene_buf
 		float output_scale = scene_output->output->scale;
 		float output_scale_x = output_scale * scale_x;
 		float output_scale_y = output_scale * scale_y;
-		pixman_region32_t output_damage;
-		pixman_region32_init(&output_damage);
-		wlr_region_scale_xy(&output_damage, &trans_damage,
-			output_scale_x, output_scale_y);
 
 		// One output pixel will match (buffer_scale_x)x(buffer_scale_y) buffer pixels.
 		// If the buffer is upscaled on the given axis (output_scale_* > 1.0,
@@ -979,21 +1208,28 @@ void wlr_scene_buffer_set_buffer_with_options(struct wlr_scene_buffer *scene_buf
 		int dist_y = floor(buffer_scale_y) != buffer_scale_y ?
 			(int)ceilf(output_scale_y / 2.0f) : 0;
 		// TODO: expand with per-axis distances
-		wlr_region_expand(&output_damage, &output_damage,
-			dist_x >= dist_y ? dist_x : dist_y);
+		pixman_region32_t output_damage;
+		pixman_region32_init(&output_damage);
+		region_map(&output_damage, &trans_damage, &(struct region_map_options){
+			.scale_x = output_scale_x,
+			.scale_y = output_scale_y,
+			.expand = dist_x >= dist_y ? dist_x : dist_y,
+		}, &scene_output->region_scratch);
 
 		pixman_region32_t cull_region;
 		pixman_region32_init(&cull_region);
-		pixman_region32_copy(&cull_region, &scene_buffer->node.visible);
-		scale_region(&cull_region, output_scale, true);
+		region_map(&cull_region, &scene_buffer->node.visible, &(struct region_map_options){
+			.scale_x = output_scale,
+			.scale_y = output_scale,
+			.expand = floor(output_scale) != output_scale ? 1 : 0,
+		}, &scene_output->region_scratch);
 		pixman_region32_translate(&cull_region, -lx * output_scale, -ly * output_scale);
 		pixman_region32_intersect(&output_damage, &output_damage, &cull_region);
 		pixman_region32_fini(&cull_region);
 
-		pixman_region32_translate(&output_damage,
+		output_damage_to_buffer_coords(scene_output, &output_damage, &output_damage,
 			(int)round((lx - scene_output->x) * output_scale),
-			(int)round((ly - scene_output->y) * output_scale));
-		output_to_buffer_coords(&output_damage, scene_output->output);
+			(int)round((ly - scene_output->y) * output_scale), 1, 1, 0);
 		scene_output_damage(scene_output, &output_damage);
 		pixman_region32_fini(&output_damage);
 	}
@@ -1263,6 +1499,9 @@ void wlr_scene_node_reparent(struct wlr_scene_node *node,
 		scene_node_visibility(node, &visible);
 	}
 
+	scene_node_invalidate_bounds(node);
+	scene_node_invalidate_visibility(node);
+
 	wl_list_remove(&node->link);
 	node->parent = new_parent;
 	wl_list_insert(new_parent->children.prev, &node->link);
@@ -1376,17 +1615,93 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 struct render_list_entry {
 	struct wlr_scene_node *node;
 	bool highlight_transparent_region;
+	// Displayed via an output layer instead of being rendered
+	bool layer;
 	int x, y;
 };
 
+static void scene_timer_add_pixels(const struct render_data *data,
+		pixman_region32_t *region, bool blend) {
+	if (data->timer == NULL) {
+		return;
+	}
+	if (blend) {
+		data->timer->blended_pixels += region_area(region);
+	} else {
+		data->timer->copied_pixels += region_area(region);
+	}
+}
+
+/**
+ * Check whether texture pixels map to whole output pixels, i.e. the output
+ * scale is an integer and the texture is drawn at an integer scale from an
+ * integer source box. Otherwise, output pixels at the edge of the opaque
+ * region may be sampled from translucent texture pixels.
+ */
+static bool texture_scale_is_integer(const struct wlr_render_texture_options *options,
+		float output_scale) {
+	if (floor(output_scale) != output_scale) {
+		return false;
+	}
+
+	struct wlr_fbox src = options->src_box;
+	if (wlr_fbox_empty(&src)) {
+		src = (struct wlr_fbox){
+			.width = options->texture->width,
+			.height = options->texture->height,
+		};
+	}
+	if (floor(src.x) != src.x || floor(src.y) != src.y ||
+			floor(src.width) != src.width || floor(src.height) != src.height) {
+		return false;
+	}
+
+	int src_width = src.width, src_height = src.height;
+	int dst_width = options->dst_box.width, dst_height = options->dst_box.height;
+	if (options->transform & WL_OUTPUT_TRANSFORM_90) {
+		int tmp = dst_width;
+		dst_width = dst_height;
+		dst_height = tmp;
+	}
+	if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) {
+		return false;
+	}
+
+	bool width_integer = dst_width % src_width == 0 || src_width % dst_width == 0;
+	bool height_integer = dst_height % src_height == 0 || src_height % dst_height == 0;
+	return width_integer && height_integer;
+}
+
+/**
+ * Split the render region of an entry into a part which can be drawn without
+ * blending and a part which needs blending. Returns false if drawing the
+ * whole entry with blending is likely cheaper than two draws, e.g. because the
+ * opaque part is small or the split would be too fragmented.
+ */
+static bool scene_entry_split_blending(const pixman_region32_t *render_region,
+		const pixman_region32_t *translucent, pixman_region32_t *copy_region,
+		pixman_region32_t *blend_region) {
+	// Filtering may bleed translucent pixels one pixel into the opaque
+	// region, blend its edges as well
+	wlr_region_expand(blend_region, translucent, 1);
+	// Merging translucent rectangles over opaque pixels of the entry is fine,
+	// they're only blended unnecessarily. Coalescing may grow the region past
+	// the render region though, where pixels must not be drawn at all.
+	region_coalesce(blend_region, SPLIT_BLENDING_MAX_RECTS);
+	pixman_region32_intersect(blend_region, blend_region, render_region);
+	pixman_region32_subtract(copy_region, render_region, blend_region);
+
+	return pixman_region32_n_rects(blend_region) <= SPLIT_BLENDING_MAX_RECTS &&
+		pixman_region32_n_rects(copy_region) <= SPLIT_BLENDING_MAX_RECTS &&
+		region_area(copy_region) >= SPLIT_BLENDING_MIN_AREA;
+}
+
 static void scene_entry_render(struct render_list_entry *entry, const struct render_data *data) {
 	struct wlr_scene_node *node = entry->node;
 
 	pixman_region32_t render_region;
 	pixman_region32_init(&render_region);
-	pixman_region32_copy(&render_region, &node->visible);
-	pixman_region32_translate(&render_region, -data->logical.x, -data->logical.y);
-	logical_to_buffer_coords(&render_region, data, true);
+	logical_to_buffer_coords(&render_region, &node->visible, data, true);
 	pixman_region32_intersect(&render_region, &render_region, &data->damage);
 	if (pixman_region32_empty(&render_region)) {
 		pixman_region32_fini(&render_region);
@@ -1405,9 +1720,13 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 
 	pixman_region32_t opaque;
 	pixman_region32_init(&opaque);
-	scene_node_opaque_region(node, x, y, &opaque);
-	logical_to_buffer_coords(&opaque, data, false);
-	pixman_region32_subtract(&opaque, &render_region, &opaque);
+	scene_node_opaque_region(node, entry->x, entry->y, &opaque);
+	logical_to_buffer_coords(&opaque, &opaque, data, false);
+
+	pixman_region32_t translucent;
+	pixman_region32_init(&translucent);
+	pixman_region32_subtract(&translucent, &render_region, &opaque);
+	pixman_region32_fini(&opaque);
 
 	switch (node->type) {
 	case WLR_SCENE_NODE_TREE:
@@ -1426,6 +1745,7 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			},
 			.clip = &render_region,
 		});
+		scene_timer_add_pixels(data, &render_region, scene_rect->color[3] < 1);
 		break;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
@@ -1443,6 +1763,9 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 				},
 				.clip = &render_region,
 			});
+			scene_timer_add_pixels(data, &render_region,
+				scene_buffer->single_pixel_buffer_color[3] != UINT32_MAX ||
+				scene_buffer->opacity < 1);
 			break;
 		}
 
@@ -1462,7 +1785,9 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			wlr_color_primaries_from_named(&primaries, scene_buffer->primaries);
 		}
 
-		wlr_render_pass_add_texture(data->render_pass, &(struct wlr_render_texture_options) {
+		bool calculate_visibility = data->output->scene->calculate_visibility;
+		bool blend = !calculate_visibility || !pixman_region32_empty(&translucent);
+		struct wlr_render_texture_options options = {
 			.texture = texture,
 			.src_box = scene_buffer->src_box,
 			.dst_box = dst_box,
@@ -1470,14 +1795,40 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			.clip = &render_region,
 			.alpha = &scene_buffer->opacity,
 			.filter_mode = scene_buffer->filter_mode,
-			.blend_mode = !data->output->scene->calculate_visibility ||
-					!pixman_region32_empty(&opaque) ?
+			.blend_mode = blend ?
 				WLR_RENDER_BLEND_MODE_PREMULTIPLIED : WLR_RENDER_BLEND_MODE_NONE,
 			.transfer_function = scene_buffer->transfer_function,
 			.primaries = scene_buffer->primaries != 0 ? &primaries : NULL,
 			.wait_timeline = scene_buffer->wait_timeline,
 			.wait_point = scene_buffer->wait_point,
-		});
+		};
+
+		pixman_region32_t copy_region, blend_region;
+		pixman_region32_init(&copy_region);
+		pixman_region32_init(&blend_region);
+		if (blend && calculate_visibility &&
+				texture_scale_is_integer(&options, data->scale) &&
+				scene_entry_split_blending(&render_region, &translucent,
+					&copy_region, &blend_region)) {
+			// Only blend the translucent part of the texture
+			options.clip = &copy_region;
+			options.blend_mode = WLR_RENDER_BLEND_MODE_NONE;
+			wlr_render_pass_add_texture(data->render_pass, &options);
+			scene_timer_add_pixels(data, &copy_region, false);
+
+			// The first draw already waited for the buffer to be ready
+			options.clip = &blend_region;
+			options.blend_mode = WLR_RENDER_BLEND_MODE_PREMULTIPLIED;
+			options.wait_timeline = NULL;
+			options.wait_point = 0;
+			wlr_render_pass_add_texture(data->render_pass, &options);
+			scene_timer_add_pixels(data, &blend_region, true);
+		} else {
+			wlr_render_pass_add_texture(data->render_pass, &options);
+			scene_timer_add_pixels(data, &render_region, blend);
+		}
+		pixman_region32_fini(&copy_region);
+		pixman_region32_fini(&blend_region);
 
 		struct wlr_scene_output_sample_event sample_event = {
 			.output = data->output,
@@ -1489,14 +1840,14 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			wlr_render_pass_add_rect(data->render_pass, &(struct wlr_render_rect_options){
 				.box = dst_box,
 				.color = { .r = 0, .g = 0.3, .b = 0, .a = 0.3 },
-				.clip = &opaque,
+				.clip = &translucent,
 			});
 		}
 
 		break;
 	}
 
-	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&translucent);
 	pixman_region32_fini(&render_region);
 }
 
@@ -1578,6 +1929,11 @@ void wlr_scene_set_color_manager_v1(struct wlr_scene *scene, struct wlr_color_ma
 	wl_signal_add(&manager->events.destroy, &scene->color_manager_v1_destroy);
 }
 
+void wlr_scene_set_frame_done_active_only(struct wlr_scene *scene,
+		bool active_only) {
+	scene->frame_done_active_only = active_only;
+}
+
 static void scene_output_handle_destroy(struct wlr_addon *addon) {
 	struct wlr_scene_output *scene_output =
 		wl_container_of(addon, scene_output, addon);
@@ -1657,17 +2013,11 @@ static void scene_output_handle_commit(struct wl_listener *listener, void *data)
 static void scene_output_handle_damage(struct wl_listener *listener, void *data) {
 	struct wlr_scene_output *scene_output = wl_container_of(listener,
 		scene_output, output_damage);
-	struct wlr_output *output = scene_output->output;
 	struct wlr_output_event_damage *event = data;
 
-	int width, height;
-	wlr_output_transformed_resolution(output, &width, &height);
-
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
-	pixman_region32_copy(&damage, event->damage);
-	wlr_region_transform(&damage, &damage,
-		wlr_output_transform_invert(output->transform), width, height);
+	output_damage_to_buffer_coords(scene_output, &damage, event->damage, 0, 0, 1, 1, 0);
 	scene_output_damage(scene_output, &damage);
 	pixman_region32_fini(&damage);
 }
@@ -1690,8 +2040,12 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 	wlr_addon_init(&scene_output->addon, &output->addons, scene, &output_addon_impl);
 
 	wlr_damage_ring_init(&scene_output->damage_ring);
+	// Swapchain buffers are rotated every frame, a short history is enough
+	wlr_damage_ring_set_mode(&scene_output->damage_ring, WLR_DAMAGE_RING_MODE_AGE);
 	pixman_region32_init(&scene_output->pending_commit_damage);
+	pixman_region32_init(&scene_output->render_list_opaque);
 	wl_list_init(&scene_output->damage_highlight_regions);
+	wl_list_init(&scene_output->active_buffers);
 
 	int prev_output_index = -1;
 	struct wl_list *prev_output_link = &scene->outputs;
@@ -1753,6 +2107,13 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 
 	assert(wl_list_empty(&scene_output->events.destroy.listener_list));
 
+	// Updating the outputs of all nodes above should have removed all
+	// entries, make sure none is left dangling
+	struct scene_output_buffer *entry, *tmp_entry;
+	wl_list_for_each_safe(entry, tmp_entry, &scene_output->active_buffers, output_link) {
+		scene_output_buffer_destroy(entry);
+	}
+
 	struct highlight_region *damage, *tmp_damage;
 	wl_list_for_each_safe(damage, tmp_damage, &scene_output->damage_highlight_regions, link) {
 		highlight_region_destroy(damage);
@@ -1767,6 +2128,16 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	wl_list_remove(&scene_output->output_needs_frame.link);
 	wlr_drm_syncobj_timeline_unref(scene_output->in_timeline);
 	wl_array_release(&scene_output->render_list);
+	wl_array_release(&scene_output->region_scratch);
+	pixman_region32_fini(&scene_output->render_list_opaque);
+
+	struct wlr_output_layer **layer_ptr;
+	wl_array_for_each(layer_ptr, &scene_output->layers) {
+		wlr_output_layer_destroy(*layer_ptr);
+	}
+	wl_array_release(&scene_output->layers);
+	wl_array_release(&scene_output->layer_states);
+
 	free(scene_output);
 }
 
@@ -1818,15 +2189,6 @@ struct render_list_constructor_data {
 	bool fractional_scale;
 };
 
-static bool scene_buffer_is_black_opaque(struct wlr_scene_buffer *scene_buffer) {
-	return scene_buffer->is_single_pixel_buffer &&
-		scene_buffer->single_pixel_buffer_color[0] == 0 &&
-		scene_buffer->single_pixel_buffer_color[1] == 0 &&
-		scene_buffer->single_pixel_buffer_color[2] == 0 &&
-		scene_buffer->single_pixel_buffer_color[3] == UINT32_MAX &&
-		scene_buffer->opacity == 1.0;
-}
-
 static bool construct_render_list_iterator(struct wlr_scene_node *node,
 		int lx, int ly, void *_data) {
 	struct render_list_constructor_data *data = _data;
@@ -1906,11 +2268,6 @@ static void scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
 
 	scene_buffer->prev_feedback_options = *options;
 
-	struct wlr_linux_dmabuf_feedback_v1 feedback = {0};
-	if (!wlr_linux_dmabuf_feedback_v1_init_with_options(&feedback, options)) {
-		return;
-	}
-
 	enum wl_output_transform preferred_buffer_transform = WL_OUTPUT_TRANSFORM_NORMAL;
 	if (options->scanout_primary_output != NULL) {
 		preferred_buffer_transform = options->scanout_primary_output->transform;
@@ -1919,10 +2276,8 @@ static void scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
 	// TODO: also send wl_surface.preferred_buffer_transform when running with
 	// pure software rendering
 	wlr_surface_set_preferred_buffer_transform(surface->surface, preferred_buffer_transform);
-	wlr_linux_dmabuf_v1_set_surface_feedback(scene->linux_dmabuf_v1,
-		surface->surface, &feedback);
-
-	wlr_linux_dmabuf_feedback_v1_finish(&feedback);
+	wlr_linux_dmabuf_v1_set_surface_feedback_with_options(scene->linux_dmabuf_v1,
+		surface->surface, options);
 }
 
 static bool color_management_is_scanout_allowed(const struct wlr_output_image_description *img_desc,
@@ -2064,6 +2419,337 @@ static enum scene_direct_scanout_result scene_entry_try_direct_scanout(
 	return SCANOUT_SUCCESS;
 }
 
+/**
+ * Disable all output layers created by this scene output. All layers need to
+ * be included in the state, otherwise the backend keeps displaying the
+ * previous contents.
+ */
+static void scene_output_reset_layers(struct wlr_scene_output *scene_output,
+		struct wlr_output_state *state) {
+	size_t layers_len = scene_output->layers.size / sizeof(struct wlr_output_layer *);
+	if (layers_len == 0) {
+		return;
+	}
+
+	struct wlr_output_layer **layers = scene_output->layers.data;
+	struct wlr_output_layer_state *layer_states = scene_output->layer_states.data;
+	for (size_t i = 0; i < layers_len; i++) {
+		layer_states[i] = (struct wlr_output_layer_state){
+			.layer = layers[i],
+		};
+	}
+
+	wlr_output_state_set_layers(state, layer_states, layers_len);
+}
+
+static bool scene_output_ensure_layers(struct wlr_scene_output *scene_output,
+		size_t layers_len) {
+	while (scene_output->layers.size / sizeof(struct wlr_output_layer *) < layers_len) {
+		struct wlr_output_layer **layer_ptr =
+			wl_array_add(&scene_output->layers, sizeof(*layer_ptr));
+		if (layer_ptr == NULL) {
+			return false;
+		}
+		struct wlr_output_layer_state *layer_state =
+			wl_array_add(&scene_output->layer_states, sizeof(*layer_state));
+		if (layer_state == NULL) {
+			scene_output->layers.size -= sizeof(*layer_ptr);
+			return false;
+		}
+
+		*layer_ptr = wlr_output_layer_create(scene_output->output);
+		if (*layer_ptr == NULL) {
+			scene_output->layers.size -= sizeof(*layer_ptr);
+			scene_output->layer_states.size -= sizeof(*layer_state);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool scene_entry_can_use_layer(struct render_list_entry *entry,
+		const struct wlr_output_state *state, const struct render_data *data) {
+	struct wlr_scene_node *node = entry->node;
+	if (node->type != WLR_SCENE_NODE_BUFFER) {
+		return false;
+	}
+
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	if (buffer->buffer == NULL || buffer->opacity != 1 ||
+			buffer->transform != data->transform) {
+		return false;
+	}
+
+	const struct wlr_output_image_description *img_desc =
+		output_pending_image_description(data->output->output, state);
+	if (!color_management_is_scanout_allowed(img_desc, buffer)) {
+		return false;
+	}
+
+	// Output layers display the whole buffer, so the node must not be
+	// partially occluded (e.g. by a black rect omitted from the render list)
+	int width, height;
+	scene_node_get_size(node, &width, &height);
+	return region_area(&node->visible) == (uint32_t)width * (uint32_t)height;
+}
+
+struct scene_layer_candidate {
+	// Destination box, in output buffer-local coordinates
+	struct wlr_box box;
+	// DRM format of the buffer, DRM_FORMAT_INVALID if it can't be imported
+	uint32_t format;
+	// Whether the backend accepted the layer during the last test
+	bool accepted;
+};
+
+static uint32_t buffer_get_scanout_format(struct wlr_buffer *buffer) {
+	struct wlr_dmabuf_attributes dmabuf;
+	if (wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
+		return dmabuf.format;
+	}
+	struct wlr_shm_attributes shm;
+	if (wlr_buffer_get_shm(buffer, &shm)) {
+		return shm.format;
+	}
+	return DRM_FORMAT_INVALID;
+}
+
+/**
+ * Returns the number of top-most candidates worth trying to put on layers.
+ * Candidates are ordered from top to bottom and are the first entries of a
+ * render list of list_len entries, displayed on a width x height output.
+ */
+static int scene_layers_select(const struct scene_layer_candidate *candidates,
+		int candidates_len, int list_len, int width, int height) {
+	struct wlr_box output_box = { .width = width, .height = height };
+
+	int selected = 0;
+	while (selected < candidates_len && selected < SCENE_OUTPUT_MAX_LAYERS) {
+		const struct scene_layer_candidate *candidate = &candidates[selected];
+		struct wlr_box visible;
+		if (candidate->format == DRM_FORMAT_INVALID ||
+				!wlr_box_intersection(&visible, &candidate->box, &output_box)) {
+			break;
+		}
+		selected++;
+	}
+
+	// A single entry is better handled by direct scan-out, and we don't
+	// gain anything by offloading the whole render list
+	if (selected == list_len) {
+		selected--;
+	}
+	return selected;
+}
+
+/**
+ * Returns the number of top-most candidates which can stay on layers after a
+ * test commit. Rejected layers are composited onto the primary buffer, which
+ * sits below all layers. Thus all candidates below a rejected one need to be
+ * composited as well to preserve the stacking order.
+ */
+static int scene_layers_accepted(const struct scene_layer_candidate *candidates,
+		int candidates_len) {
+	for (int i = 0; i < candidates_len; i++) {
+		if (!candidates[i].accepted) {
+			return i;
+		}
+	}
+	return candidates_len;
+}
+
+/**
+ * Try to display the top-most scene buffers of the render list with output
+ * layers. Layers are stacked above the primary buffer, so only a contiguous
+ * run of entries starting at the top can be offloaded. Entries which end up
+ * on a layer are marked as such and must not be rendered.
+ */
+static void scene_output_assign_layers(struct wlr_scene_output *scene_output,
+		struct wlr_output_state *state, const struct render_data *data,
+		struct render_list_entry *list_data, int list_len,
+		const struct wlr_scene_output_state_options *options) {
+	struct wlr_output *output = scene_output->output;
+	bool allowed = scene_output->scene->output_layers &&
+		scene_output->scene->direct_scanout &&
+		options->color_transform == NULL &&
+		scene_output->scene->debug_damage_option != WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
+		!(state->committed & (WLR_OUTPUT_STATE_MODE |
+			WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_RENDER_FORMAT)) &&
+		wlr_output_is_direct_scanout_allowed(output);
+
+	// Candidates are collected from the top-most entry downwards
+	struct scene_layer_candidate candidates[SCENE_OUTPUT_MAX_LAYERS];
+	int candidates_len = 0;
+	if (allowed) {
+		while (candidates_len < list_len &&
+				candidates_len < SCENE_OUTPUT_MAX_LAYERS &&
+				scene_entry_can_use_layer(&list_data[candidates_len], state, data)) {
+			struct render_list_entry *entry = &list_data[candidates_len];
+			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+
+			struct scene_layer_candidate *candidate = &candidates[candidates_len];
+			*candidate = (struct scene_layer_candidate){
+				.box = {
+					.x = entry->x - scene_output->x,
+					.y = entry->y - scene_output->y,
+				},
+				.format = buffer_get_scanout_format(buffer->buffer),
+			};
+			scene_node_get_size(entry->node,
+				&candidate->box.width, &candidate->box.height);
+			transform_output_box(&candidate->box, data);
+			candidates_len++;
+		}
+
+		candidates_len = scene_layers_select(candidates, candidates_len,
+			list_len, output->width, output->height);
+	}
+
+	if (candidates_len > 0 && !scene_output_ensure_layers(scene_output, candidates_len)) {
+		candidates_len = 0;
+	}
+
+	struct wlr_output_layer_state *layer_states = scene_output->layer_states.data;
+	while (candidates_len > 0) {
+		scene_output_reset_layers(scene_output, state);
+
+		// Layer states are ordered from bottom to top
+		for (int i = 0; i < candidates_len; i++) {
+			struct render_list_entry *entry = &list_data[candidates_len - i - 1];
+			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+
+			struct wlr_output_layer_state *layer_state = &layer_states[i];
+			layer_state->buffer = buffer->buffer;
+			layer_state->src_box = buffer->src_box;
+			layer_state->dst_box = candidates[candidates_len - i - 1].box;
+		}
+
+		struct wlr_output_state pending;
+		wlr_output_state_init(&pending);
+		if (!wlr_output_state_copy(&pending, state)) {
+			candidates_len = 0;
+			break;
+		}
+		bool ok = wlr_output_test_state(output, &pending);
+		wlr_output_state_finish(&pending);
+		if (!ok) {
+			// Give up on the bottom-most candidate and try again
+			candidates_len--;
+			continue;
+		}
+
+		for (int i = 0; i < candidates_len; i++) {
+			candidates[candidates_len - i - 1].accepted = layer_states[i].accepted;
+		}
+		int accepted = scene_layers_accepted(candidates, candidates_len);
+		if (accepted == candidates_len) {
+			break;
+		}
+		candidates_len = accepted;
+	}
+
+	if (candidates_len == 0) {
+		scene_output_reset_layers(scene_output, state);
+	}
+
+	for (int i = 0; i < list_len; i++) {
+		struct render_list_entry *entry = &list_data[i];
+		if (entry->node->type != WLR_SCENE_NODE_BUFFER) {
+			continue;
+		}
+
+		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+		uint64_t mask = 1ull << scene_output->index;
+		entry->layer = i < candidates_len;
+
+		// The primary buffer contents below the entry are stale whenever it
+		// moves on or off a layer
+		if (entry->layer != !!(buffer->layer_outputs & mask)) {
+			pixman_region32_t damage;
+			pixman_region32_init(&damage);
+			logical_to_buffer_coords(&damage, &entry->node->visible, data, true);
+			scene_output_damage(scene_output, &damage);
+			pixman_region32_fini(&damage);
+		}
+
+		if (entry->layer) {
+			buffer->layer_outputs |= mask;
+
+			struct wlr_scene_output_sample_event sample_event = {
+				.output = scene_output,
+				.direct_scanout = true,
+			};
+			wl_signal_emit_mutable(&buffer->events.output_sample, &sample_event);
+		} else {
+			buffer->layer_outputs &= ~mask;
+		}
+	}
+
+}
+
+/**
+ * Re-build the render list, unless nothing changed in the scene or the output
+ * geometry since it was last built.
+ */
+static void scene_output_update_render_list(struct wlr_scene_output *scene_output,
+		const struct render_data *data) {
+	struct wlr_scene *scene = scene_output->scene;
+	if (scene_output->render_list_generation == scene->generation &&
+			wlr_box_equal(&scene_output->render_list_box, &data->logical) &&
+			scene_output->render_list_scale == data->scale &&
+			scene_output->render_list_transform == data->transform &&
+			scene_output->render_list_width == data->trans_width &&
+			scene_output->render_list_height == data->trans_height) {
+		return;
+	}
+
+	scene_output->render_list_generation = scene->generation;
+	scene_output->render_list_box = data->logical;
+	scene_output->render_list_scale = data->scale;
+	scene_output->render_list_transform = data->transform;
+	scene_output->render_list_width = data->trans_width;
+	scene_output->render_list_height = data->trans_height;
+
+	struct render_list_constructor_data list_con = {
+		.box = data->logical,
+		.render_list = &scene_output->render_list,
+		.calculate_visibility = scene->calculate_visibility,
+		.highlight_transparent_region = scene->highlight_transparent_region,
+		.fractional_scale = floor(data->scale) != data->scale,
+	};
+
+	list_con.render_list->size = 0;
+	scene_nodes_in_box(&scene->tree.node, &list_con.box,
+		construct_render_list_iterator, &list_con);
+	array_realloc(list_con.render_list, list_con.render_list->size);
+
+	pixman_region32_clear(&scene_output->render_list_opaque);
+	if (!scene->calculate_visibility) {
+		return;
+	}
+
+	struct render_list_entry *list_data = list_con.render_list->data;
+	int list_len = list_con.render_list->size / sizeof(*list_data);
+	for (int i = list_len - 1; i >= 0; i--) {
+		struct render_list_entry *entry = &list_data[i];
+
+		// We must only cull opaque regions that are visible by the node.
+		// The node's visibility will have the knowledge of a black rect
+		// that may have been omitted from the render list via the black
+		// rect optimization. In order to ensure we don't cull background
+		// rendering in that black rect region, consider the node's visibility.
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		scene_node_opaque_region(entry->node, entry->x, entry->y, &opaque);
+		pixman_region32_intersect(&opaque, &opaque, &entry->node->visible);
+		logical_to_buffer_coords(&opaque, &opaque, data, false);
+		pixman_region32_union(&scene_output->render_list_opaque,
+			&scene_output->render_list_opaque, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+}
+
 bool wlr_scene_output_needs_frame(struct wlr_scene_output *scene_output) {
 	return scene_output->output->needs_frame ||
 		!pixman_region32_empty(&scene_output->pending_commit_damage) ||
@@ -2150,6 +2836,7 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 		.scale = output->scale,
 		.logical = { .x = scene_output->x, .y = scene_output->y },
 		.output = scene_output,
+		.timer = timer,
 	};
 
 	int resolution_width, resolution_height;
@@ -2180,21 +2867,10 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 	render_data.logical.width = render_data.trans_width / render_data.scale;
 	render_data.logical.height = render_data.trans_height / render_data.scale;
 
-	struct render_list_constructor_data list_con = {
-		.box = render_data.logical,
-		.render_list = &scene_output->render_list,
-		.calculate_visibility = scene_output->scene->calculate_visibility,
-		.highlight_transparent_region = scene_output->scene->highlight_transparent_region,
-		.fractional_scale = floor(render_data.scale) != render_data.scale,
-	};
-
-	list_con.render_list->size = 0;
-	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
-		construct_render_list_iterator, &list_con);
-	array_realloc(list_con.render_list, list_con.render_list->size);
+	scene_output_update_render_list(scene_output, &render_data);
 
-	struct render_list_entry *list_data = list_con.render_list->data;
-	int list_len = list_con.render_list->size / sizeof(*list_data);
+	struct render_list_entry *list_data = scene_output->render_list.data;
+	int list_len = scene_output->render_list.size / sizeof(*list_data);
 
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_RERENDER) {
 		scene_output_damage_whole(scene_output);
@@ -2238,7 +2914,11 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 		pixman_region32_fini(&acc_damage);
 	}
 
-	wlr_output_state_set_damage(state, &scene_output->pending_commit_damage);
+	// Output layers stay enabled until disabled explicitly, so make sure
+	// they're not displayed on top of a direct scan-out buffer
+	scene_output_reset_layers(scene_output, state);
+
+	scene_output_state_set_damage(scene_output, state);
 
 	// We only want to try direct scanout if:
 	// - There is only one entry in the render list
@@ -2280,6 +2960,11 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 		return true;
 	}
 
+	scene_output_assign_layers(scene_output, state, &render_data,
+		list_data, list_len, options);
+	// Moving entries on or off layers may have added damage
+	scene_output_state_set_damage(scene_output, state);
+
 	struct wlr_swapchain *swapchain = options->swapchain;
 	if (!swapchain) {
 		if (!wlr_output_configure_primary_swapchain(output, state, &output->swapchain)) {
@@ -2348,24 +3033,8 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 	// scene nodes above. Those scene nodes will just render atop having us
 	// never see the background.
 	if (scene_output->scene->calculate_visibility) {
-		for (int i = list_len - 1; i >= 0; i--) {
-			struct render_list_entry *entry = &list_data[i];
-
-			// We must only cull opaque regions that are visible by the node.
-			// The node's visibility will have the knowledge of a black rect
-			// that may have been omitted from the render list via the black
-			// rect optimization. In order to ensure we don't cull background
-			// rendering in that black rect region, consider the node's visibility.
-			pixman_region32_t opaque;
-			pixman_region32_init(&opaque);
-			scene_node_opaque_region(entry->node, entry->x, entry->y, &opaque);
-			pixman_region32_intersect(&opaque, &opaque, &entry->node->visible);
-
-			pixman_region32_translate(&opaque, -scene_output->x, -scene_output->y);
-			logical_to_buffer_coords(&opaque, &render_data, false);
-			pixman_region32_subtract(&background, &background, &opaque);
-			pixman_region32_fini(&opaque);
-		}
+		pixman_region32_subtract(&background, &background,
+			&scene_output->render_list_opaque);
 
 		if (floor(render_data.scale) != render_data.scale) {
 			wlr_region_expand(&background, &background, 1);
@@ -2385,6 +3054,10 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 
 	for (int i = list_len - 1; i >= 0; i--) {
 		struct render_list_entry *entry = &list_data[i];
+		if (entry->layer) {
+			continue;
+		}
+
 		scene_entry_render(entry, &render_data);
 
 		if (entry->node->type == WLR_SCENE_NODE_BUFFER) {
@@ -2462,7 +3135,7 @@ void wlr_scene_timer_finish(struct wlr_scene_timer *timer) {
 }
 
 static void scene_node_send_frame_done(struct wlr_scene_node *node,
-		struct wlr_scene_output *scene_output, struct timespec *now) {
+		struct wlr_scene_frame_done_event *event) {
 	if (!node->enabled) {
 		return;
 	}
@@ -2470,24 +3143,50 @@ static void scene_node_send_frame_done(struct wlr_scene_node *node,
 	if (node->type == WLR_SCENE_NODE_BUFFER) {
 		struct wlr_scene_buffer *scene_buffer =
 			wlr_scene_buffer_from_node(node);
-		struct wlr_scene_frame_done_event event = {
-			.output = scene_output,
-			.when = *now,
-		};
-		wlr_scene_buffer_send_frame_done(scene_buffer, &event);
+		wlr_scene_buffer_send_frame_done(scene_buffer, event);
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
 		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
 		struct wlr_scene_node *child;
 		wl_list_for_each(child, &scene_tree->children, link) {
-			scene_node_send_frame_done(child, scene_output, now);
+			scene_node_send_frame_done(child, event);
 		}
 	}
 }
 
 void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
 		struct timespec *now) {
-	scene_node_send_frame_done(&scene_output->scene->tree.node,
-		scene_output, now);
+	struct wlr_scene_frame_done_event event = {
+		.output = scene_output,
+		.when = *now,
+	};
+
+	if (!scene_output->scene->frame_done_active_only) {
+		scene_node_send_frame_done(&scene_output->scene->tree.node, &event);
+		return;
+	}
+
+	// Only buffers active on this output can use it for frame pacing.
+	// Handlers may destroy any entry, so don't hold on to the next one across
+	// emits: always take the first entry, and move it to the end once handled.
+	// Entries added by handlers are skipped until the next frame.
+	uint64_t seq = ++scene_output->frame_done_seq;
+	while (!wl_list_empty(&scene_output->active_buffers)) {
+		struct scene_output_buffer *entry = wl_container_of(
+			scene_output->active_buffers.next, entry, output_link);
+		if (entry->frame_done_seq == seq) {
+			break;
+		}
+		entry->frame_done_seq = seq;
+		wl_list_remove(&entry->output_link);
+		wl_list_insert(scene_output->active_buffers.prev, &entry->output_link);
+
+		int lx, ly;
+		if (!wlr_scene_node_coords(&entry->buffer->node, &lx, &ly)) {
+			// The node or one of its ancestors is disabled
+			continue;
+		}
+		wlr_scene_buffer_send_frame_done(entry->buffer, &event);
+	}
 }
 
 static void scene_output_for_each_scene_buffer(const struct wlr_box *output_box,
@@ -2511,6 +3210,15 @@ static void scene_output_for_each_scene_buffer(const struct wlr_box *output_box,
 			user_iterator(scene_buffer, lx, ly, user_data);
 		}
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
+		// Skip sub-trees which don't intersect the output at all
+		struct wlr_box bounds, intersection;
+		scene_node_get_bounds(node, &bounds);
+		bounds.x += lx;
+		bounds.y += ly;
+		if (!wlr_box_intersection(&intersection, output_box, &bounds)) {
+			return;
+		}
+
 		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
 		struct wlr_scene_node *child;
 		wl_list_for_each(child, &scene_tree->children, link) {
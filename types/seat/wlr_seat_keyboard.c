@@ -8,6 +8,7 @@
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/util/log.h>
 #include "types/wlr_data_device.h"
+#include "types/wlr_keyboard.h"
 #include "types/wlr_seat.h"
 
 static void default_keyboard_enter(struct wlr_seat_keyboard_grab *grab,
@@ -125,7 +126,7 @@ void wlr_seat_set_keyboard(struct wlr_seat *seat,
 	// send the keymap only if it has changed
 	bool needs_keymap_update =
 		!seat->keyboard_state.keyboard || !keyboard ||
-		seat->keyboard_state.keyboard->keymap != keyboard->keymap;
+		!keyboard_keymaps_match(seat->keyboard_state.keyboard, keyboard);
 
 	if (seat->keyboard_state.keyboard) {
 		wl_list_remove(&seat->keyboard_state.keyboard_destroy.link);
@@ -404,6 +404,47 @@ static void surface_state_move(struct wlr_surface_state *state,
 	next->cached_state_locks = 0;
 }
 
+#define DAMAGE_HISTORY_LEN \
+	(sizeof(((struct wlr_surface *)NULL)->damage_history) / \
+	sizeof(((struct wlr_surface *)NULL)->damage_history[0]))
+
+static void surface_drop_prev_buffer(struct wlr_surface *surface) {
+	if (surface->prev_buffer != NULL) {
+		wlr_buffer_unlock(&surface->prev_buffer->base);
+	}
+	surface->prev_buffer = NULL;
+}
+
+/**
+ * Try to bring the previous client buffer up to date with the damage
+ * accumulated since its last upload, and swap it with the current one.
+ */
+static bool surface_apply_damage_to_prev_buffer(struct wlr_surface *surface) {
+	struct wlr_client_buffer *prev = surface->prev_buffer;
+	if (prev == NULL ||
+			surface->damage_seq - surface->prev_buffer_seq > DAMAGE_HISTORY_LEN) {
+		return false;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	for (uint64_t seq = surface->prev_buffer_seq + 1; seq <= surface->damage_seq; seq++) {
+		pixman_region32_union(&damage, &damage,
+			&surface->damage_history[seq % DAMAGE_HISTORY_LEN]);
+	}
+	bool ok = wlr_client_buffer_apply_damage(prev, surface->current.buffer, &damage);
+	pixman_region32_fini(&damage);
+	if (!ok) {
+		return false;
+	}
+
+	surface->prev_buffer = surface->buffer;
+	surface->prev_buffer_seq = surface->buffer_seq;
+	surface->buffer = prev;
+	surface->buffer_seq = surface->damage_seq;
+	return true;
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	if (surface->current.buffer == NULL) {
 		// NULL commit
@@ -411,15 +452,23 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 			wlr_buffer_unlock(&surface->buffer->base);
 		}
 		surface->buffer = NULL;
+		surface_drop_prev_buffer(surface);
 		surface->opaque = false;
 		return;
 	}
 
 	surface->opaque = wlr_buffer_is_opaque(surface->current.buffer);
 
+	surface->damage_seq++;
+	size_t history_index = surface->damage_seq % DAMAGE_HISTORY_LEN;
+	pixman_region32_copy(&surface->damage_history[history_index],
+		&surface->buffer_damage);
+
 	if (surface->buffer != NULL) {
 		if (wlr_client_buffer_apply_damage(surface->buffer,
-				surface->current.buffer, &surface->buffer_damage)) {
+				surface->current.buffer, &surface->buffer_damage) ||
+				surface_apply_damage_to_prev_buffer(surface)) {
+			surface->buffer_seq = surface->damage_seq;
 			wlr_buffer_unlock(surface->current.buffer);
 			surface->current.buffer = NULL;
 			return;
@@ -438,10 +487,22 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		return;
 	}
 
-	if (surface->buffer != NULL) {
+	surface_drop_prev_buffer(surface);
+	struct wlr_shm_attributes shm;
+	if (surface->buffer != NULL && wlr_buffer_get_shm(surface->current.buffer, &shm) &&
+			surface->buffer->base.width == buffer->base.width &&
+			surface->buffer->base.height == buffer->base.height) {
+		// Texture uploads from shm buffers are copies, keep the previous
+		// one for partial uploads on the next commits. The damage history
+		// doesn't track resizes: a previous buffer of a different size is
+		// dropped, even if the surface is later resized back to its size.
+		surface->prev_buffer = surface->buffer;
+		surface->prev_buffer_seq = surface->buffer_seq;
+	} else if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
 	surface->buffer = buffer;
+	surface->buffer_seq = surface->damage_seq;
 }
 
 static void surface_update_opaque_region(struct wlr_surface *surface) {
@@ -756,6 +817,10 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
+	surface_drop_prev_buffer(surface);
+	for (size_t i = 0; i < DAMAGE_HISTORY_LEN; i++) {
+		pixman_region32_fini(&surface->damage_history[i]);
+	}
 
 	struct wlr_surface_output *surface_output, *surface_output_tmp;
 	wl_list_for_each_safe(surface_output, surface_output_tmp,
@@ -803,6 +868,9 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	pixman_region32_init(&surface->buffer_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
+	for (size_t i = 0; i < DAMAGE_HISTORY_LEN; i++) {
+		pixman_region32_init(&surface->damage_history[i]);
+	}
 	wlr_addon_set_init(&surface->addons);
 	wl_list_init(&surface->synced);
 
@@ -53,6 +53,10 @@ struct wlr_cursor_device {
 	struct wl_listener tablet_tool_button;
 
 	struct wl_listener destroy;
+
+	// only when motion coalescing is enabled
+	struct wlr_pointer_motion_event pending_motion;
+	bool motion_pending, frame_pending;
 };
 
 struct wlr_cursor_output_cursor {
@@ -69,6 +73,14 @@ struct wlr_cursor_output_cursor {
 	struct wlr_xcursor *xcursor;
 	size_t xcursor_index;
 	struct wl_event_source *xcursor_timer;
+
+	// Textures for the images of textures_xcursor, created on demand and
+	// kept so that the output can cache the rendered cursor buffers
+	struct wlr_xcursor *textures_xcursor;
+	struct wlr_texture **xcursor_textures;
+	size_t xcursor_textures_len;
+	struct wlr_renderer *xcursor_renderer;
+	struct wl_listener xcursor_renderer_destroy;
 };
 
 struct wlr_cursor_state {
@@ -102,6 +114,11 @@ struct wlr_cursor_state {
 	// only when using an XCursor as the cursor image
 	struct wlr_xcursor_manager *xcursor_manager;
 	char *xcursor_name;
+
+	// only when motion coalescing is enabled
+	struct wl_event_source *motion_timer;
+	int motion_interval_ms;
+	bool motion_throttled;
 };
 
 struct wlr_cursor *wlr_cursor_create(void) {
@@ -156,12 +173,33 @@ struct wlr_cursor *wlr_cursor_create(void) {
 
 static void cursor_output_cursor_reset_image(struct wlr_cursor_output_cursor *output_cursor);
 
+/**
+ * Destroy xcursor textures. The output cursor may be NULL if it has already
+ * been destroyed, otherwise it must not display any of the textures anymore.
+ */
+static void destroy_xcursor_textures(struct wlr_output_cursor *output_cursor,
+		struct wlr_texture **textures, size_t textures_len) {
+	for (size_t i = 0; i < textures_len; i++) {
+		if (textures[i] != NULL) {
+			if (output_cursor != NULL) {
+				output_cursor_forget_texture(output_cursor, textures[i]);
+			}
+			wlr_texture_destroy(textures[i]);
+		}
+	}
+	free(textures);
+}
+
 static void output_cursor_destroy(struct wlr_cursor_output_cursor *output_cursor) {
 	cursor_output_cursor_reset_image(output_cursor);
 	wl_list_remove(&output_cursor->layout_output_destroy.link);
 	wl_list_remove(&output_cursor->link);
 	wl_list_remove(&output_cursor->output_commit.link);
+	wl_list_remove(&output_cursor->xcursor_renderer_destroy.link);
+	struct wlr_texture **textures = output_cursor->xcursor_textures;
+	size_t textures_len = output_cursor->xcursor_textures_len;
 	wlr_output_cursor_destroy(output_cursor->output_cursor);
+	destroy_xcursor_textures(NULL, textures, textures_len);
 	free(output_cursor);
 }
 
@@ -241,6 +279,14 @@ static void cursor_reset_image(struct wlr_cursor *cur) {
 	wl_list_init(&cur->state->surface_commit.link);
 	cur->state->surface = NULL;
 
+	// The xcursor manager may be destroyed at any point after this, don't
+	// re-use the xcursor textures even if a new xcursor ends up at the same
+	// address
+	struct wlr_cursor_output_cursor *output_cursor;
+	wl_list_for_each(output_cursor, &cur->state->output_cursors, link) {
+		output_cursor->textures_xcursor = NULL;
+	}
+
 	cur->state->xcursor_manager = NULL;
 	free(cur->state->xcursor_name);
 	cur->state->xcursor_name = NULL;
@@ -283,6 +329,10 @@ void wlr_cursor_destroy(struct wlr_cursor *cur) {
 		cursor_device_destroy(device);
 	}
 
+	if (cur->state->motion_timer != NULL) {
+		wl_event_source_remove(cur->state->motion_timer);
+	}
+
 	free(cur->state);
 }
 
@@ -496,16 +546,56 @@ static int handle_xcursor_timer(void *data) {
 	return 0;
 }
 
-static void output_cursor_set_xcursor_image(struct wlr_cursor_output_cursor *output_cursor, size_t i) {
-	struct wlr_xcursor_image *image = output_cursor->xcursor->images[i];
+static struct wlr_texture *output_cursor_get_xcursor_texture(
+		struct wlr_cursor_output_cursor *output_cursor, size_t i) {
+	assert(i < output_cursor->xcursor_textures_len);
+	if (output_cursor->xcursor_textures[i] != NULL) {
+		return output_cursor->xcursor_textures[i];
+	}
 
+	struct wlr_xcursor_image *image = output_cursor->xcursor->images[i];
 	struct wlr_readonly_data_buffer *ro_buffer = readonly_data_buffer_create(
 		DRM_FORMAT_ARGB8888, 4 * image->width, image->width, image->height, image->buffer);
 	if (ro_buffer == NULL) {
-		return;
+		return NULL;
 	}
-	wlr_output_cursor_set_buffer(output_cursor->output_cursor, &ro_buffer->base, image->hotspot_x, image->hotspot_y);
+	struct wlr_renderer *renderer = output_cursor->output_cursor->output->renderer;
+	output_cursor->xcursor_textures[i] = wlr_texture_from_buffer(renderer, &ro_buffer->base);
 	wlr_buffer_drop(&ro_buffer->base);
+	return output_cursor->xcursor_textures[i];
+}
+
+static void output_cursor_set_xcursor_image(struct wlr_cursor_output_cursor *output_cursor, size_t i) {
+	struct wlr_xcursor_image *image = output_cursor->xcursor->images[i];
+	struct wlr_output_cursor *cursor = output_cursor->output_cursor;
+
+	if (output_cursor->xcursor_textures != NULL &&
+			output_cursor->textures_xcursor == output_cursor->xcursor) {
+		struct wlr_texture *texture = output_cursor_get_xcursor_texture(output_cursor, i);
+		if (texture == NULL) {
+			return;
+		}
+
+		// Same geometry as wlr_output_cursor_set_buffer()
+		float scale = cursor->output->scale;
+		struct wlr_fbox src_box = {
+			.width = texture->width,
+			.height = texture->height,
+		};
+		int32_t hotspot_x = image->hotspot_x / scale;
+		int32_t hotspot_y = image->hotspot_y / scale;
+		output_cursor_set_texture(cursor, texture, false, true, &src_box,
+			texture->width / scale, texture->height / scale,
+			WL_OUTPUT_TRANSFORM_NORMAL, hotspot_x, hotspot_y, NULL, 0);
+	} else {
+		struct wlr_readonly_data_buffer *ro_buffer = readonly_data_buffer_create(
+			DRM_FORMAT_ARGB8888, 4 * image->width, image->width, image->height, image->buffer);
+		if (ro_buffer == NULL) {
+			return;
+		}
+		wlr_output_cursor_set_buffer(cursor, &ro_buffer->base, image->hotspot_x, image->hotspot_y);
+		wlr_buffer_drop(&ro_buffer->base);
+	}
 
 	output_cursor->xcursor_index = i;
 
@@ -526,12 +616,59 @@ static void output_cursor_set_xcursor_image(struct wlr_cursor_output_cursor *out
 	wl_event_source_timer_update(output_cursor->xcursor_timer, image->delay);
 }
 
+static void output_cursor_set_xcursor_textures(struct wlr_cursor_output_cursor *output_cursor,
+	struct wlr_xcursor *xcursor, struct wlr_texture **textures, size_t textures_len);
+
+static void output_cursor_handle_xcursor_renderer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_cursor_output_cursor *output_cursor =
+		wl_container_of(listener, output_cursor, xcursor_renderer_destroy);
+
+	// The textures are destroyed along with the renderer
+	for (size_t i = 0; i < output_cursor->xcursor_textures_len; i++) {
+		if (output_cursor->xcursor_textures[i] != NULL) {
+			output_cursor_forget_texture(output_cursor->output_cursor,
+				output_cursor->xcursor_textures[i]);
+		}
+	}
+	free(output_cursor->xcursor_textures);
+	output_cursor_set_xcursor_textures(output_cursor, NULL, NULL, 0);
+}
+
+static void output_cursor_set_xcursor_textures(struct wlr_cursor_output_cursor *output_cursor,
+		struct wlr_xcursor *xcursor, struct wlr_texture **textures, size_t textures_len) {
+	output_cursor->textures_xcursor = xcursor;
+	output_cursor->xcursor_textures = textures;
+	output_cursor->xcursor_textures_len = textures_len;
+	output_cursor->xcursor_renderer = NULL;
+
+	wl_list_remove(&output_cursor->xcursor_renderer_destroy.link);
+	if (textures != NULL) {
+		struct wlr_renderer *renderer = output_cursor->output_cursor->output->renderer;
+		output_cursor->xcursor_renderer = renderer;
+		output_cursor->xcursor_renderer_destroy.notify =
+			output_cursor_handle_xcursor_renderer_destroy;
+		wl_signal_add(&renderer->events.destroy, &output_cursor->xcursor_renderer_destroy);
+	} else {
+		wl_list_init(&output_cursor->xcursor_renderer_destroy.link);
+	}
+}
+
 static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_cursor) {
 	struct wlr_cursor *cur = output_cursor->cursor;
 	struct wlr_output *output = output_cursor->output_cursor->output;
 
 	cursor_output_cursor_reset_image(output_cursor);
 
+	// The output cursor may still display one of the previous xcursor textures,
+	// only destroy them once the new image has been set
+	struct wlr_xcursor *prev_xcursor = output_cursor->textures_xcursor;
+	struct wlr_texture **prev_textures = output_cursor->xcursor_textures;
+	size_t prev_textures_len = output_cursor->xcursor_textures_len;
+	bool prev_textures_valid = prev_textures != NULL &&
+		output_cursor->xcursor_renderer == output->renderer;
+	output_cursor_set_xcursor_textures(output_cursor, NULL, NULL, 0);
+
 	if (cur->state->buffer != NULL) {
 		struct wlr_renderer *renderer = output->renderer;
 		assert(renderer != NULL);
@@ -557,7 +694,7 @@ static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_
 			}
 		}
 
-		output_cursor_set_texture(output_cursor->output_cursor, texture, true,
+		output_cursor_set_texture(output_cursor->output_cursor, texture, true, false,
 			&src_box, dst_width, dst_height, WL_OUTPUT_TRANSFORM_NORMAL,
 			hotspot_x, hotspot_y, NULL, 0);
 	} else if (cur->state->surface != NULL) {
@@ -581,7 +718,7 @@ static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_
 			wait_point = syncobj_surface_state->acquire_point;
 		}
 
-		output_cursor_set_texture(output_cursor->output_cursor, texture, false,
+		output_cursor_set_texture(output_cursor->output_cursor, texture, false, false,
 			&src_box, dst_width, dst_height, surface->current.transform,
 			hotspot_x, hotspot_y, wait_timeline, wait_point);
 
@@ -622,15 +759,34 @@ static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_
 			if (xcursor == NULL) {
 				wlr_log(WLR_DEBUG, "XCursor theme is missing a 'default' cursor");
 				wlr_output_cursor_set_buffer(output_cursor->output_cursor, NULL, 0, 0);
+				destroy_xcursor_textures(output_cursor->output_cursor,
+					prev_textures, prev_textures_len);
 				return;
 			}
 		}
 
+		if (xcursor == prev_xcursor && prev_textures_valid) {
+			output_cursor_set_xcursor_textures(output_cursor, xcursor,
+				prev_textures, prev_textures_len);
+			prev_textures = NULL;
+			prev_textures_len = 0;
+		} else {
+			struct wlr_texture **textures =
+				calloc(xcursor->image_count, sizeof(textures[0]));
+			if (textures != NULL) {
+				output_cursor_set_xcursor_textures(output_cursor, xcursor,
+					textures, xcursor->image_count);
+			}
+		}
+
 		output_cursor->xcursor = xcursor;
 		output_cursor_set_xcursor_image(output_cursor, 0);
 	} else {
 		wlr_output_cursor_set_buffer(output_cursor->output_cursor, NULL, 0, 0);
 	}
+
+	destroy_xcursor_textures(output_cursor->output_cursor,
+		prev_textures, prev_textures_len);
 }
 
 static void output_cursor_output_handle_output_commit(
@@ -721,11 +877,122 @@ void wlr_cursor_set_surface(struct wlr_cursor *cur, struct wlr_surface *surface,
 	cursor_update_outputs(cur);
 }
 
+static void cursor_device_flush_motion(struct wlr_cursor_device *device) {
+	if (!device->motion_pending) {
+		return;
+	}
+
+	struct wlr_pointer_motion_event event = device->pending_motion;
+	bool frame = device->frame_pending;
+	device->motion_pending = false;
+	device->frame_pending = false;
+
+	wl_signal_emit_mutable(&device->cursor->events.motion, &event);
+	if (frame) {
+		wl_signal_emit_mutable(&device->cursor->events.frame, device->cursor);
+	}
+}
+
+static struct wlr_cursor_device *cursor_find_pending_motion(
+		struct wlr_cursor *cur) {
+	struct wlr_cursor_device *device;
+	wl_list_for_each(device, &cur->state->devices, link) {
+		if (device->motion_pending) {
+			return device;
+		}
+	}
+	return NULL;
+}
+
+void wlr_cursor_flush_motion(struct wlr_cursor *cur) {
+	// Handlers may detach or destroy any device, so don't hold on to the
+	// device list across emits. Flushing clears the pending state before
+	// emitting, so each lookup makes progress, and devices detached in the
+	// meantime take their pending state with them.
+	struct wlr_cursor_device *device;
+	while ((device = cursor_find_pending_motion(cur)) != NULL) {
+		cursor_device_flush_motion(device);
+	}
+}
+
+static int handle_motion_timer(void *data) {
+	struct wlr_cursor_state *state = data;
+
+	bool pending = false;
+	struct wlr_cursor_device *device;
+	wl_list_for_each(device, &state->devices, link) {
+		pending = pending || device->motion_pending;
+	}
+
+	if (!pending) {
+		// The pointer went idle, deliver the next motion event right away
+		state->motion_throttled = false;
+		return 0;
+	}
+
+	wlr_cursor_flush_motion(&state->cursor);
+	wl_event_source_timer_update(state->motion_timer, state->motion_interval_ms);
+	return 0;
+}
+
+void wlr_cursor_set_motion_coalescing(struct wlr_cursor *cur,
+		struct wl_event_loop *loop, int interval_ms) {
+	assert(interval_ms >= 0);
+
+	wlr_cursor_flush_motion(cur);
+
+	struct wlr_cursor_state *state = cur->state;
+	if (state->motion_timer != NULL) {
+		wl_event_source_remove(state->motion_timer);
+		state->motion_timer = NULL;
+	}
+	state->motion_interval_ms = 0;
+	state->motion_throttled = false;
+
+	if (interval_ms == 0) {
+		return;
+	}
+
+	state->motion_timer = wl_event_loop_add_timer(loop, handle_motion_timer, state);
+	if (state->motion_timer == NULL) {
+		wlr_log(WLR_ERROR, "wl_event_loop_add_timer failed");
+		return;
+	}
+	state->motion_interval_ms = interval_ms;
+}
+
 static void handle_pointer_motion(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_motion_event *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion);
-	wl_signal_emit_mutable(&device->cursor->events.motion, event);
+	struct wlr_cursor_state *state = device->cursor->state;
+
+	if (state->motion_timer == NULL) {
+		wl_signal_emit_mutable(&device->cursor->events.motion, event);
+		return;
+	}
+
+	if (!state->motion_throttled) {
+		// Start of a motion burst: deliver the event right away to keep
+		// latency low and accumulate the next ones until the timer fires
+		state->motion_throttled = true;
+		wl_event_source_timer_update(state->motion_timer, state->motion_interval_ms);
+		wl_signal_emit_mutable(&device->cursor->events.motion, event);
+		return;
+	}
+
+	if (!device->motion_pending) {
+		device->pending_motion = *event;
+		device->motion_pending = true;
+		return;
+	}
+
+	struct wlr_pointer_motion_event *pending = &device->pending_motion;
+	pending->time_msec = event->time_msec;
+	pending->delta_x += event->delta_x;
+	pending->delta_y += event->delta_y;
+	pending->unaccel_dx += event->unaccel_dx;
+	pending->unaccel_dy += event->unaccel_dy;
 }
 
 static void apply_output_transform(double *x, double *y,
@@ -797,6 +1064,7 @@ static void handle_pointer_motion_absolute(struct wl_listener *listener,
 	if (output) {
 		apply_output_transform(&event->x, &event->y, output->transform);
 	}
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.motion_absolute, event);
 }
 
@@ -804,65 +1072,81 @@ static void handle_pointer_button(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_button_event *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, button);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.button, event);
 }
 
 static void handle_pointer_axis(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_axis_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, axis);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.axis, event);
 }
 
 static void handle_pointer_frame(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_device *device = wl_container_of(listener, device, frame);
+	if (device->motion_pending) {
+		// Any other event would have flushed the pending motion, so this
+		// frame only groups motion events: deliver it along with them
+		device->frame_pending = true;
+		return;
+	}
 	wl_signal_emit_mutable(&device->cursor->events.frame, device->cursor);
 }
 
 static void handle_pointer_swipe_begin(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_swipe_begin_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, swipe_begin);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.swipe_begin, event);
 }
 
 static void handle_pointer_swipe_update(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_swipe_update_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, swipe_update);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.swipe_update, event);
 }
 
 static void handle_pointer_swipe_end(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_swipe_end_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, swipe_end);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.swipe_end, event);
 }
 
 static void handle_pointer_pinch_begin(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_pinch_begin_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, pinch_begin);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.pinch_begin, event);
 }
 
 static void handle_pointer_pinch_update(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_pinch_update_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, pinch_update);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.pinch_update, event);
 }
 
 static void handle_pointer_pinch_end(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_pinch_end_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, pinch_end);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.pinch_end, event);
 }
 
 static void handle_pointer_hold_begin(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_hold_begin_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, hold_begin);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.hold_begin, event);
 }
 
 static void handle_pointer_hold_end(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_hold_end_event *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, hold_end);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.hold_end, event);
 }
 
@@ -870,6 +1154,7 @@ static void handle_touch_up(struct wl_listener *listener, void *data) {
 	struct wlr_touch_up_event *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_up);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.touch_up, event);
 }
 
@@ -883,6 +1168,7 @@ static void handle_touch_down(struct wl_listener *listener, void *data) {
 	if (output) {
 		apply_output_transform(&event->x, &event->y, output->transform);
 	}
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.touch_down, event);
 }
 
@@ -896,6 +1182,7 @@ static void handle_touch_motion(struct wl_listener *listener, void *data) {
 	if (output) {
 		apply_output_transform(&event->x, &event->y, output->transform);
 	}
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.touch_motion, event);
 }
 
@@ -903,6 +1190,7 @@ static void handle_touch_cancel(struct wl_listener *listener, void *data) {
 	struct wlr_touch_cancel_event *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_cancel);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.touch_cancel, event);
 }
 
@@ -922,6 +1210,7 @@ static void handle_tablet_tool_tip(struct wl_listener *listener, void *data) {
 	if (output) {
 		apply_output_transform(&event->x, &event->y, output->transform);
 	}
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.tablet_tool_tip, event);
 }
 
@@ -957,6 +1246,7 @@ static void handle_tablet_tool_axis(struct wl_listener *listener, void *data) {
 		}
 	}
 
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.tablet_tool_axis, event);
 }
 
@@ -965,6 +1255,7 @@ static void handle_tablet_tool_button(struct wl_listener *listener,
 	struct wlr_tablet_tool_button *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_button);
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.tablet_tool_button, event);
 }
 
@@ -979,6 +1270,7 @@ static void handle_tablet_tool_proximity(struct wl_listener *listener,
 	if (output) {
 		apply_output_transform(&event->x, &event->y, output->transform);
 	}
+	wlr_cursor_flush_motion(device->cursor);
 	wl_signal_emit_mutable(&device->cursor->events.tablet_tool_proximity, event);
 }
 
@@ -1156,6 +1448,7 @@ static void layout_add(struct wlr_cursor_state *state,
 		return;
 	}
 	output_cursor->cursor = &state->cursor;
+	wl_list_init(&output_cursor->xcursor_renderer_destroy.link);
 
 	output_cursor->output_cursor = wlr_output_cursor_create(l_output->output);
 	if (output_cursor->output_cursor == NULL) {
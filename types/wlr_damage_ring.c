@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,6 +6,7 @@
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/util/box.h>
+#include "util/region.h"
 
 #define WLR_DAMAGE_RING_MAX_RECTS 20
 
@@ -12,6 +14,16 @@ void wlr_damage_ring_init(struct wlr_damage_ring *ring) {
 	*ring = (struct wlr_damage_ring){ 0 };
 	pixman_region32_init(&ring->current);
 	wl_list_init(&ring->buffers);
+	ring->max_rects = WLR_DAMAGE_RING_MAX_RECTS;
+	ring->mode = WLR_DAMAGE_RING_MODE_BUFFERS;
+
+	for (size_t i = 0; i < WLR_DAMAGE_RING_HISTORY_LEN; i++) {
+		pixman_region32_init(&ring->history[i]);
+	}
+}
+
+void wlr_damage_ring_set_max_rects(struct wlr_damage_ring *ring, int max_rects) {
+	ring->max_rects = max_rects < 1 ? 1 : max_rects;
 }
 
 static void buffer_destroy(struct wlr_damage_ring_buffer *entry) {
@@ -27,6 +39,27 @@ void wlr_damage_ring_finish(struct wlr_damage_ring *ring) {
 	wl_list_for_each_safe(entry, tmp_entry, &ring->buffers, link) {
 		buffer_destroy(entry);
 	}
+	for (size_t i = 0; i < WLR_DAMAGE_RING_HISTORY_LEN; i++) {
+		pixman_region32_fini(&ring->history[i]);
+	}
+}
+
+void wlr_damage_ring_set_mode(struct wlr_damage_ring *ring,
+		enum wlr_damage_ring_mode mode) {
+	if (ring->mode == mode) {
+		return;
+	}
+
+	struct wlr_damage_ring_buffer *entry, *tmp_entry;
+	wl_list_for_each_safe(entry, tmp_entry, &ring->buffers, link) {
+		buffer_destroy(entry);
+	}
+	for (size_t i = 0; i < WLR_DAMAGE_RING_HISTORY_LEN; i++) {
+		pixman_region32_clear(&ring->history[i]);
+	}
+	ring->history_idx = 0;
+	ring->history_len = 0;
+	ring->mode = mode;
 }
 
 void wlr_damage_ring_add(struct wlr_damage_ring *ring,
@@ -71,12 +104,133 @@ static void entry_squash_damage(struct wlr_damage_ring_buffer *entry) {
 
 static void buffer_handle_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_damage_ring_buffer *entry = wl_container_of(listener, entry, destroy);
-	entry_squash_damage(entry);
+	if (entry->ring->mode == WLR_DAMAGE_RING_MODE_BUFFERS) {
+		entry_squash_damage(entry);
+	}
 	buffer_destroy(entry);
 }
 
+static struct wlr_damage_ring_buffer *ring_get_entry(struct wlr_damage_ring *ring,
+		struct wlr_buffer *buffer) {
+	struct wlr_damage_ring_buffer *entry;
+	wl_list_for_each(entry, &ring->buffers, link) {
+		if (entry->buffer == buffer) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static struct wlr_damage_ring_buffer *ring_add_entry(struct wlr_damage_ring *ring,
+		struct wlr_buffer *buffer) {
+	struct wlr_damage_ring_buffer *entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		return NULL;
+	}
+
+	pixman_region32_init(&entry->damage);
+
+	wl_list_insert(&ring->buffers, &entry->link);
+	entry->buffer = buffer;
+	entry->ring = ring;
+
+	entry->destroy.notify = buffer_handle_destroy;
+	wl_signal_add(&buffer->events.destroy, &entry->destroy);
+	return entry;
+}
+
+static int entry_get_age(struct wlr_damage_ring_buffer *entry) {
+	uint64_t age = entry->ring->frame - entry->frame + 1;
+	return age > INT_MAX ? INT_MAX : (int)age;
+}
+
+int wlr_damage_ring_get_buffer_age(struct wlr_damage_ring *ring,
+		struct wlr_buffer *buffer) {
+	struct wlr_damage_ring_buffer *entry = ring_get_entry(ring, buffer);
+	if (entry == NULL) {
+		return 0;
+	}
+	return entry_get_age(entry);
+}
+
+/**
+ * Returns the union of the damage of the n most recent frames.
+ */
+static pixman_region32_t *ring_get_history(struct wlr_damage_ring *ring, size_t n) {
+	assert(n >= 1 && n <= ring->history_len);
+	return &ring->history[(ring->history_idx + n - 1) % WLR_DAMAGE_RING_HISTORY_LEN];
+}
+
+bool wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
+		int buffer_age, pixman_region32_t *damage) {
+	if (ring->mode != WLR_DAMAGE_RING_MODE_AGE || buffer_age <= 0 ||
+			(size_t)buffer_age - 1 > ring->history_len) {
+		return false;
+	}
+
+	pixman_region32_copy(damage, &ring->current);
+	if (buffer_age > 1) {
+		pixman_region32_union(damage, damage,
+			ring_get_history(ring, buffer_age - 1));
+	}
+	return true;
+}
+
+static void ring_rotate_history(struct wlr_damage_ring *ring) {
+	// Each cached union gains the current frame's damage and moves one slot
+	// further in the history. The oldest one falls out of the history.
+	size_t len = ring->history_len;
+	if (len == WLR_DAMAGE_RING_HISTORY_LEN) {
+		len--;
+	}
+	for (size_t n = 1; n <= len; n++) {
+		pixman_region32_t *history = ring_get_history(ring, n);
+		pixman_region32_union(history, history, &ring->current);
+	}
+
+	ring->history_idx = (ring->history_idx + WLR_DAMAGE_RING_HISTORY_LEN - 1) %
+		WLR_DAMAGE_RING_HISTORY_LEN;
+	ring->history_len = len + 1;
+	pixman_region32_copy(&ring->history[ring->history_idx], &ring->current);
+	pixman_region32_clear(&ring->current);
+}
+
+static void ring_rotate_buffer_age(struct wlr_damage_ring *ring,
+		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	struct wlr_damage_ring_buffer *entry = ring_get_entry(ring, buffer);
+	int age = entry != NULL ? entry_get_age(entry) : 0;
+	if (wlr_damage_ring_get_buffer_damage(ring, age, damage)) {
+		pixman_region32_intersect_rect(damage, damage, 0, 0, buffer->width, buffer->height);
+		region_coalesce(damage, ring->max_rects);
+	} else {
+		pixman_region32_clear(damage);
+		pixman_region32_union_rect(damage, damage,
+			0, 0, buffer->width, buffer->height);
+	}
+
+	ring_rotate_history(ring);
+	ring->frame++;
+
+	if (entry == NULL) {
+		entry = ring_add_entry(ring, buffer);
+		if (entry == NULL) {
+			return;
+		}
+	} else {
+		wl_list_remove(&entry->link);
+		wl_list_insert(&ring->buffers, &entry->link);
+	}
+	entry->frame = ring->frame;
+}
+
 void wlr_damage_ring_rotate_buffer(struct wlr_damage_ring *ring,
 		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	if (ring->mode == WLR_DAMAGE_RING_MODE_AGE) {
+		ring_rotate_buffer_age(ring, buffer, damage);
+		return;
+	}
+
+	ring->frame++;
 	pixman_region32_copy(damage, &ring->current);
 
 	struct wlr_damage_ring_buffer *entry;
@@ -87,21 +241,13 @@ void wlr_damage_ring_rotate_buffer(struct wlr_damage_ring *ring,
 		}
 
 		pixman_region32_intersect_rect(damage, damage, 0, 0, buffer->width, buffer->height);
-
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage,
-				extents->x1, extents->y1,
-				extents->x2 - extents->x1,
-				extents->y2 - extents->y1);
-		}
+		region_coalesce(damage, ring->max_rects);
 
 		// rotate
 		entry_squash_damage(entry);
 		pixman_region32_copy(&entry->damage, &ring->current);
 		pixman_region32_clear(&ring->current);
+		entry->frame = ring->frame;
 
 		wl_list_remove(&entry->link);
 		wl_list_insert(&ring->buffers, &entry->link);
@@ -112,19 +258,12 @@ void wlr_damage_ring_rotate_buffer(struct wlr_damage_ring *ring,
 	pixman_region32_union_rect(damage, damage,
 		0, 0, buffer->width, buffer->height);
 
-	entry = calloc(1, sizeof(*entry));
+	entry = ring_add_entry(ring, buffer);
 	if (!entry) {
 		return;
 	}
 
-	pixman_region32_init(&entry->damage);
 	pixman_region32_copy(&entry->damage, &ring->current);
 	pixman_region32_clear(&ring->current);
-
-	wl_list_insert(&ring->buffers, &entry->link);
-	entry->buffer = buffer;
-	entry->ring = ring;
-
-	entry->destroy.notify = buffer_handle_destroy;
-	wl_signal_add(&buffer->events.destroy, &entry->destroy);
+	entry->frame = ring->frame;
 }
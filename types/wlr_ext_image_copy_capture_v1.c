@@ -6,6 +6,7 @@
 #include <wlr/types/wlr_ext_image_copy_capture_v1.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
 #include "ext-image-copy-capture-v1-protocol.h"
 #include "render/pixel_format.h"
 
@@ -71,6 +72,7 @@ static void frame_destroy(struct wlr_ext_image_copy_capture_frame_v1 *frame) {
 	}
 	wl_signal_emit_mutable(&frame->events.destroy, NULL);
 	assert(wl_list_empty(&frame->events.destroy.listener_list));
+	wlr_texture_read_pixels_async_destroy(frame->read);
 	wl_resource_set_user_data(frame->resource, NULL);
 	wlr_buffer_unlock(frame->buffer);
 	pixman_region32_fini(&frame->buffer_damage);
@@ -104,6 +106,17 @@ void wlr_ext_image_copy_capture_frame_v1_ready(struct wlr_ext_image_copy_capture
 	ext_image_copy_capture_frame_v1_send_transform(frame->resource, transform);
 	ext_image_copy_capture_frame_v1_send_presentation_time(frame->resource,
 		pres_time_sec >> 32, (uint32_t)pres_time_sec, presentation_time->tv_nsec);
+
+	if (frame->read != NULL) {
+		frame->ready_pending = true;
+		return;
+	}
+	if (frame->read_failed) {
+		wlr_ext_image_copy_capture_frame_v1_fail(frame,
+			EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_UNKNOWN);
+		return;
+	}
+
 	ext_image_copy_capture_frame_v1_send_ready(frame->resource);
 	frame_destroy(frame);
 }
@@ -155,6 +168,64 @@ static bool copy_shm(void *data, uint32_t format, size_t stride,
 	return ok;
 }
 
+static void frame_handle_read_ready(struct wlr_texture_read_pixels_async *read,
+		void *data) {
+	struct wlr_ext_image_copy_capture_frame_v1 *frame = data;
+
+	bool ok = false;
+	void *dst;
+	uint32_t format;
+	size_t stride;
+	if (wlr_buffer_begin_data_ptr_access(frame->buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &dst, &format, &stride)) {
+		ok = wlr_texture_read_pixels_async_finish(read, dst, stride);
+		wlr_buffer_end_data_ptr_access(frame->buffer);
+	}
+
+	wlr_texture_read_pixels_async_destroy(frame->read);
+	frame->read = NULL;
+
+	if (!frame->ready_pending) {
+		frame->read_failed = !ok;
+		return;
+	}
+
+	if (!ok) {
+		wlr_ext_image_copy_capture_frame_v1_fail(frame,
+			EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_UNKNOWN);
+		return;
+	}
+
+	ext_image_copy_capture_frame_v1_send_ready(frame->resource);
+	frame_destroy(frame);
+}
+
+// Starts copying without waiting for the GPU. The ready event is deferred
+// until the copy completes. Returns false if the renderer can't do it.
+static bool copy_shm_async(struct wlr_ext_image_copy_capture_frame_v1 *frame,
+		struct wlr_buffer *src, struct wlr_renderer *renderer) {
+	struct wlr_shm_attributes shm;
+	if (!wlr_buffer_get_shm(frame->buffer, &shm)) {
+		return false;
+	}
+
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, src);
+	if (!texture) {
+		return false;
+	}
+
+	struct wl_client *client = wl_resource_get_client(frame->resource);
+	struct wl_event_loop *loop = wl_display_get_event_loop(wl_client_get_display(client));
+	frame->read = wlr_texture_read_pixels_async_begin(texture,
+		&(struct wlr_texture_read_pixels_async_options){
+			.format = shm.format,
+		}, loop, frame_handle_read_ready, frame);
+
+	wlr_texture_destroy(texture);
+
+	return frame->read != NULL;
+}
+
 bool wlr_ext_image_copy_capture_frame_v1_copy_buffer(struct wlr_ext_image_copy_capture_frame_v1 *frame,
 		struct wlr_buffer *src, struct wlr_renderer *renderer) {
 	struct wlr_buffer *dst = frame->buffer;
@@ -165,6 +236,10 @@ bool wlr_ext_image_copy_capture_frame_v1_copy_buffer(struct wlr_ext_image_copy_c
 		return false;
 	}
 
+	wlr_texture_read_pixels_async_destroy(frame->read);
+	frame->read = NULL;
+	frame->read_failed = false;
+
 	bool ok = false;
 	enum ext_image_copy_capture_frame_v1_failure_reason failure_reason =
 		EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_UNKNOWN;
@@ -179,6 +254,9 @@ bool wlr_ext_image_copy_capture_frame_v1_copy_buffer(struct wlr_ext_image_copy_c
 		} else {
 			ok = copy_dmabuf(dst, src, renderer, &frame->buffer_damage);
 		}
+	} else if (frame->session->source->shm_formats_len > 0 &&
+			copy_shm_async(frame, src, renderer)) {
+		ok = true;
 	} else if (wlr_buffer_begin_data_ptr_access(dst,
 			WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
 		if (frame->session->source->shm_formats_len == 0) {
@@ -423,7 +501,7 @@ static void session_handle_source_frame(struct wl_listener *listener, void *data
 	pixman_region32_union(&session->damage, &session->damage, event->damage);
 
 	struct wlr_ext_image_copy_capture_frame_v1 *frame = session->frame;
-	if (frame != NULL && frame->capturing &&
+	if (frame != NULL && frame->capturing && !frame->ready_pending &&
 			!pixman_region32_empty(&session->damage)) {
 		pixman_region32_union(&frame->buffer_damage,
 			&frame->buffer_damage, &session->damage);
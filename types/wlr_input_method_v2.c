@@ -10,6 +10,7 @@
 #include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
 #include "input-method-unstable-v2-protocol.h"
+#include "types/wlr_keyboard.h"
 
 // Note: zwp_input_popup_surface_v2 and zwp_input_method_keyboard_grab_v2 objects
 // become inert when the corresponding zwp_input_method_v2 is destroyed
@@ -387,8 +388,7 @@ void wlr_input_method_keyboard_grab_v2_set_keyboard(
 
 	if (keyboard) {
 		if (keyboard_grab->keyboard == NULL ||
-				!wlr_keyboard_keymaps_match(keyboard_grab->keyboard->keymap,
-				keyboard->keymap)) {
+				!keyboard_keymaps_match(keyboard_grab->keyboard, keyboard)) {
 			// Only send keymap if it changed, otherwise if the input-method
 			// client sent back the same keymap with virtual-keyboard, it would
 			// result in an infinite loop of keymap updates.
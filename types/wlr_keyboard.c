@@ -13,6 +13,165 @@
 #include "util/shm.h"
 #include "util/time.h"
 
+#define KEYMAP_ENTRY_KEYMAPS_CAP 4
+
+/**
+ * Keyboards with identical keymaps share a single entry: the keymap text is
+ * serialized and copied into a shm file once per distinct keymap, rather
+ * than once per keyboard.
+ */
+struct wlr_keyboard_keymap_entry {
+	struct wl_list link; // keymap_entries
+	size_t n_refs;
+
+	uint64_t hash;
+	char *string;
+	size_t size;
+	int fd;
+
+	// Recently seen keymaps which serialize to the string above, so that
+	// setting them again doesn't require serializing them
+	struct xkb_keymap *keymaps[KEYMAP_ENTRY_KEYMAPS_CAP];
+	size_t keymaps_next;
+};
+
+static struct wl_list keymap_entries = { &keymap_entries, &keymap_entries };
+
+// 64-bit FNV-1a
+static uint64_t hash_keymap_string(const char *str, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static struct wlr_keyboard_keymap_entry *keymap_entry_find(
+		struct xkb_keymap *keymap) {
+	struct wlr_keyboard_keymap_entry *entry;
+	wl_list_for_each(entry, &keymap_entries, link) {
+		for (size_t i = 0; i < KEYMAP_ENTRY_KEYMAPS_CAP; i++) {
+			if (entry->keymaps[i] == keymap) {
+				return entry;
+			}
+		}
+	}
+	return NULL;
+}
+
+static void keymap_entry_add_keymap(struct wlr_keyboard_keymap_entry *entry,
+		struct xkb_keymap *keymap) {
+	for (size_t i = 0; i < KEYMAP_ENTRY_KEYMAPS_CAP; i++) {
+		if (entry->keymaps[i] == keymap) {
+			return;
+		}
+	}
+
+	size_t i = entry->keymaps_next;
+	entry->keymaps_next = (entry->keymaps_next + 1) % KEYMAP_ENTRY_KEYMAPS_CAP;
+	xkb_keymap_unref(entry->keymaps[i]);
+	entry->keymaps[i] = xkb_keymap_ref(keymap);
+}
+
+static struct wlr_keyboard_keymap_entry *keymap_entry_create(char *str,
+		size_t size, uint64_t hash) {
+	struct wlr_keyboard_keymap_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	int rw_fd = -1, ro_fd = -1;
+	if (!allocate_shm_file_pair(size, &rw_fd, &ro_fd)) {
+		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
+		free(entry);
+		return NULL;
+	}
+
+	void *dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
+	close(rw_fd);
+	if (dst == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(ro_fd);
+		free(entry);
+		return NULL;
+	}
+
+	memcpy(dst, str, size);
+	munmap(dst, size);
+
+	entry->hash = hash;
+	entry->string = str;
+	entry->size = size;
+	entry->fd = ro_fd;
+	wl_list_insert(&keymap_entries, &entry->link);
+	return entry;
+}
+
+/**
+ * Get the entry for a keymap, creating it if no keyboard uses a keymap with
+ * the same contents yet. The returned entry is referenced.
+ */
+static struct wlr_keyboard_keymap_entry *keymap_entry_acquire(
+		struct xkb_keymap *keymap) {
+	struct wlr_keyboard_keymap_entry *entry = keymap_entry_find(keymap);
+	if (entry != NULL) {
+		entry->n_refs++;
+		return entry;
+	}
+
+	char *str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (str == NULL) {
+		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
+		return NULL;
+	}
+	size_t size = strlen(str) + 1;
+	uint64_t hash = hash_keymap_string(str, size);
+
+	bool found = false;
+	wl_list_for_each(entry, &keymap_entries, link) {
+		if (entry->hash == hash && entry->size == size &&
+				memcmp(entry->string, str, size) == 0) {
+			found = true;
+			break;
+		}
+	}
+
+	if (found) {
+		free(str);
+	} else {
+		entry = keymap_entry_create(str, size, hash);
+		if (entry == NULL) {
+			free(str);
+			return NULL;
+		}
+	}
+
+	keymap_entry_add_keymap(entry, keymap);
+	entry->n_refs++;
+	return entry;
+}
+
+static void keymap_entry_release(struct wlr_keyboard_keymap_entry *entry) {
+	if (entry == NULL) {
+		return;
+	}
+	assert(entry->n_refs > 0);
+	entry->n_refs--;
+	if (entry->n_refs > 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < KEYMAP_ENTRY_KEYMAPS_CAP; i++) {
+		xkb_keymap_unref(entry->keymaps[i]);
+	}
+	wl_list_remove(&entry->link);
+	close(entry->fd);
+	free(entry->string);
+	free(entry);
+}
+
 struct wlr_keyboard *wlr_keyboard_from_input_device(
 		struct wlr_input_device *input_device) {
 	assert(input_device->type == WLR_INPUT_DEVICE_KEYBOARD);
@@ -143,12 +302,10 @@ static void keyboard_unset_keymap(struct wlr_keyboard *kb) {
 	kb->keymap = NULL;
 	xkb_state_unref(kb->xkb_state);
 	kb->xkb_state = NULL;
-	free(kb->keymap_string);
+	keymap_entry_release(kb->keymap_entry);
+	kb->keymap_entry = NULL;
 	kb->keymap_string = NULL;
 	kb->keymap_size = 0;
-	if (kb->keymap_fd >= 0) {
-		close(kb->keymap_fd);
-	}
 	kb->keymap_fd = -1;
 }
 
@@ -200,36 +357,19 @@ bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb, struct xkb_keymap *keymap)
 		return false;
 	}
 
-	char *keymap_str = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (keymap_str == NULL) {
-		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
-		goto error_xkb_state;
-	}
-	size_t keymap_size = strlen(keymap_str) + 1;
-
-	int rw_fd = -1, ro_fd = -1;
-	if (!allocate_shm_file_pair(keymap_size, &rw_fd, &ro_fd)) {
-		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
-		goto error_keymap_str;
-	}
-
-	void *dst = mmap(NULL, keymap_size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
-	close(rw_fd);
-	if (dst == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(ro_fd);
-		goto error_keymap_str;
+	struct wlr_keyboard_keymap_entry *entry = keymap_entry_acquire(keymap);
+	if (entry == NULL) {
+		xkb_state_unref(xkb_state);
+		return false;
 	}
 
-	memcpy(dst, keymap_str, keymap_size);
-	munmap(dst, keymap_size);
-
 	keyboard_unset_keymap(kb);
 	kb->keymap = xkb_keymap_ref(keymap);
 	kb->xkb_state = xkb_state;
-	kb->keymap_string = keymap_str;
-	kb->keymap_size = keymap_size;
-	kb->keymap_fd = ro_fd;
+	kb->keymap_entry = entry;
+	kb->keymap_string = entry->string;
+	kb->keymap_size = entry->size;
+	kb->keymap_fd = entry->fd;
 
 	const char *led_names[WLR_LED_COUNT] = {
 		XKB_LED_NAME_NUM,
@@ -267,12 +407,6 @@ bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb, struct xkb_keymap *keymap)
 	wl_signal_emit_mutable(&kb->events.keymap, kb);
 
 	return true;
-
-error_keymap_str:
-	free(keymap_str);
-error_xkb_state:
-	xkb_state_unref(xkb_state);
-	return false;
 }
 
 void wlr_keyboard_set_repeat_info(struct wlr_keyboard *kb, int32_t rate,
@@ -305,14 +439,41 @@ bool wlr_keyboard_keymaps_match(struct xkb_keymap *km1,
 	if (!km1 || !km2) {
 		return false;
 	}
-	char *km1_str = xkb_keymap_get_as_string(km1, XKB_KEYMAP_FORMAT_TEXT_V1);
-	char *km2_str = xkb_keymap_get_as_string(km2, XKB_KEYMAP_FORMAT_TEXT_V1);
-	bool result = strcmp(km1_str, km2_str) == 0;
-	free(km1_str);
-	free(km2_str);
+	if (km1 == km2) {
+		return true;
+	}
+
+	struct wlr_keyboard_keymap_entry *entry1 = keymap_entry_find(km1);
+	struct wlr_keyboard_keymap_entry *entry2 = keymap_entry_find(km2);
+	if (entry1 != NULL && entry2 != NULL) {
+		return entry1 == entry2;
+	}
+
+	char *km1_str = entry1 != NULL ? entry1->string :
+		xkb_keymap_get_as_string(km1, XKB_KEYMAP_FORMAT_TEXT_V1);
+	char *km2_str = entry2 != NULL ? entry2->string :
+		xkb_keymap_get_as_string(km2, XKB_KEYMAP_FORMAT_TEXT_V1);
+	bool result = km1_str != NULL && km2_str != NULL &&
+		strcmp(km1_str, km2_str) == 0;
+	if (entry1 == NULL) {
+		free(km1_str);
+	}
+	if (entry2 == NULL) {
+		free(km2_str);
+	}
 	return result;
 }
 
+bool keyboard_keymaps_match(const struct wlr_keyboard *kb1,
+		const struct wlr_keyboard *kb2) {
+	if (kb1->keymap_entry != NULL && kb2->keymap_entry != NULL) {
+		return kb1->keymap_entry == kb2->keymap_entry;
+	}
+	// Keyboards without a keymap are handled the same way as by
+	// wlr_keyboard_keymaps_match()
+	return wlr_keyboard_keymaps_match(kb1->keymap, kb2->keymap);
+}
+
 uint32_t wlr_keyboard_keysym_to_pointer_button(xkb_keysym_t keysym) {
 	switch (keysym) {
 	case XKB_KEY_Pointer_Button1:
@@ -142,12 +142,10 @@ static void handle_keyboard_keymap(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, group_device, keymap);
 	struct wlr_keyboard *keyboard = group_device->keyboard;
 
-	if (!wlr_keyboard_keymaps_match(keyboard->group->keyboard.keymap,
-				keyboard->keymap)) {
+	if (!keyboard_keymaps_match(&keyboard->group->keyboard, keyboard)) {
 		struct keyboard_group_device *device;
 		wl_list_for_each(device, &keyboard->group->devices, link) {
-			if (!wlr_keyboard_keymaps_match(keyboard->keymap,
-						device->keyboard->keymap)) {
+			if (!keyboard_keymaps_match(keyboard, device->keyboard)) {
 				wlr_keyboard_set_keymap(device->keyboard, keyboard->keymap);
 				return;
 			}
@@ -247,7 +245,7 @@ bool wlr_keyboard_group_add_keyboard(struct wlr_keyboard_group *group,
 		return false;
 	}
 
-	if (!wlr_keyboard_keymaps_match(group->keyboard.keymap, keyboard->keymap)) {
+	if (!keyboard_keymaps_match(&group->keyboard, keyboard)) {
 		wlr_log(WLR_ERROR, "Device keymap does not match keyboard group's");
 		return false;
 	}
@@ -37,6 +37,8 @@ struct wlr_linux_dmabuf_feedback_v1_compiled_tranche {
 };
 
 struct wlr_linux_dmabuf_feedback_v1_compiled {
+	size_t n_refs;
+
 	dev_t main_device;
 	int table_fd;
 	size_t table_size;
@@ -54,6 +56,18 @@ struct wlr_linux_dmabuf_feedback_v1_table_entry {
 static_assert(sizeof(struct wlr_linux_dmabuf_feedback_v1_table_entry) == 16,
 	"Expected wlr_linux_dmabuf_feedback_v1_table_entry to be tightly packed");
 
+// Compiled feedback shared by all surfaces using the same init options
+struct wlr_linux_dmabuf_v1_feedback_cache_entry {
+	struct wl_list link; // wlr_linux_dmabuf_v1.feedback_cache
+
+	struct wlr_renderer *main_renderer;
+	struct wlr_output *scanout_primary_output; // may be NULL
+	struct wlr_linux_dmabuf_feedback_v1_compiled *feedback;
+
+	struct wl_listener renderer_destroy;
+	struct wl_listener output_destroy;
+};
+
 struct wlr_linux_dmabuf_v1_surface {
 	struct wlr_surface *surface;
 	struct wlr_linux_dmabuf_v1 *linux_dmabuf;
@@ -480,30 +494,23 @@ static const struct zwp_linux_dmabuf_feedback_v1_interface
 	.destroy = linux_dmabuf_feedback_destroy,
 };
 
+/**
+ * Get the index of a format + modifier pair in the format table built from a
+ * format set. offsets contains the index of the first modifier of each format
+ * of the set.
+ */
 static ssize_t get_drm_format_set_index(const struct wlr_drm_format_set *set,
-		uint32_t format, uint64_t modifier) {
-	bool format_found = false;
-	const struct wlr_drm_format *fmt;
-	size_t idx = 0;
-	for (size_t i = 0; i < set->len; i++) {
-		fmt = &set->formats[i];
-		if (fmt->format == format) {
-			format_found = true;
-			break;
-		}
-		idx += fmt->len;
-	}
-	if (!format_found) {
+		const size_t *offsets, uint32_t format, uint64_t modifier) {
+	const struct wlr_drm_format *fmt = wlr_drm_format_set_get(set, format);
+	if (fmt == NULL) {
 		return -1;
 	}
 
-	for (size_t i = 0; i < fmt->len; i++) {
-		if (fmt->modifiers[i] == modifier) {
-			return idx;
-		}
-		idx++;
+	ssize_t idx = wlr_drm_format_get_modifier_index(fmt, modifier);
+	if (idx < 0) {
+		return -1;
 	}
-	return -1;
+	return offsets[fmt - set->formats] + idx;
 }
 
 static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
@@ -515,6 +522,7 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 	// Make one big format set that contains all formats across all tranches so that we
 	// can build an index
 	struct wlr_drm_format_set all_formats = {0};
+	size_t *offsets = NULL;
 	for (size_t i = 0; i < tranches_len; i++) {
 		const struct wlr_linux_dmabuf_feedback_v1_tranche *tranche = &tranches[i];
 		if (!wlr_drm_format_set_union(&all_formats, &all_formats, &tranche->formats)) {
@@ -523,9 +531,16 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 		}
 	}
 
+	offsets = calloc(all_formats.len, sizeof(*offsets));
+	if (offsets == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		goto err_all_formats;
+	}
+
 	size_t table_len = 0;
 	for (size_t i = 0; i < all_formats.len; i++) {
 		const struct wlr_drm_format *fmt = &all_formats.formats[i];
+		offsets[i] = table_len;
 		table_len += fmt->len;
 	}
 	assert(table_len > 0);
@@ -535,7 +550,7 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 	int rw_fd, ro_fd;
 	if (!allocate_shm_file_pair(table_size, &rw_fd, &ro_fd)) {
 		wlr_log(WLR_ERROR, "Failed to allocate shm file for format table");
-		return NULL;
+		goto err_all_formats;
 	}
 
 	struct wlr_linux_dmabuf_feedback_v1_table_entry *table =
@@ -572,6 +587,7 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 		goto err_all_formats;
 	}
 
+	compiled->n_refs = 1;
 	compiled->main_device = feedback->main_device;
 	compiled->tranches_len = tranches_len;
 	compiled->table_fd = ro_fd;
@@ -598,7 +614,7 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 			const struct wlr_drm_format *fmt = &tranche->formats.formats[j];
 			for (size_t k = 0; k < fmt->len; k++) {
 				ssize_t index = get_drm_format_set_index(
-					&all_formats, fmt->format, fmt->modifiers[k]);
+					&all_formats, offsets, fmt->format, fmt->modifiers[k]);
 				if (index < 0) {
 					wlr_log(WLR_ERROR, "Format 0x%" PRIX32 " and modifier "
 						"0x%" PRIX64 " are in tranche #%zu but are missing "
@@ -613,6 +629,7 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 		compiled_tranche->indices.size = n * sizeof(uint16_t);
 	}
 
+	free(offsets);
 	wlr_drm_format_set_finish(&all_formats);
 
 	return compiled;
@@ -621,15 +638,27 @@ error_compiled:
 	close(compiled->table_fd);
 	free(compiled);
 err_all_formats:
+	free(offsets);
 	wlr_drm_format_set_finish(&all_formats);
 	return NULL;
 }
 
-static void compiled_feedback_destroy(
+static struct wlr_linux_dmabuf_feedback_v1_compiled *compiled_feedback_ref(
+		struct wlr_linux_dmabuf_feedback_v1_compiled *feedback) {
+	feedback->n_refs++;
+	return feedback;
+}
+
+static void compiled_feedback_unref(
 		struct wlr_linux_dmabuf_feedback_v1_compiled *feedback) {
 	if (feedback == NULL) {
 		return;
 	}
+	assert(feedback->n_refs > 0);
+	feedback->n_refs--;
+	if (feedback->n_refs > 0) {
+		return;
+	}
 	for (size_t i = 0; i < feedback->tranches_len; i++) {
 		wl_array_release(&feedback->tranches[i].indices);
 	}
@@ -687,6 +716,84 @@ static void linux_dmabuf_get_default_feedback(struct wl_client *client,
 	feedback_send(linux_dmabuf->default_feedback, feedback_resource);
 }
 
+static void feedback_cache_entry_destroy(
+		struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry) {
+	compiled_feedback_unref(entry->feedback);
+	wl_list_remove(&entry->renderer_destroy.link);
+	wl_list_remove(&entry->output_destroy.link);
+	wl_list_remove(&entry->link);
+	free(entry);
+}
+
+static void feedback_cache_entry_handle_renderer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry =
+		wl_container_of(listener, entry, renderer_destroy);
+	feedback_cache_entry_destroy(entry);
+}
+
+static void feedback_cache_entry_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry =
+		wl_container_of(listener, entry, output_destroy);
+	feedback_cache_entry_destroy(entry);
+}
+
+/**
+ * Get the compiled feedback for the provided options, compiling it if it's
+ * not in the cache yet. The caller owns a reference to the returned feedback.
+ */
+static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_cache_get(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
+		const struct wlr_linux_dmabuf_feedback_v1_init_options *options) {
+	// Output layer feedback events are transient and can't be used as keys
+	bool cacheable = options->output_layer_feedback_event == NULL;
+
+	if (cacheable) {
+		struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry;
+		wl_list_for_each(entry, &linux_dmabuf->feedback_cache, link) {
+			if (entry->main_renderer == options->main_renderer &&
+					entry->scanout_primary_output == options->scanout_primary_output) {
+				return compiled_feedback_ref(entry->feedback);
+			}
+		}
+	}
+
+	struct wlr_linux_dmabuf_feedback_v1 feedback = {0};
+	if (!wlr_linux_dmabuf_feedback_v1_init_with_options(&feedback, options)) {
+		return NULL;
+	}
+	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled = feedback_compile(&feedback);
+	wlr_linux_dmabuf_feedback_v1_finish(&feedback);
+	if (compiled == NULL || !cacheable) {
+		return compiled;
+	}
+
+	struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		// Not fatal, the feedback just won't be shared
+		return compiled;
+	}
+
+	entry->main_renderer = options->main_renderer;
+	entry->scanout_primary_output = options->scanout_primary_output;
+	entry->feedback = compiled_feedback_ref(compiled);
+
+	entry->renderer_destroy.notify = feedback_cache_entry_handle_renderer_destroy;
+	wl_signal_add(&options->main_renderer->events.destroy, &entry->renderer_destroy);
+	if (options->scanout_primary_output != NULL) {
+		entry->output_destroy.notify = feedback_cache_entry_handle_output_destroy;
+		wl_signal_add(&options->scanout_primary_output->events.destroy,
+			&entry->output_destroy);
+	} else {
+		wl_list_init(&entry->output_destroy.link);
+	}
+
+	wl_list_insert(&linux_dmabuf->feedback_cache, &entry->link);
+
+	return compiled;
+}
+
 static void surface_destroy(struct wlr_linux_dmabuf_v1_surface *surface) {
 	struct wl_resource *resource, *resource_tmp;
 	wl_resource_for_each_safe(resource, resource_tmp, &surface->feedback_resources) {
@@ -695,7 +802,7 @@ static void surface_destroy(struct wlr_linux_dmabuf_v1_surface *surface) {
 		wl_list_init(link);
 	}
 
-	compiled_feedback_destroy(surface->feedback);
+	compiled_feedback_unref(surface->feedback);
 
 	wlr_addon_finish(&surface->addon);
 	wl_list_remove(&surface->link);
@@ -866,7 +973,12 @@ static void linux_dmabuf_v1_destroy(struct wlr_linux_dmabuf_v1 *linux_dmabuf) {
 		surface_destroy(surface);
 	}
 
-	compiled_feedback_destroy(linux_dmabuf->default_feedback);
+	struct wlr_linux_dmabuf_v1_feedback_cache_entry *entry, *entry_tmp;
+	wl_list_for_each_safe(entry, entry_tmp, &linux_dmabuf->feedback_cache, link) {
+		feedback_cache_entry_destroy(entry);
+	}
+
+	compiled_feedback_unref(linux_dmabuf->default_feedback);
 	wlr_drm_format_set_finish(&linux_dmabuf->default_formats);
 	if (linux_dmabuf->main_device_fd >= 0) {
 		close(linux_dmabuf->main_device_fd);
@@ -928,7 +1040,7 @@ static bool set_default_feedback(struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 		}
 	}
 
-	compiled_feedback_destroy(linux_dmabuf->default_feedback);
+	compiled_feedback_unref(linux_dmabuf->default_feedback);
 	linux_dmabuf->default_feedback = compiled;
 
 	if (linux_dmabuf->main_device_fd >= 0) {
@@ -944,7 +1056,7 @@ static bool set_default_feedback(struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 error_formats:
 	wlr_drm_format_set_finish(&formats);
 error_compiled:
-	compiled_feedback_destroy(compiled);
+	compiled_feedback_unref(compiled);
 	return false;
 }
 
@@ -960,6 +1072,7 @@ struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_create(struct wl_display *displa
 	linux_dmabuf->main_device_fd = -1;
 
 	wl_list_init(&linux_dmabuf->surfaces);
+	wl_list_init(&linux_dmabuf->feedback_cache);
 
 	wl_signal_init(&linux_dmabuf->events.destroy);
 
@@ -1013,6 +1126,21 @@ void wlr_linux_dmabuf_v1_set_check_dmabuf_callback(struct wlr_linux_dmabuf_v1 *l
 	linux_dmabuf->check_dmabuf_callback_data = data;
 }
 
+/**
+ * Replace the surface's feedback, taking over the reference to the compiled
+ * feedback, and re-send it to clients.
+ */
+static void surface_set_compiled_feedback(struct wlr_linux_dmabuf_v1_surface *surface,
+		struct wlr_linux_dmabuf_feedback_v1_compiled *compiled) {
+	compiled_feedback_unref(surface->feedback);
+	surface->feedback = compiled;
+
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &surface->feedback_resources) {
+		feedback_send(surface_get_feedback(surface), resource);
+	}
+}
+
 bool wlr_linux_dmabuf_v1_set_surface_feedback(
 		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 		struct wlr_surface *wlr_surface,
@@ -1031,14 +1159,26 @@ bool wlr_linux_dmabuf_v1_set_surface_feedback(
 		}
 	}
 
-	compiled_feedback_destroy(surface->feedback);
-	surface->feedback = compiled;
+	surface_set_compiled_feedback(surface, compiled);
+	return true;
+}
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &surface->feedback_resources) {
-		feedback_send(surface_get_feedback(surface), resource);
+bool wlr_linux_dmabuf_v1_set_surface_feedback_with_options(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf, struct wlr_surface *wlr_surface,
+		const struct wlr_linux_dmabuf_feedback_v1_init_options *options) {
+	struct wlr_linux_dmabuf_v1_surface *surface =
+		surface_get_or_create(linux_dmabuf, wlr_surface);
+	if (surface == NULL) {
+		return false;
+	}
+
+	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled =
+		feedback_cache_get(linux_dmabuf, options);
+	if (compiled == NULL) {
+		return false;
 	}
 
+	surface_set_compiled_feedback(surface, compiled);
 	return true;
 }
 
@@ -5,6 +5,7 @@
 #include <wlr/render/allocator.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/backend.h>
 #include <wlr/util/box.h>
@@ -143,6 +144,8 @@ static void frame_destroy(struct wlr_screencopy_frame_v1 *frame) {
 			wlr_output_lock_software_cursors(frame->output, false);
 		}
 	}
+	wlr_texture_read_pixels_async_destroy(frame->read);
+	pixman_region32_fini(&frame->read_damage);
 	wl_list_remove(&frame->link);
 	wl_list_remove(&frame->output_commit.link);
 	wl_list_remove(&frame->output_destroy.link);
@@ -153,7 +156,9 @@ static void frame_destroy(struct wlr_screencopy_frame_v1 *frame) {
 	free(frame);
 }
 
-static void frame_send_damage(struct wlr_screencopy_frame_v1 *frame) {
+// Moves the damage accumulated since the last frame into the given region
+static void frame_take_damage(struct wlr_screencopy_frame_v1 *frame,
+		pixman_region32_t *region) {
 	if (!frame->with_damage) {
 		return;
 	}
@@ -164,8 +169,14 @@ static void frame_send_damage(struct wlr_screencopy_frame_v1 *frame) {
 		return;
 	}
 
+	pixman_region32_union(region, region, &damage->damage);
+	pixman_region32_clear(&damage->damage);
+}
+
+static void frame_send_damage(struct wlr_screencopy_frame_v1 *frame,
+		const pixman_region32_t *region) {
 	int n_boxes;
-	const pixman_box32_t *boxes = pixman_region32_rectangles(&damage->damage, &n_boxes);
+	const pixman_box32_t *boxes = pixman_region32_rectangles(region, &n_boxes);
 	for (int i = 0; i < n_boxes; i++) {
 		const pixman_box32_t *box = &boxes[i];
 
@@ -177,8 +188,6 @@ static void frame_send_damage(struct wlr_screencopy_frame_v1 *frame) {
 		zwlr_screencopy_frame_v1_send_damage(frame->resource,
 			damage_x, damage_y, damage_width, damage_height);
 	}
-
-	pixman_region32_clear(&damage->damage);
 }
 
 static void frame_send_ready(struct wlr_screencopy_frame_v1 *frame,
@@ -231,6 +240,73 @@ out:
 	return ok;
 }
 
+static void frame_handle_read_ready(struct wlr_texture_read_pixels_async *read,
+		void *data) {
+	struct wlr_screencopy_frame_v1 *frame = data;
+
+	bool ok = false;
+	void *dst;
+	uint32_t format;
+	size_t stride;
+	if (wlr_buffer_begin_data_ptr_access(frame->buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &dst, &format, &stride)) {
+		ok = wlr_texture_read_pixels_async_finish(read, dst, stride);
+		wlr_buffer_end_data_ptr_access(frame->buffer);
+	}
+
+	wlr_texture_read_pixels_async_destroy(frame->read);
+	frame->read = NULL;
+
+	if (!ok) {
+		wlr_log(WLR_DEBUG, "Failed to copy to destination during shm screencopy");
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	zwlr_screencopy_frame_v1_send_flags(frame->resource, 0);
+	frame_send_damage(frame, &frame->read_damage);
+	frame_send_ready(frame, &frame->read_when);
+	frame_destroy(frame);
+}
+
+// Starts copying without waiting for the GPU, the frame is completed from
+// frame_handle_read_ready(). Returns false if the renderer can't do it.
+static bool frame_shm_copy_async(struct wlr_screencopy_frame_v1 *frame,
+		struct wlr_buffer *src_buffer, const struct timespec *when) {
+	struct wlr_renderer *renderer = frame->output->renderer;
+	assert(renderer);
+
+	struct wlr_shm_attributes shm;
+	if (!wlr_buffer_get_shm(frame->buffer, &shm)) {
+		return false;
+	}
+
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, src_buffer);
+	if (!texture) {
+		return false;
+	}
+
+	struct wl_client *client = wl_resource_get_client(frame->resource);
+	struct wl_event_loop *loop = wl_display_get_event_loop(wl_client_get_display(client));
+	frame->read = wlr_texture_read_pixels_async_begin(texture,
+		&(struct wlr_texture_read_pixels_async_options){
+			.format = shm.format,
+			.src_box = frame->box,
+		}, loop, frame_handle_read_ready, frame);
+
+	// The renderer keeps what it needs until the copy completes
+	wlr_texture_destroy(texture);
+
+	if (frame->read == NULL) {
+		return false;
+	}
+
+	frame->read_when = *when;
+	frame_take_damage(frame, &frame->read_damage);
+	return true;
+}
+
 static bool frame_dma_copy(struct wlr_screencopy_frame_v1 *frame,
 		struct wlr_buffer *src_buffer) {
 	struct wlr_buffer *dst_buffer = frame->buffer;
@@ -324,6 +400,9 @@ static void frame_handle_output_commit(struct wl_listener *listener,
 		}
 		break;
 	case WLR_BUFFER_CAP_DATA_PTR:
+		if (frame_shm_copy_async(frame, src_buffer, &event->when)) {
+			return;
+		}
 		if (!frame_shm_copy(frame, src_buffer)) {
 			goto err;
 		}
@@ -332,10 +411,16 @@ static void frame_handle_output_commit(struct wl_listener *listener,
 		abort(); // unreachable
 	}
 
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	frame_take_damage(frame, &damage);
+
 	zwlr_screencopy_frame_v1_send_flags(frame->resource, 0);
-	frame_send_damage(frame);
+	frame_send_damage(frame, &damage);
 	frame_send_ready(frame, &event->when);
 	frame_destroy(frame);
+
+	pixman_region32_fini(&damage);
 	return;
 
 err:
@@ -494,6 +579,7 @@ static void capture_output(struct wl_client *wl_client,
 	}
 	frame->output = output;
 	frame->overlay_cursor = !!overlay_cursor;
+	pixman_region32_init(&frame->read_damage);
 
 	frame->resource = wl_resource_create(wl_client,
 		&zwlr_screencopy_frame_v1_interface, version, id);
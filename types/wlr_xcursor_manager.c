@@ -44,7 +44,7 @@ bool wlr_xcursor_manager_load(struct wlr_xcursor_manager *manager,
 		return false;
 	}
 	theme->scale = scale;
-	theme->theme = wlr_xcursor_theme_load(manager->name, manager->size * scale);
+	theme->theme = wlr_xcursor_theme_load_lazy(manager->name, manager->size * scale);
 	if (theme->theme == NULL) {
 		free(theme);
 		return false;
@@ -1,8 +1,15 @@
 #include <assert.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/util/region.h>
+#include "util/region.h"
+
+// Number of following rectangles considered when looking for a rectangle to
+// merge with in region_coalesce()
+#define COALESCE_WINDOW 8
 
 void wlr_region_scale(pixman_region32_t *dst, const pixman_region32_t *src,
 		float scale) {
@@ -36,6 +43,64 @@ void wlr_region_scale_xy(pixman_region32_t *dst, const pixman_region32_t *src,
 	free(dst_rects);
 }
 
+static void box_transform(pixman_box32_t *dst, const pixman_box32_t *src,
+		enum wl_output_transform transform, int width, int height) {
+	// dst and src may alias
+	pixman_box32_t box = *src;
+	src = &box;
+
+	switch (transform) {
+	case WL_OUTPUT_TRANSFORM_NORMAL:
+		dst->x1 = src->x1;
+		dst->y1 = src->y1;
+		dst->x2 = src->x2;
+		dst->y2 = src->y2;
+		break;
+	case WL_OUTPUT_TRANSFORM_90:
+		dst->x1 = height - src->y2;
+		dst->y1 = src->x1;
+		dst->x2 = height - src->y1;
+		dst->y2 = src->x2;
+		break;
+	case WL_OUTPUT_TRANSFORM_180:
+		dst->x1 = width - src->x2;
+		dst->y1 = height - src->y2;
+		dst->x2 = width - src->x1;
+		dst->y2 = height - src->y1;
+		break;
+	case WL_OUTPUT_TRANSFORM_270:
+		dst->x1 = src->y1;
+		dst->y1 = width - src->x2;
+		dst->x2 = src->y2;
+		dst->y2 = width - src->x1;
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED:
+		dst->x1 = width - src->x2;
+		dst->y1 = src->y1;
+		dst->x2 = width - src->x1;
+		dst->y2 = src->y2;
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+		dst->x1 = src->y1;
+		dst->y1 = src->x1;
+		dst->x2 = src->y2;
+		dst->y2 = src->x2;
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+		dst->x1 = src->x1;
+		dst->y1 = height - src->y2;
+		dst->x2 = src->x2;
+		dst->y2 = height - src->y1;
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+		dst->x1 = height - src->y2;
+		dst->y1 = width - src->x2;
+		dst->x2 = height - src->y1;
+		dst->y2 = width - src->x1;
+		break;
+	}
+}
+
 void wlr_region_transform(pixman_region32_t *dst, const pixman_region32_t *src,
 		enum wl_output_transform transform, int width, int height) {
 	if (transform == WL_OUTPUT_TRANSFORM_NORMAL) {
@@ -52,56 +117,7 @@ void wlr_region_transform(pixman_region32_t *dst, const pixman_region32_t *src,
 	}
 
 	for (int i = 0; i < nrects; ++i) {
-		switch (transform) {
-		case WL_OUTPUT_TRANSFORM_NORMAL:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_90:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_180:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_270:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		}
+		box_transform(&dst_rects[i], &src_rects[i], transform, width, height);
 	}
 
 	pixman_region32_fini(dst);
@@ -254,3 +270,197 @@ bool wlr_region_confine(const pixman_region32_t *region, double x1, double y1, d
 		return false;
 	}
 }
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void box_union(pixman_box32_t *dst, const pixman_box32_t *box) {
+	dst->x1 = dst->x1 < box->x1 ? dst->x1 : box->x1;
+	dst->y1 = dst->y1 < box->y1 ? dst->y1 : box->y1;
+	dst->x2 = dst->x2 > box->x2 ? dst->x2 : box->x2;
+	dst->y2 = dst->y2 > box->y2 ? dst->y2 : box->y2;
+}
+
+static bool box_intersects(const pixman_box32_t *a, const pixman_box32_t *b) {
+	return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+/**
+ * Returns the area which would be added by replacing both boxes with their
+ * bounding box. The boxes must not overlap.
+ */
+static int64_t box_merge_cost(const pixman_box32_t *a, const pixman_box32_t *b) {
+	pixman_box32_t bounds = *a;
+	box_union(&bounds, b);
+	return box_area(&bounds) - box_area(a) - box_area(b);
+}
+
+static int boxes_remove(pixman_box32_t *boxes, int nboxes, int i) {
+	memmove(&boxes[i], &boxes[i + 1], (nboxes - i - 1) * sizeof(*boxes));
+	return nboxes - 1;
+}
+
+/**
+ * Merge the cheapest pair of nearby boxes into their bounding box, then absorb
+ * any other box overlapping the result so that the boxes stay disjoint.
+ * Returns the new number of boxes.
+ */
+static int boxes_merge_best_pair(pixman_box32_t *boxes, int nboxes) {
+	assert(nboxes >= 2);
+
+	int best_i = 0, best_j = 1;
+	int64_t best_cost = INT64_MAX;
+	for (int i = 0; i < nboxes - 1 && best_cost > 0; i++) {
+		int end = i + 1 + COALESCE_WINDOW;
+		if (end > nboxes) {
+			end = nboxes;
+		}
+		for (int j = i + 1; j < end; j++) {
+			int64_t cost = box_merge_cost(&boxes[i], &boxes[j]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_i = i;
+				best_j = j;
+				if (cost <= 0) {
+					break;
+				}
+			}
+		}
+	}
+
+	int i = best_i;
+	box_union(&boxes[i], &boxes[best_j]);
+	nboxes = boxes_remove(boxes, nboxes, best_j);
+
+	// Growing the box may make it overlap boxes it didn't overlap before, so
+	// rescan until nothing else gets absorbed
+	bool absorbed = true;
+	while (absorbed) {
+		absorbed = false;
+		for (int k = 0; k < nboxes; k++) {
+			if (k == i || !box_intersects(&boxes[i], &boxes[k])) {
+				continue;
+			}
+			box_union(&boxes[i], &boxes[k]);
+			nboxes = boxes_remove(boxes, nboxes, k);
+			if (k < i) {
+				i--;
+			}
+			k--;
+			absorbed = true;
+		}
+	}
+
+	return nboxes;
+}
+
+void region_coalesce(pixman_region32_t *region, int max_rects) {
+	if (max_rects < 1) {
+		max_rects = 1;
+	}
+
+	int nboxes;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &nboxes);
+	if (nboxes <= max_rects) {
+		return;
+	}
+
+	pixman_box32_t *boxes = malloc(nboxes * sizeof(*boxes));
+	if (boxes == NULL) {
+		return;
+	}
+	memcpy(boxes, rects, nboxes * sizeof(*boxes));
+
+	// The boxes are kept disjoint, but pixman splits them into y-x bands
+	// when building the region, which may need more rectangles than there
+	// are boxes. Keep merging until the banded region fits in the budget.
+	// This always terminates, since a single box is a single rectangle.
+	while (nboxes > max_rects) {
+		nboxes = boxes_merge_best_pair(boxes, nboxes);
+	}
+	while (true) {
+		pixman_region32_t coalesced;
+		if (!pixman_region32_init_rects(&coalesced, boxes, nboxes)) {
+			break;
+		}
+		if (pixman_region32_n_rects(&coalesced) <= max_rects) {
+			pixman_region32_fini(region);
+			// pixman_region32_t is safe to move
+			*region = coalesced;
+			break;
+		}
+		pixman_region32_fini(&coalesced);
+		nboxes = boxes_merge_best_pair(boxes, nboxes);
+	}
+
+	free(boxes);
+}
+
+static void box_map(pixman_box32_t *box, const struct region_map_options *options) {
+	box->x1 += options->dx;
+	box->y1 += options->dy;
+	box->x2 += options->dx;
+	box->y2 += options->dy;
+
+	// Same rounding as wlr_region_scale_xy()
+	if (options->scale_x != 1.0 || options->scale_y != 1.0) {
+		box->x1 = floor(box->x1 * options->scale_x);
+		box->x2 = ceil(box->x2 * options->scale_x);
+		box->y1 = floor(box->y1 * options->scale_y);
+		box->y2 = ceil(box->y2 * options->scale_y);
+	}
+
+	box->x1 -= options->expand;
+	box->y1 -= options->expand;
+	box->x2 += options->expand;
+	box->y2 += options->expand;
+
+	box_transform(box, box, options->transform, options->width, options->height);
+}
+
+static bool box_clip(pixman_box32_t *box, const pixman_box32_t *clip) {
+	box->x1 = box->x1 > clip->x1 ? box->x1 : clip->x1;
+	box->y1 = box->y1 > clip->y1 ? box->y1 : clip->y1;
+	box->x2 = box->x2 < clip->x2 ? box->x2 : clip->x2;
+	box->y2 = box->y2 < clip->y2 ? box->y2 : clip->y2;
+	return box->x1 < box->x2 && box->y1 < box->y2;
+}
+
+bool region_map(pixman_region32_t *dst, const pixman_region32_t *src,
+		const struct region_map_options *options, struct wl_array *scratch) {
+	assert(options->expand >= 0);
+
+	int nrects;
+	const pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+
+	// wl_array_add() never shrinks the allocation, so the scratch buffer
+	// quickly stops allocating
+	scratch->size = 0;
+	pixman_box32_t *dst_rects = wl_array_add(scratch, nrects * sizeof(*dst_rects));
+	if (dst_rects == NULL) {
+		pixman_box32_t extents = *pixman_region32_extents(src);
+		box_map(&extents, options);
+		if (options->clip != NULL && !box_clip(&extents, options->clip)) {
+			extents = (pixman_box32_t){0};
+		}
+		pixman_region32_fini(dst);
+		pixman_region32_init_with_extents(dst, &extents);
+		return false;
+	}
+
+	int dst_nrects = 0;
+	for (int i = 0; i < nrects; i++) {
+		pixman_box32_t box = src_rects[i];
+		box_map(&box, options);
+		if (options->clip != NULL && !box_clip(&box, options->clip)) {
+			continue;
+		}
+		dst_rects[dst_nrects++] = box;
+	}
+
+	// src isn't used anymore, so dst may alias it
+	pixman_region32_fini(dst);
+	pixman_region32_init_rects(dst, dst_rects, dst_nrects);
+	return true;
+}
@@ -31,6 +31,12 @@
 #include <wlr/xcursor.h>
 #include "xcursor/xcursor.h"
 
+struct wlr_xcursor_theme_file {
+	char *name;
+	char *path;
+	bool tried; // whether we've already attempted to decode it
+};
+
 static void xcursor_destroy(struct wlr_xcursor *cursor) {
 	for (size_t i = 0; i < cursor->image_count; i++) {
 		free(cursor->images[i]->buffer);
@@ -172,32 +178,97 @@ static struct wlr_xcursor *xcursor_create_from_xcursor_images(
 static struct wlr_xcursor *xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme,
 	const char *name);
 
+static struct wlr_xcursor *theme_add_cursor(struct wlr_xcursor_theme *theme,
+		struct xcursor_images *images) {
+	struct wlr_xcursor *cursor = xcursor_create_from_xcursor_images(images, theme);
+	if (cursor == NULL) {
+		return NULL;
+	}
+
+	theme->cursor_count++;
+	struct wlr_xcursor **cursors = realloc(theme->cursors,
+		theme->cursor_count * sizeof(theme->cursors[0]));
+	if (cursors == NULL) {
+		theme->cursor_count--;
+		xcursor_destroy(cursor);
+		return NULL;
+	}
+	theme->cursors = cursors;
+	theme->cursors[theme->cursor_count - 1] = cursor;
+	return cursor;
+}
+
 static void load_callback(struct xcursor_images *images, void *data) {
 	struct wlr_xcursor_theme *theme = data;
 
-	if (xcursor_theme_get_cursor(theme, images->name)) {
-		xcursor_images_destroy(images);
+	if (!xcursor_theme_get_cursor(theme, images->name)) {
+		theme_add_cursor(theme, images);
+	}
+
+	xcursor_images_destroy(images);
+}
+
+static void scan_callback(const char *name, const char *path, void *data) {
+	struct wlr_xcursor_theme *theme = data;
+
+	if (theme->files_len == theme->files_cap) {
+		size_t cap = theme->files_cap == 0 ? 64 : theme->files_cap * 2;
+		struct wlr_xcursor_theme_file *files =
+			realloc(theme->files, cap * sizeof(files[0]));
+		if (files == NULL) {
+			return;
+		}
+		theme->files = files;
+		theme->files_cap = cap;
+	}
+
+	struct wlr_xcursor_theme_file *file = &theme->files[theme->files_len];
+	*file = (struct wlr_xcursor_theme_file){
+		.name = strdup(name),
+		.path = strdup(path),
+	};
+	if (file->name == NULL || file->path == NULL) {
+		free(file->name);
+		free(file->path);
 		return;
 	}
+	theme->files_len++;
+}
 
-	struct wlr_xcursor *cursor = xcursor_create_from_xcursor_images(images, theme);
-	if (cursor) {
-		theme->cursor_count++;
-		struct wlr_xcursor **cursors = realloc(theme->cursors,
-			theme->cursor_count * sizeof(theme->cursors[0]));
-		if (cursors == NULL) {
-			theme->cursor_count--;
-			xcursor_destroy(cursor);
-		} else {
-			theme->cursors = cursors;
-			theme->cursors[theme->cursor_count - 1] = cursor;
+/**
+ * Decode a cursor from the files indexed by wlr_xcursor_theme_load_lazy().
+ * Like when loading eagerly, the first file with the name which can be
+ * decoded wins.
+ */
+static struct wlr_xcursor *theme_load_cursor(struct wlr_xcursor_theme *theme,
+		const char *name) {
+	for (size_t i = 0; i < theme->files_len; i++) {
+		struct wlr_xcursor_theme_file *file = &theme->files[i];
+		if (file->tried || strcmp(file->name, name) != 0) {
+			continue;
+		}
+		file->tried = true;
+
+		struct xcursor_images *images = xcursor_load_images(file->path, theme->size);
+		if (images == NULL) {
+			continue;
+		}
+		images->name = strdup(name);
+
+		struct wlr_xcursor *cursor = NULL;
+		if (images->name != NULL) {
+			cursor = theme_add_cursor(theme, images);
+		}
+		xcursor_images_destroy(images);
+		if (cursor != NULL) {
+			return cursor;
 		}
 	}
 
-	xcursor_images_destroy(images);
+	return NULL;
 }
 
-struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
+static struct wlr_xcursor_theme *theme_create(const char *name, int size) {
 	struct wlr_xcursor_theme *theme = calloc(1, sizeof(*theme));
 	if (!theme) {
 		return NULL;
@@ -215,7 +286,20 @@ struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 	theme->cursor_count = 0;
 	theme->cursors = NULL;
 
-	xcursor_load_theme(name, size, load_callback, theme);
+	return theme;
+
+out_error_name:
+	free(theme);
+	return NULL;
+}
+
+struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
+	struct wlr_xcursor_theme *theme = theme_create(name, size);
+	if (theme == NULL) {
+		return NULL;
+	}
+
+	xcursor_load_theme(theme->name, size, load_callback, theme);
 
 	if (theme->cursor_count == 0) {
 		load_default_theme(theme);
@@ -225,16 +309,37 @@ struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 			theme->name, size, theme->cursor_count);
 
 	return theme;
+}
 
-out_error_name:
-	free(theme);
-	return NULL;
+struct wlr_xcursor_theme *wlr_xcursor_theme_load_lazy(const char *name, int size) {
+	struct wlr_xcursor_theme *theme = theme_create(name, size);
+	if (theme == NULL) {
+		return NULL;
+	}
+
+	if (size >= 0) {
+		xcursor_scan_theme(theme->name, scan_callback, theme);
+	}
+
+	if (theme->files_len == 0) {
+		load_default_theme(theme);
+	}
+
+	wlr_log(WLR_DEBUG, "Indexed cursor theme '%s' at size %d (%zu cursor files)",
+			theme->name, size, theme->files_len);
+
+	return theme;
 }
 
 void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 	for (unsigned int i = 0; i < theme->cursor_count; i++) {
 		xcursor_destroy(theme->cursors[i]);
 	}
+	for (size_t i = 0; i < theme->files_len; i++) {
+		free(theme->files[i].name);
+		free(theme->files[i].path);
+	}
+	free(theme->files);
 
 	free(theme->name);
 	free(theme->cursors);
@@ -252,9 +357,18 @@ static struct wlr_xcursor *xcursor_theme_get_cursor(struct wlr_xcursor_theme *th
 	return NULL;
 }
 
-struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme,
+static struct wlr_xcursor *theme_get_or_load_cursor(struct wlr_xcursor_theme *theme,
 		const char *name) {
 	struct wlr_xcursor *xcursor = xcursor_theme_get_cursor(theme, name);
+	if (xcursor == NULL) {
+		xcursor = theme_load_cursor(theme, name);
+	}
+	return xcursor;
+}
+
+struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme,
+		const char *name) {
+	struct wlr_xcursor *xcursor = theme_get_or_load_cursor(theme, name);
 	if (xcursor) {
 		return xcursor;
 	}
@@ -290,7 +404,7 @@ struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme
 	} else {
 		return NULL;
 	}
-	return xcursor_theme_get_cursor(theme, fallback);
+	return theme_get_or_load_cursor(theme, fallback);
 }
 
 static int xcursor_frame_and_duration(struct wlr_xcursor *cursor,
@@ -25,11 +25,15 @@
 
 #undef _POSIX_C_SOURCE
 #define _DEFAULT_SOURCE // for d_type in struct dirent
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "config.h"
 #include "xcursor/xcursor.h"
 
@@ -198,16 +202,28 @@ xcursor_images_destroy(struct xcursor_images *images)
 	free(images);
 }
 
+/*
+ * Cursor files are memory-mapped and read through this cursor, instead of
+ * going through stdio for each 32-bit word.
+ */
+struct xcursor_file {
+	const unsigned char *data;
+	size_t size;
+	size_t pos;
+};
+
 static bool
-xcursor_read_uint(FILE *file, uint32_t *u)
+xcursor_read_uint(struct xcursor_file *file, uint32_t *u)
 {
-	unsigned char bytes[4];
+	const unsigned char *bytes;
 
 	if (!file || !u)
 		return false;
 
-	if (fread(bytes, 1, 4, file) != 4)
+	if (file->size - file->pos < 4)
 		return false;
+	bytes = file->data + file->pos;
+	file->pos += 4;
 
 	*u = ((uint32_t)(bytes[0]) << 0) |
 		 ((uint32_t)(bytes[1]) << 8) |
@@ -216,6 +232,15 @@ xcursor_read_uint(FILE *file, uint32_t *u)
 	return true;
 }
 
+static bool
+xcursor_seek(struct xcursor_file *file, size_t pos)
+{
+	if (pos > file->size)
+		return false;
+	file->pos = pos;
+	return true;
+}
+
 static void
 xcursor_file_header_destroy(struct xcursor_file_header *file_header)
 {
@@ -242,7 +267,7 @@ xcursor_file_header_create(uint32_t ntoc)
 }
 
 static struct xcursor_file_header *
-xcursor_read_file_header(FILE *file)
+xcursor_read_file_header(struct xcursor_file *file)
 {
 	struct xcursor_file_header head, *file_header;
 	uint32_t skip;
@@ -261,9 +286,11 @@ xcursor_read_file_header(FILE *file)
 		return NULL;
 	if (!xcursor_read_uint(file, &head.ntoc))
 		return NULL;
+	if (head.header < XCURSOR_FILE_HEADER_LEN)
+		return NULL;
 	skip = head.header - XCURSOR_FILE_HEADER_LEN;
 	if (skip)
-		if (fseek(file, skip, SEEK_CUR) == EOF)
+		if (!xcursor_seek(file, file->pos + skip))
 			return NULL;
 	file_header = xcursor_file_header_create(head.ntoc);
 	if (!file_header)
@@ -288,18 +315,18 @@ xcursor_read_file_header(FILE *file)
 }
 
 static bool
-xcursor_seek_to_toc(FILE *file,
+xcursor_seek_to_toc(struct xcursor_file *file,
 		    struct xcursor_file_header *file_header,
 		    int toc)
 {
 	if (!file || !file_header ||
-	    fseek(file, file_header->tocs[toc].position, SEEK_SET) == EOF)
+	    !xcursor_seek(file, file_header->tocs[toc].position))
 		return false;
 	return true;
 }
 
 static bool
-xcursor_file_read_chunk_header(FILE *file,
+xcursor_file_read_chunk_header(struct xcursor_file *file,
 			       struct xcursor_file_header *file_header,
 			       int toc,
 			       struct xcursor_chunk_header *chunk_header)
@@ -382,15 +409,14 @@ xcursor_find_image_toc(struct xcursor_file_header *file_header,
 }
 
 static struct xcursor_image *
-xcursor_read_image(FILE *file,
+xcursor_read_image(struct xcursor_file *file,
 		   struct xcursor_file_header *file_header,
 		   int toc)
 {
 	struct xcursor_chunk_header chunk_header;
 	struct xcursor_image head;
 	struct xcursor_image *image;
-	int n;
-	uint32_t *p;
+	size_t n;
 
 	if (!file || !file_header)
 		return NULL;
@@ -426,20 +452,23 @@ xcursor_read_image(FILE *file,
 	image->xhot = head.xhot;
 	image->yhot = head.yhot;
 	image->delay = head.delay;
-	n = image->width * image->height;
-	p = image->pixels;
-	while (n--) {
-		if (!xcursor_read_uint(file, p)) {
-			xcursor_image_destroy(image);
-			return NULL;
-		}
-		p++;
+	n = (size_t)image->width * image->height;
+	if ((file->size - file->pos) / 4 < n) {
+		xcursor_image_destroy(image);
+		return NULL;
 	}
+#if WLR_LITTLE_ENDIAN
+	memcpy(image->pixels, file->data + file->pos, n * 4);
+	file->pos += n * 4;
+#else
+	for (size_t i = 0; i < n; i++)
+		xcursor_read_uint(file, &image->pixels[i]);
+#endif
 	return image;
 }
 
 static struct xcursor_images *
-xcursor_xc_file_load_images(FILE *file, int size)
+xcursor_xc_file_load_images(struct xcursor_file *file, int size)
 {
 	struct xcursor_file_header *file_header;
 	uint32_t best_size;
@@ -481,6 +510,40 @@ xcursor_xc_file_load_images(FILE *file, int size)
 	return images;
 }
 
+/** Load the images of a cursor file which best match a size
+ *
+ * The file is memory-mapped, only the image chunks of the selected size
+ * are read. The name of the returned images is left unset.
+ */
+struct xcursor_images *
+xcursor_load_images(const char *path, int size)
+{
+	struct xcursor_file file = {0};
+	struct xcursor_images *images;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	file.data = data;
+	file.size = st.st_size;
+	images = xcursor_xc_file_load_images(&file, size);
+
+	munmap(data, st.st_size);
+	return images;
+}
+
 /*
  * From libXcursor/src/library.c
  */
@@ -678,15 +741,13 @@ xcursor_theme_inherits(const char *full)
 }
 
 static void
-load_all_cursors_from_dir(const char *path, int size,
-			  void (*load_callback)(struct xcursor_images *, void *),
+scan_all_cursors_from_dir(const char *path,
+			  void (*scan_callback)(const char *, const char *, void *),
 			  void *user_data)
 {
-	FILE *f;
 	DIR *dir = opendir(path);
 	struct dirent *ent;
 	char *full;
-	struct xcursor_images *images;
 
 	if (!dir)
 		return;
@@ -703,20 +764,7 @@ load_all_cursors_from_dir(const char *path, int size,
 		if (!full)
 			continue;
 
-		f = fopen(full, "r");
-		if (!f) {
-			free(full);
-			continue;
-		}
-
-		images = xcursor_xc_file_load_images(f, size);
-
-		if (images) {
-			images->name = strdup(ent->d_name);
-			load_callback(images, user_data);
-		}
-
-		fclose(f);
+		scan_callback(ent->d_name, full, user_data);
 		free(full);
 	}
 
@@ -740,9 +788,8 @@ nodelist_contains(struct xcursor_nodelist *nodelist, const char *s, size_t ss) {
 }
 
 static void
-xcursor_load_theme_protected(const char *theme,
-			     int size,
-			     void (*load_callback)(struct xcursor_images *, void *),
+xcursor_scan_theme_protected(const char *theme,
+			     void (*scan_callback)(const char *, const char *, void *),
 			     void *user_data,
 			     struct xcursor_nodelist *visited_nodes)
 {
@@ -771,7 +818,7 @@ xcursor_load_theme_protected(const char *theme,
 
 		full = xcursor_build_fullname(dir, "cursors", "");
 		if (full) {
-			load_all_cursors_from_dir(full, size, load_callback,
+			scan_all_cursors_from_dir(full, scan_callback,
 						  user_data);
 			free(full);
 		}
@@ -789,13 +836,53 @@ xcursor_load_theme_protected(const char *theme,
 		si = strlen(i);
 		if (nodelist_contains(visited_nodes, i, si))
 			continue;
-		xcursor_load_theme_protected(i, size, load_callback, user_data, visited_nodes);
+		xcursor_scan_theme_protected(i, scan_callback, user_data, visited_nodes);
 	}
 
 	free(inherits);
 	free(xcursor_path);
 }
 
+/** List all the cursor files of a theme
+ *
+ * This function calls the scan callback with the name and path of each
+ * cursor file of a given theme and its inherited themes, in the same order
+ * as xcursor_load_theme(), without opening the files. If a cursor appears
+ * more than once across all the inherited themes, the scan callback will be
+ * called multiple times with the same name.
+ *
+ * \param theme The name of theme that should be scanned
+ * \param scan_callback A callback function that will be called for each
+ * cursor file, with the cursor name, the file path and the user data
+ * \param user_data The data that should be passed to the scan callback
+ */
+void
+xcursor_scan_theme(const char *theme,
+		   void (*scan_callback)(const char *, const char *, void *),
+		   void *user_data)
+{
+	xcursor_scan_theme_protected(theme, scan_callback, user_data, NULL);
+}
+
+struct xcursor_load_data {
+	int size;
+	void (*load_callback)(struct xcursor_images *, void *);
+	void *user_data;
+};
+
+static void
+load_scan_callback(const char *name, const char *path, void *data)
+{
+	struct xcursor_load_data *load = data;
+	struct xcursor_images *images;
+
+	images = xcursor_load_images(path, load->size);
+	if (!images)
+		return;
+	images->name = strdup(name);
+	load->load_callback(images, load->user_data);
+}
+
 /** Load all the cursor of a theme
  *
  * This function loads all the cursor images of a given theme and its
@@ -819,5 +906,13 @@ void
 xcursor_load_theme(const char *theme, int size,
 		   void (*load_callback)(struct xcursor_images *, void *),
 		   void *user_data) {
-	return xcursor_load_theme_protected(theme, size, load_callback, user_data, NULL);
+	struct xcursor_load_data load = {
+		.size = size,
+		.load_callback = load_callback,
+		.user_data = user_data,
+	};
+
+	if (size < 0)
+		return;
+	xcursor_scan_theme(theme, load_scan_callback, &load);
 }
@@ -13,6 +13,7 @@
 #include <xcb/render.h>
 #include <xcb/res.h>
 #include <xcb/xfixes.h>
+#include "util/array.h"
 #include "xwayland/xwm.h"
 
 static const char *const atom_map[ATOM_LAST] = {
@@ -123,11 +124,70 @@ struct wlr_xwayland_surface *wlr_xwayland_surface_try_from_wlr_surface(
 	return xsurface;
 }
 
-// TODO: replace this with hash table?
+#define XWM_SURFACE_BUCKETS_MIN 64
+
+static struct wl_list *xwm_get_surface_bucket(struct wlr_xwm *xwm,
+		xcb_window_t window_id) {
+	// Window IDs are allocated sequentially from a per-client base, mix the
+	// bits so that the low ones are well distributed
+	uint32_t hash = window_id * 0x9E3779B1u;
+	hash ^= hash >> 16;
+	return &xwm->surface_buckets[hash & (xwm->surface_buckets_len - 1)];
+}
+
+static bool xwm_init_surface_buckets(struct wlr_xwm *xwm) {
+	xwm->surface_buckets = calloc(XWM_SURFACE_BUCKETS_MIN, sizeof(*xwm->surface_buckets));
+	if (xwm->surface_buckets == NULL) {
+		return false;
+	}
+	xwm->surface_buckets_len = XWM_SURFACE_BUCKETS_MIN;
+	for (size_t i = 0; i < xwm->surface_buckets_len; i++) {
+		wl_list_init(&xwm->surface_buckets[i]);
+	}
+	return true;
+}
+
+static void xwm_grow_surface_buckets(struct wlr_xwm *xwm) {
+	size_t len = xwm->surface_buckets_len * 2;
+	struct wl_list *buckets = calloc(len, sizeof(*buckets));
+	if (buckets == NULL) {
+		// Keep going with longer chains
+		return;
+	}
+	for (size_t i = 0; i < len; i++) {
+		wl_list_init(&buckets[i]);
+	}
+
+	struct wl_list *old_buckets = xwm->surface_buckets;
+	size_t old_len = xwm->surface_buckets_len;
+	xwm->surface_buckets = buckets;
+	xwm->surface_buckets_len = len;
+
+	for (size_t i = 0; i < old_len; i++) {
+		struct wlr_xwayland_surface *surface, *tmp;
+		wl_list_for_each_safe(surface, tmp, &old_buckets[i], window_link) {
+			wl_list_remove(&surface->window_link);
+			wl_list_insert(xwm_get_surface_bucket(xwm, surface->window_id),
+				&surface->window_link);
+		}
+	}
+	free(old_buckets);
+}
+
+static void xwm_index_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *surface) {
+	if (xwm->surfaces_len >= xwm->surface_buckets_len) {
+		xwm_grow_surface_buckets(xwm);
+	}
+	wl_list_insert(xwm_get_surface_bucket(xwm, surface->window_id),
+		&surface->window_link);
+	xwm->surfaces_len++;
+}
+
 static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 		xcb_window_t window_id) {
 	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
+	wl_list_for_each(surface, xwm_get_surface_bucket(xwm, window_id), window_link) {
 		if (surface->window_id == window_id) {
 			return surface;
 		}
@@ -266,6 +326,7 @@ static struct wlr_xwayland_surface *xwayland_surface_create(
 	}
 
 	wl_list_insert(&xwm->surfaces, &surface->link);
+	xwm_index_surface(xwm, surface);
 
 	if (xwm->xres) {
 		read_surface_client_id(xwm, surface, client_id_cookie);
@@ -323,57 +384,101 @@ static void xwm_send_wm_message(struct wlr_xwayland_surface *surface,
 	xwm_schedule_flush(xwm);
 }
 
-static void xwm_set_net_client_list(struct wlr_xwm *xwm) {
-	// FIXME: _NET_CLIENT_LIST is expected to be ordered by map time, but the
-	// order of surfaces in `xwm->surfaces` is by creation time. The order of
-	// windows _NET_CLIENT_LIST exposed by wlroots is wrong.
-
-	size_t mapped_surfaces = 0;
-	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->surface != NULL && surface->surface->mapped) {
-			mapped_surfaces++;
-		}
+static void xwm_schedule_net_client_list_update(struct wlr_xwm *xwm) {
+	// The event source is gone while the XWM is being destroyed
+	if (xwm->event_source != NULL) {
+		xwm_schedule_flush(xwm);
 	}
+}
 
-	xcb_window_t *windows = NULL;
-	if (mapped_surfaces > 0) {
-		windows = malloc(sizeof(*windows) * mapped_surfaces);
-		if (!windows) {
+static void xwm_add_net_client_list(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *w;
+	wl_array_for_each(w, &xwm->client_list) {
+		if (*w == window) {
 			return;
 		}
+	}
 
-		size_t index = 0;
-		wl_list_for_each(surface, &xwm->surfaces, link) {
-			if (surface->surface != NULL && surface->surface->mapped) {
-				windows[index++] = surface->window_id;
-			}
-		}
+	w = wl_array_add(&xwm->client_list, sizeof(*w));
+	if (w == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
 	}
+	*w = window;
 
-	xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
-			xwm->screen->root, xwm->atoms[NET_CLIENT_LIST],
-			XCB_ATOM_WINDOW, 32, mapped_surfaces, windows);
-	free(windows);
+	xwm->client_list_dirty = true;
+	xwm_schedule_net_client_list_update(xwm);
 }
 
-static void xwm_set_net_client_list_stacking(struct wlr_xwm *xwm) {
-	size_t num_surfaces = wl_list_length(&xwm->surfaces_in_stack_order);
-	xcb_window_t *windows = malloc(sizeof(xcb_window_t) * num_surfaces);
-	if (!windows) {
-		return;
+static void xwm_remove_net_client_list(struct wlr_xwm *xwm, xcb_window_t window) {
+	xcb_window_t *w;
+	wl_array_for_each(w, &xwm->client_list) {
+		if (*w == window) {
+			array_remove_at(&xwm->client_list,
+				(char *)w - (char *)xwm->client_list.data, sizeof(*w));
+			xwm->client_list_dirty = true;
+			xwm_schedule_net_client_list_update(xwm);
+			return;
+		}
 	}
+}
+
+static void xwm_set_net_client_list_stacking(struct wlr_xwm *xwm) {
+	xwm->client_list_stacking_dirty = true;
+	xwm_schedule_net_client_list_update(xwm);
+}
+
+static void xwm_flush_net_client_list_stacking(struct wlr_xwm *xwm) {
+	// Compare the stacking order against the last one sent while updating it,
+	// restacks which end up not changing anything don't need a request
+	struct wl_array *list = &xwm->client_list_stacking;
+	size_t len = list->size / sizeof(xcb_window_t);
+	bool changed = false;
 
 	size_t i = 0;
 	struct wlr_xwayland_surface *xsurface;
 	wl_list_for_each(xsurface, &xwm->surfaces_in_stack_order, stack_link) {
-		windows[i++] = xsurface->window_id;
+		if (i == len) {
+			if (wl_array_add(list, sizeof(xcb_window_t)) == NULL) {
+				wlr_log(WLR_ERROR, "Allocation failed");
+				// Make sure the next flush sends the whole list
+				list->size = 0;
+				return;
+			}
+			len++;
+		}
+
+		xcb_window_t *windows = list->data;
+		if (windows[i] != xsurface->window_id) {
+			windows[i] = xsurface->window_id;
+			changed = true;
+		}
+		i++;
+	}
+	if (i < len) {
+		list->size = i * sizeof(xcb_window_t);
+		changed = true;
 	}
 
-	xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE, xwm->screen->root,
-			xwm->atoms[NET_CLIENT_LIST_STACKING], XCB_ATOM_WINDOW, 32, num_surfaces,
-			windows);
-	free(windows);
+	if (changed) {
+		xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE, xwm->screen->root,
+				xwm->atoms[NET_CLIENT_LIST_STACKING], XCB_ATOM_WINDOW, 32,
+				list->size / sizeof(xcb_window_t), list->data);
+	}
+}
+
+static void xwm_flush_net_client_lists(struct wlr_xwm *xwm) {
+	if (xwm->client_list_dirty) {
+		xcb_change_property(xwm->xcb_conn, XCB_PROP_MODE_REPLACE,
+				xwm->screen->root, xwm->atoms[NET_CLIENT_LIST],
+				XCB_ATOM_WINDOW, 32, xwm->client_list.size / sizeof(xcb_window_t),
+				xwm->client_list.data);
+		xwm->client_list_dirty = false;
+	}
+	if (xwm->client_list_stacking_dirty) {
+		xwm_flush_net_client_list_stacking(xwm);
+		xwm->client_list_stacking_dirty = false;
+	}
 }
 
 static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface);
@@ -618,6 +723,8 @@ static void xwayland_surface_destroy(struct wlr_xwayland_surface *xsurface) {
 	}
 
 	wl_list_remove(&xsurface->link);
+	wl_list_remove(&xsurface->window_link);
+	xsurface->xwm->surfaces_len--;
 	wl_list_remove(&xsurface->parent_link);
 
 	struct wlr_xwayland_surface *child, *next;
@@ -1118,12 +1225,12 @@ static void xwayland_surface_handle_commit(struct wl_listener *listener, void *d
 
 static void xwayland_surface_handle_map(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_surface *xsurface = wl_container_of(listener, xsurface, surface_map);
-	xwm_set_net_client_list(xsurface->xwm);
+	xwm_add_net_client_list(xsurface->xwm, xsurface->window_id);
 }
 
 static void xwayland_surface_handle_unmap(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_surface *xsurface = wl_container_of(listener, xsurface, surface_unmap);
-	xwm_set_net_client_list(xsurface->xwm);
+	xwm_remove_net_client_list(xsurface->xwm, xsurface->window_id);
 }
 
 static void xwayland_surface_handle_addon_destroy(struct wlr_addon *addon) {
@@ -1358,16 +1465,6 @@ void wlr_xwayland_surface_restack(struct wlr_xwayland_surface *xsurface,
 		return;
 	}
 
-	if (sibling != NULL) {
-		values[idx++] = sibling->window_id;
-		flags |= XCB_CONFIG_WINDOW_SIBLING;
-	}
-	values[idx++] = mode;
-
-	xcb_configure_window(xwm->xcb_conn, xsurface->window_id, flags, values);
-
-	wl_list_remove(&xsurface->stack_link);
-
 	struct wl_list *node;
 	if (mode == XCB_STACK_MODE_ABOVE) {
 		node = &sibling->stack_link;
@@ -1383,9 +1480,26 @@ void wlr_xwayland_surface_restack(struct wlr_xwayland_surface *xsurface,
 		abort();
 	}
 
+	if (sibling != NULL) {
+		values[idx++] = sibling->window_id;
+		flags |= XCB_CONFIG_WINDOW_SIBLING;
+	}
+	values[idx++] = mode;
+
+	// The stacking list only tracks managed surfaces, windows it doesn't know
+	// about (e.g. override-redirect ones) may sit in between in the X server,
+	// so always send the request
+	xcb_configure_window(xwm->xcb_conn, xsurface->window_id, flags, values);
+
+	// The scene graph restacks surfaces on every update, avoid re-sending
+	// _NET_CLIENT_LIST_STACKING if the surface is already at the right position
+	if (node->next == &xsurface->stack_link) {
+		return;
+	}
+
+	wl_list_remove(&xsurface->stack_link);
 	wl_list_insert(node, &xsurface->stack_link);
 	xwm_set_net_client_list_stacking(xwm);
-	xwm_schedule_flush(xwm);
 }
 
 static void xwm_handle_map_request(struct wlr_xwm *xwm,
@@ -2064,6 +2178,8 @@ static int x11_event_handler(int fd, uint32_t mask, void *data) {
 	}
 
 	if (mask & WL_EVENT_WRITABLE) {
+		xwm_flush_net_client_lists(xwm);
+
 		// xcb_flush() always blocks until it's written all pending requests,
 		// but it's the only thing we have
 		xcb_flush(xwm->xcb_conn);
@@ -2247,6 +2363,7 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	}
 	if (xwm->event_source) {
 		wl_event_source_remove(xwm->event_source);
+		xwm->event_source = NULL;
 	}
 #if HAVE_XCB_ERRORS
 	if (xwm->errors_context) {
@@ -2272,6 +2389,9 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 	}
 
 	xwm->xwayland->xwm = NULL;
+	wl_array_release(&xwm->client_list);
+	wl_array_release(&xwm->client_list_stacking);
+	free(xwm->surface_buckets);
 	free(xwm);
 }
 
@@ -2533,11 +2653,18 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *xwayland, int wm_fd) {
 		return NULL;
 	}
 
+	if (!xwm_init_surface_buckets(xwm)) {
+		free(xwm);
+		return NULL;
+	}
+
 	xwm->xwayland = xwayland;
 	wl_list_init(&xwm->surfaces);
 	wl_list_init(&xwm->surfaces_in_stack_order);
 	wl_list_init(&xwm->unpaired_surfaces);
 	wl_list_init(&xwm->pending_startup_ids);
+	wl_array_init(&xwm->client_list);
+	wl_array_init(&xwm->client_list_stacking);
 	wl_list_init(&xwm->seat_drag_source_destroy.link);
 	wl_list_init(&xwm->drag_focus_destroy.link);
 	wl_list_init(&xwm->drop_focus_destroy.link);
@@ -2549,6 +2676,7 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *xwayland, int wm_fd) {
 	int rc = xcb_connection_has_error(xwm->xcb_conn);
 	if (rc) {
 		wlr_log(WLR_ERROR, "xcb connect failed: %d", rc);
+		free(xwm->surface_buckets);
 		free(xwm);
 		return NULL;
 	}